@@ -0,0 +1,126 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "optimizer.hpp"
+#include "population.hpp"
+
+namespace audiogene {
+
+enum class MigrationTopology {
+    Ring,  //!< Each island sends its elites to the next one
+    FullyConnected,  //!< Each island sends its elites to every other island
+    Random  //!< Each island sends its elites to one other island chosen at random
+};
+
+auto migrationTopology(const std::string& name) -> MigrationTopology;
+
+/*!
+ * An island-model GA.
+ * Each island is an independent Population evolved on its own thread. Every
+ * migrationInterval generations the fittest individuals of each island replace
+ * the least fit of its neighbours, as given by the topology.
+ */
+class Archipelago final : public Optimizer {
+    std::shared_ptr<spdlog::logger> _logger;
+    const Math _math;
+
+    std::vector<std::unique_ptr<Population>> _islands;
+    uint32_t _generation;
+    const uint32_t _migrationInterval;
+    const size_t _migrants;
+    const MigrationTopology _topology;
+
+    // Workers wait for the round to change, evolve their island and count down
+    std::mutex _roundMutex;
+    std::condition_variable _roundCV;
+    std::condition_variable _doneCV;
+    uint64_t _round;
+    size_t _pending;
+    bool _stop;
+    std::vector<std::thread> _workers;
+
+    // Every island needs to hear every preference; the newest are passed on before each round
+    std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>> _preferencesQueue;
+    std::vector<std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>> _islandQueues;
+    bool _forwarded;
+
+    Counter& _migrations;
+    // Islands label their own gauges; these are the archipelago's as a whole
+    Gauge& _generationGauge;
+    Gauge& _bestFitness;
+
+    /*! Pass the newest preferences on to every island, waiting if asked and none ever have been */
+    void forwardPreferences(bool wait);
+    void migrate();
+    auto fittestIsland() -> Population&;
+
+ public:
+    Archipelago(size_t islands,
+                const PopulationConfig& island,
+                const Individual& seed,
+                uint32_t migrationInterval,
+                size_t migrants,
+                MigrationTopology topology);
+    Archipelago(const Archipelago&) = delete;
+    Archipelago& operator=(const Archipelago&) = delete;
+    ~Archipelago() final;
+
+    void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) final;
+    void setPreferences(const Preferences& preferences) final;
+
+    void nextGeneration() final;
+    /*! Islands finish their generations, but with a deadline nobody waits for preferences */
+    auto advance(std::chrono::steady_clock::time_point deadline) -> bool final;
+    auto fittest() -> Individual final;
+    /*! An equal share of n from each island */
+    auto sample(size_t n) -> Individuals final;
+    auto generation() const -> uint32_t final;
+    auto diversity() const -> double final;
+
+    auto checkpoint() const -> Checkpoint final;
+    void restore(const Checkpoint& checkpoint) final;
+    void warmStart(const Individuals& seeds, const Preferences& preferences) final;
+    void setReactions(const std::shared_ptr<const Reactions>& reactions) final;
+
+    void print(std::ostream& os) const final;
+};
+
+}  // namespace audiogene
@@ -22,16 +22,21 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <utility>
 
 #include "math.hpp"
+#include "metrics.hpp"
 #include "preference.hpp"
+#include "reactions.hpp"
 #include "blockingqueue.hpp"
 
 namespace audiogene {
@@ -42,32 +47,97 @@ using Attributes = std::map<AttributeName, Attribute>;
 /*! An interface that an input source must implement */
 class Audience {
  protected:
+    // Written by the input callbacks; everyone else copies them under the lock
     Preferences _preferences;
+    mutable std::mutex _preferencesMutex;
     std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>> _preferencesQueue;
     Math _math;
+    // Reactions are read from the input callbacks, which may already be running when they're attributed
+    std::shared_ptr<Reactions> _reactionsOwner;
+    std::atomic<Reactions*> _reactions;
+    // The last direction of input for each preference, to tell when the audience reverses,
+    // since the conductor change they were cleared at
+    std::map<AttributeName, int> _directions;
+    uint64_t _directionsSince;
+
+    Counter& _preferencesEnqueued;
+    Counter& _preferenceChanges;
+    Gauge& _preferencesQueueDepth;
+
+    Audience():
+            _reactions(nullptr),
+            _directionsSince(0),
+            _preferencesEnqueued(Metrics::instance().counter("audiogene_preferences_enqueued_total",
+                    "Preference snapshots sent from the audience to the population")),
+            _preferenceChanges(Metrics::instance().counter("audiogene_preference_changes_total",
+                    "Individual preference changes made by the audience")),
+            _preferencesQueueDepth(Metrics::instance().gauge("audiogene_preferences_queue_depth",
+                    "Approximate number of preference updates waiting to be read")) {
+        // empty constructor
+    }
+
+    auto enqueuePreferences() -> Preferences {
+        Preferences preferences = snapshot();
+        _preferencesQueue->enqueue(preferences);
+        _preferencesEnqueued.increment();
+        _preferencesQueueDepth.set(_preferencesQueue->size_approx());
+        return preferences;
+    }
 
  public:
     virtual ~Audience() = default;
     virtual auto prepare() -> bool = 0;
 
     void initializePreferences(const Attributes& attributes) {
-        for (const std::pair<AttributeName, Attribute>& p : attributes) {
-            _preferences.emplace(p.first, p.second);
+        {
+            std::lock_guard<std::mutex> l(_preferencesMutex);
+            for (const std::pair<AttributeName, Attribute>& p : attributes) {
+                _preferences.emplace(p.first, p.second);
+                _directions.emplace(p.first, 0);
+            }
+        }
+        enqueuePreferences();
+    }
+
+    /*! Pick up where a previous show left off */
+    void restorePreferences(const Preferences& preferences) {
+        {
+            std::lock_guard<std::mutex> l(_preferencesMutex);
+            for (const auto& p : preferences) {
+                if (_preferences.count(p.first) > 0) {
+                    _preferences.at(p.first) = p.second;
+                }
+            }
         }
-        _preferencesQueue->enqueue(_preferences);
+        enqueuePreferences();
     }
 
     void writeToPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) {
         _preferencesQueue = preferencesQueue;
     }
 
-    void gatherPreferences() {
-        _preferencesQueue->enqueue(_preferences);
+    /*! Count the audience's inputs against whichever conductor reactions says is playing */
+    void attributeReactions(const std::shared_ptr<Reactions>& reactions) {
+        _reactionsOwner = reactions;
+        _reactions.store(reactions.get(), std::memory_order_release);
+    }
+
+    /*! Send the population the latest preferences, and return what was sent */
+    auto gatherPreferences() -> Preferences {
+        return enqueuePreferences();
+    }
+
+    /*! The preferences as they are now; safe to take while the input callbacks are running */
+    auto snapshot() const -> Preferences {
+        std::lock_guard<std::mutex> l(_preferencesMutex);
+        return _preferences;
     }
 
     void preferenceUpdated(const AttributeName& name, const Preference& preference) {
         try {
+            std::lock_guard<std::mutex> l(_preferencesMutex);
             _preferences.at(name) = preference;
+            _preferenceChanges.increment();
         } catch (const std::out_of_range& e) {
             return;
         }
@@ -75,10 +145,27 @@ class Audience {
 
     void preferenceUpdated(const AttributeName& name, const int direction) {
         try {
-            Preference p = _preferences.at(name);
-            // here might be a good place to add backoff logic for excessive input from the audience
-            p.current = _math.clip(p.current + direction, p.min, p.max);
-            preferenceUpdated(name, p);
+            {
+                std::lock_guard<std::mutex> l(_preferencesMutex);
+                Preference& p = _preferences.at(name);
+                // here might be a good place to add backoff logic for excessive input from the audience
+                p.current = _math.clip(p.current + direction, p.min, p.max);
+                _preferenceChanges.increment();
+            }
+            Reactions* reactions = _reactions.load(std::memory_order_acquire);
+            if (reactions != nullptr) {
+                const uint64_t changes = reactions->changes();
+                if (changes != _directionsSince) {
+                    // A new conductor can't be reversed on until the audience has moved under it
+                    for (auto& d : _directions) {
+                        d.second = 0;
+                    }
+                    _directionsSince = changes;
+                }
+                int& last = _directions.at(name);
+                reactions->react(last * direction < 0);
+                last = direction;
+            }
         } catch (const std::out_of_range& e) {
             return;
         }
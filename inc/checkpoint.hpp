@@ -0,0 +1,110 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "instruction.hpp"
+#include "metrics.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+constexpr uint32_t CHECKPOINT_MAGIC = 0x4b434741;  // "AGCK"
+constexpr uint32_t CHECKPOINT_VERSION = 2;
+
+/*!
+ * On-disk layout of a checkpoint.
+ * The header is followed by sections at the given offsets, each 8-byte aligned,
+ * so the file can be mapped and the genomes read in place as doubles.
+ */
+struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;
+    uint32_t geneCount;
+    uint64_t individualCount;
+    uint64_t namesOffset;  //!< gene names, each NUL-terminated
+    uint64_t namesSize;
+    uint64_t preferencesOffset;  //!< geneCount x {min, max, current}
+    uint64_t genomesOffset;  //!< individualCount x geneCount, in name order
+    uint64_t fitnessOffset;  //!< individualCount
+    uint64_t rngOffset;  //!< population then genetics engine state, each NUL-terminated
+    uint64_t rngSize;
+    uint64_t islandCount;
+    uint64_t islandsOffset;  //!< islandCount x individuals on each island, between fitness and rng
+};
+
+/*! Everything needed to pick a population back up where it left off */
+struct Checkpoint {
+    uint32_t generation;
+    std::vector<AttributeName> genes;
+    std::vector<double> genomes;
+    std::vector<double> fitness;
+    //! How many of the genomes, in order, belong to each island; empty for a single population
+    std::vector<uint64_t> islands;
+    Preferences preferences;
+    std::string populationRng;
+    std::string geneticsRng;
+};
+
+auto writeCheckpoint(const std::string& path, const Checkpoint& checkpoint) -> bool;
+auto readCheckpoint(const std::string& path) -> Checkpoint;
+
+/*!
+ * Writes checkpoints on a background thread.
+ * Only the most recent checkpoint is kept if saves arrive faster than the disk
+ * can take them. Files are written beside the target and renamed into place.
+ */
+class Checkpointer {
+    std::shared_ptr<spdlog::logger> _logger;
+    const std::string _path;
+
+    std::mutex _pendingMutex;
+    std::condition_variable _pendingCV;
+    std::unique_ptr<Checkpoint> _pending;
+    bool _stop;
+    std::thread _thread;
+
+    Counter& _writes;
+    Counter& _failures;
+    Histogram& _writeDuration;
+
+ public:
+    explicit Checkpointer(std::string path);
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+    ~Checkpointer();
+
+    void save(Checkpoint checkpoint);
+};
+
+}  // namespace audiogene
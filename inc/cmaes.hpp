@@ -0,0 +1,157 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "optimizer.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+// Initial step size, in genes normalized to [0, 1]
+constexpr double CMAES_SIGMA = 0.3;
+// Weight of the penalty for sampling outside a gene's range
+constexpr double CMAES_BOUNDARY_PENALTY = 1.0;
+// When a preferred value moves by this fraction of its range, forget the learned shape and search widely again
+constexpr double CMAES_RESTART_SHIFT = 0.1;
+
+/*!
+ * Eigendecomposition of the symmetric n x n matrix a by cyclic Jacobi rotations.
+ * a is destroyed and left with the eigenvalues on its diagonal; the eigenvectors
+ * are the columns of v. n is the number of genes, so this is cheap.
+ */
+void jacobi(size_t n, std::vector<double>* a, std::vector<double>* v);
+
+/*!
+ * Covariance matrix adaptation evolution strategy.
+ * Samples lambda conductors from a multivariate normal over the genes (normalized
+ * to [0, 1]), and moves its mean, step size and covariance towards the fittest mu.
+ * The covariance uses the rank-one and rank-mu updates; its eigendecomposition is
+ * only refreshed every O(1 / (c1 + cmu) / n) generations.
+ */
+class CMAES final : public Optimizer {
+    mutable std::shared_ptr<spdlog::logger> _logger;
+    Math _math;
+    const std::shared_ptr<const Genes> _genes;
+    const size_t _n;
+    const size_t _lambda;
+    const size_t _mu;
+
+    // Strategy parameters, fixed by n and lambda
+    std::vector<double> _weights;
+    double _mueff;
+    double _cs;
+    double _ds;
+    double _cc;
+    double _c1;
+    double _cmu;
+    double _chiN;
+    const double _initialSigma;
+
+    // Distribution state; matrices are n x n, row-major
+    std::vector<double> _mean;
+    double _sigma;
+    std::vector<double> _ps;
+    std::vector<double> _pc;
+    std::vector<double> _C;
+    std::vector<double> _B;
+    std::vector<double> _D;
+    std::vector<double> _eigenWork;
+    uint32_t _updates;
+    uint64_t _evaluations;
+    uint64_t _eigenEvaluations;
+
+    // Scratch for one generation, preallocated
+    std::vector<double> _z;
+    std::vector<double> _y;
+    std::vector<double> _x;
+    std::vector<double> _yw;
+    std::vector<double> _work;
+    std::vector<size_t> _order;
+    Individuals _samples;
+    Individual _fittest;
+    uint32_t _generation;
+
+    // Where the audience's preferences arrive; each generation takes the newest without waiting
+    std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>> _preferencesQueue;
+    // The preferences the current generation is scored against; empty until the first arrive
+    Preferences _generationPreferences;
+    std::vector<double> _ideal;
+
+    Histogram& _generationDuration;
+    Counter& _preferencesTimeouts;
+    Counter& _eigendecompositions;
+    Counter& _restarts;
+    Gauge& _generationGauge;
+    Gauge& _sigmaGauge;
+    Gauge& _bestFitness;
+
+    void reset();
+    /*! Take the newest preferences, waiting if asked and none ever have arrived. False if there still aren't any */
+    auto takePreferences(bool wait) -> bool;
+    /*! Sample, rank and update the distribution */
+    void generate();
+    void updateIdeal(const Preferences& preferences);
+    void sample();
+    auto score(const double* x, Individual* individual) const -> double;
+    void update();
+    void decompose();
+
+ public:
+    /*! lambda of 0 uses the default, 4 + 3 ln(n) */
+    CMAES(const Individual& seed, size_t lambda, double sigma);
+    ~CMAES() final = default;
+
+    void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) final;
+    void setPreferences(const Preferences& preferences) final;
+
+    void nextGeneration() final;
+    /*! A generation can't stop part way, but with a deadline it never waits for preferences */
+    auto advance(std::chrono::steady_clock::time_point deadline) -> bool final;
+    auto fittest() -> Individual final;
+    auto generation() const -> uint32_t final;
+    auto diversity() const -> double final;
+    auto sigma() const -> double;
+    /*! Conductors sampled per generation */
+    auto lambda() const -> size_t;
+
+    auto checkpoint() const -> Checkpoint final;
+    void restore(const Checkpoint& checkpoint) final;
+    void warmStart(const Individuals& seeds, const Preferences& preferences) final;
+
+    void print(std::ostream& os) const final;
+};
+
+}  // namespace audiogene
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+constexpr size_t ARCHIVE_BINS = 8;
+constexpr size_t ARCHIVE_OFFERED = 32;
+// So a mistyped bins can't take all the memory
+constexpr size_t ARCHIVE_MAX_CELLS = 1 << 20;
+
+struct ArchiveConfig {
+    bool enabled;
+    //! Genes whose values say which cell a conductor is kept in
+    std::vector<std::string> descriptors;
+    //! Cells along each descriptor gene
+    size_t bins;
+    //! Conductors offered to the archive after each request
+    size_t offered;
+
+    ArchiveConfig():
+            enabled(false),
+            bins(ARCHIVE_BINS),
+            offered(ARCHIVE_OFFERED) {
+        // empty constructor
+    }
+};
+
+/*!
+ * A MAP-Elites archive of conductors.
+ * The range of each descriptor gene is split into bins, making a grid of
+ * cells, and each cell keeps the fittest conductor seen whose descriptors fall
+ * in it. Offers are sorted into cells on the archive's own thread, and elites
+ * are scored again whenever the preferences change. The cell the audience's
+ * preferences fall in is found by arithmetic, so when the audience jumps a
+ * conductor that already suits them is ready straight away, while the
+ * optimizer is still travelling there.
+ */
+class EliteArchive {
+    std::shared_ptr<spdlog::logger> _logger;
+    const Math _math;
+    const Genes _genes;
+    std::vector<size_t> _descriptors;
+    const size_t _bins;
+    const size_t _offered;
+
+    // Offers waiting for the archive's thread
+    std::mutex _incomingMutex;
+    std::condition_variable _wakeCV;
+    std::condition_variable _idleCV;
+    Individuals _incoming;
+    Preferences _incomingPreferences;
+    bool _haveIncoming;
+    bool _sorting;
+    bool _stop;
+
+    // Changed only by the archive's thread, under _cellsMutex
+    mutable std::mutex _cellsMutex;
+    Individuals _elites;
+    std::vector<uint8_t> _filled;
+    size_t _filledCount;
+
+    // The archive thread's own: the preferred genome elites were scored against, and the offers being sorted
+    Genome _ideal;
+    Individuals _offers;
+    Preferences _preferences;
+    std::thread _thread;
+
+    Gauge& _cellsFilled;
+    Counter& _elitesReplaced;
+    Counter& _conductorsPicked;
+
+    void run();
+    /*! Score every elite against new preferences, then sort the offers into cells */
+    void sort();
+    void idealOf(const Preferences& preferences, Genome* ideal) const;
+    void score(const Genome& ideal, Individual* individual) const;
+
+ public:
+    /*! The seed's genes give the descriptors' ranges */
+    EliteArchive(const ArchiveConfig& config, const Individual& seed);
+    EliteArchive(const EliteArchive&) = delete;
+    EliteArchive& operator=(const EliteArchive&) = delete;
+    ~EliteArchive();
+
+    /*! Hand conductors to the archive's thread to sort into cells, judged by these preferences */
+    void offer(const Individuals& conductors, const Preferences& preferences);
+    /*!
+     * Replace conductor with the elite of the cell the preferences fall in, if
+     * it's fitter against them. Says whether it was replaced.
+     */
+    auto challenge(const Preferences& preferences, Individual* conductor) const -> bool;
+    /*! Wait until every offer so far has been sorted into its cell */
+    void drain();
+    /*! The cell a genome's descriptors fall in; values at the top of a range fall in the last bin */
+    auto cellOf(const Genome& genome) const noexcept -> size_t;
+    /*! How many conductors to offer at a time */
+    auto offered() const noexcept -> size_t;
+    auto filled() const -> size_t;
+};
+
+}  // namespace audiogene
@@ -24,11 +24,38 @@
 
 #include <utility>
 #include <memory>
+#include <string>
 
-#include "instruction.hpp"
+#include "genome.hpp"
 
 namespace audiogene {
 
+// Bounds on a mutation's standard deviation, as a fraction of the gene's range
+constexpr double MIN_STEP = 1e-3;
+constexpr double MAX_STEP = 0.5;
+// After the 1/5th success rule: grow steps while more children improve than the target, shrink otherwise.
+// Most children only differ from their parents by crossover and can't beat the fitter one, so the target
+// is well under a fifth; halving keeps steps from lagging behind an audience that jumps
+constexpr double TARGET_SUCCESS_RATE = 0.05;
+constexpr double STEP_SCALE_FACTOR = 0.5;
+constexpr double MIN_STEP_SCALE = 0.01;
+constexpr double MAX_STEP_SCALE = MAX_STEP / INITIAL_STEP;
+
+struct MutationConfig {
+    double probability;
+    //! Each individual evolves its own per-gene step sizes, used for the genes probability picks
+    bool selfAdaptive;
+    //! Scale every step by how often children beat their parents
+    bool oneFifthRule;
+
+    explicit MutationConfig(const double probability):
+            probability(probability),
+            selfAdaptive(false),
+            oneFifthRule(false) {
+        // empty constructor
+    }
+};
+
 class Genetics {
     // forward-declare implementation class
     class Impl;
@@ -36,7 +63,7 @@ class Genetics {
     const Impl* Pimpl() const { return _impl.get(); }
     Impl* Pimpl() { return _impl.get(); }
  public:
-    explicit Genetics(const double mutationProbability);
+    explicit Genetics(const MutationConfig& config);
     ~Genetics();
 
     Genetics(Genetics&& rhs) = delete;
@@ -45,9 +72,20 @@ class Genetics {
     Genetics(const Genetics& rhs) = delete;
     Genetics& operator=(const Genetics& rhs) = delete;
 
-    static Instructions create(const Instructions& seed);
-    Instructions combine(const std::pair<Instructions, Instructions>& parents) const noexcept;
-    Instructions mutate(const Instructions& instructions) const noexcept;
+    // Genomes are written in place so a generation can be bred without allocating
+    static void create(const Genes& genes, Genome* genome);
+    /*! Draw every gene uniformly from its range */
+    void randomize(const Genes& genes, Genome* genome) const noexcept;
+    void combine(const Genome& first, const Genome& second, Genome* child) const noexcept;
+    void combineSteps(const StepSizes& first, const StepSizes& second, StepSizes* child) const noexcept;
+    void mutate(const Genes& genes, Genome* genome, StepSizes* steps) const noexcept;
+    /*! Mutate exactly one gene, chosen at random, by its step size */
+    void perturb(const Genes& genes, Genome* genome, const StepSizes& steps) const noexcept;
+    /*! Feed back the fraction of children fitter than their parents; returns the resulting step scale */
+    auto adapt(double successRate) -> double;
+
+    std::string rngState() const;
+    void restoreRng(const std::string& state);
 };
 
 }  // namespace audiogene
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "instruction.hpp"
+
+namespace audiogene {
+
+// The steps across a gene's range that a fixed16 gene can take
+constexpr double FIXED16_STEPS = std::numeric_limits<uint16_t>::max();
+
+/*! The encoding a gene packs with; whole-number genes that fit in 16 bits are packed as int16 unless told otherwise */
+inline auto resolveEncoding(const Expression& expression) -> ExpressionEncoding {
+    const bool fitsInt16 = expression.round
+            && expression.min >= std::numeric_limits<int16_t>::min()
+            && expression.max <= std::numeric_limits<int16_t>::max();
+    if (expression.encoding == ExpressionEncoding::Auto) {
+        return fitsInt16 ? ExpressionEncoding::Int16 : ExpressionEncoding::Double;
+    }
+    if (expression.encoding == ExpressionEncoding::Int16 && !fitsInt16) {
+        throw std::runtime_error("Only rounded genes within 16 bits can be int16");
+    }
+    return expression.encoding;
+}
+
+/*! The fixed description of a gene, shared by every individual that carries it */
+struct Gene {
+    AttributeName name;
+    double min;
+    double max;
+    bool round;
+    ExpressionActivates activates;
+    ExpressionEncoding encoding;
+
+    Gene(AttributeName name, const Expression& expression):
+            name(std::move(name)),
+            min(expression.min),
+            max(expression.max),
+            round(expression.round),
+            activates(expression.activates),
+            encoding(resolveEncoding(expression)) {
+        // empty constructor
+    }
+};
+
+using Genes = std::vector<Gene>;
+
+/*! A fixed16 gene's value at the given step across its range, which rounding can't take past max */
+inline auto fixed16Value(const double min, const double max, const double step) noexcept -> double {
+    return std::min(max, min + step / FIXED16_STEPS * (max - min));
+}
+
+/*!
+ * The nearest value to the given one, within the gene's range, that the gene's encoding can hold.
+ * Only packing uses it; genomes themselves keep full precision
+ */
+inline auto quantize(const Gene& gene, const double value) noexcept -> double {
+    const double clipped = std::min(gene.max, std::max(gene.min, value));
+    switch (gene.encoding) {
+    case ExpressionEncoding::Float32: {
+        // The nearest float to an end of the range may be just past it
+        auto narrowed = static_cast<float>(clipped);
+        if (narrowed > gene.max) {
+            narrowed = std::nextafter(narrowed, std::numeric_limits<float>::lowest());
+        }
+        if (narrowed < gene.min) {
+            narrowed = std::nextafter(narrowed, std::numeric_limits<float>::max());
+        }
+        return narrowed;
+    }
+    case ExpressionEncoding::Int16:
+        return std::min(std::floor(gene.max), std::max(std::ceil(gene.min), std::round(clipped)));
+    case ExpressionEncoding::Fixed16: {
+        const double range = gene.max - gene.min;
+        if (range <= 0) {
+            return gene.min;
+        }
+        return fixed16Value(gene.min, gene.max, std::round((clipped - gene.min) / range * FIXED16_STEPS));
+    }
+    default:
+        return clipped;
+    }
+}
+
+/*! The current value of each gene, in the same order as its Genes */
+using Genome = std::vector<double>;
+
+/*! How far each gene tends to move when mutated, as a fraction of its range */
+using StepSizes = std::vector<double>;
+
+// The same spread as Math::stddev, which fixed-step mutation uses
+constexpr double INITIAL_STEP = 1.0 / 6;
+
+}  // namespace audiogene
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "genome.hpp"
+
+namespace audiogene {
+
+// wyhash's mixing constants
+constexpr uint64_t HASH_SEED = 0xa0761d6478bd642full;
+constexpr uint64_t HASH_PRIME = 0xe7037ed1a0b428dbull;
+constexpr uint64_t HASH_FINAL = 0x8ebc6af09c88c6e3ull;
+// Slots per entry a GenomeTable keeps free, so probes stay short
+constexpr size_t GENOME_TABLE_LOAD = 2;
+
+/*! wyhash's multiply-and-fold: the 128 bit product of a and b, high half xor low half */
+inline auto hashMix(const uint64_t a, const uint64_t b) noexcept -> uint64_t {
+    __extension__ using uint128 = unsigned __int128;
+    const uint128 product = static_cast<uint128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+/*!
+ * A 64 bit hash of a genome's values, so equal genomes hash equally.
+ * Each value is hashed by its bits, with -0 folded into 0; rounded genes are
+ * already whole numbers so this quantises them for free.
+ */
+inline auto hashGenome(const Genome& genome) noexcept -> uint64_t {
+    uint64_t hash = HASH_SEED ^ genome.size();
+    for (const double value : genome) {
+        uint64_t bits;
+        const double folded = value == 0 ? 0.0 : value;
+        std::memcpy(&bits, &folded, sizeof(bits));
+        hash = hashMix(bits ^ HASH_PRIME, hash ^ HASH_FINAL);
+    }
+    return hashMix(hash ^ HASH_PRIME, HASH_FINAL);
+}
+
+/*!
+ * An open-addressing map from genome hash to a small value, such as a row in
+ * some other table. Clearing bumps a stamp instead of touching the slots, so
+ * it costs nothing however often it happens.
+ * Genomes are only compared by hash; at 64 bits a collision is not a concern
+ * for populations that fit in memory.
+ */
+class GenomeTable {
+    struct Slot {
+        uint64_t hash;
+        uint32_t stamp;
+        uint32_t value;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _mask;
+    uint32_t _stamp;
+    size_t _size;
+
+ public:
+    /*! Room for at least capacity entries */
+    explicit GenomeTable(const size_t capacity = 0):
+            _mask(0),
+            _stamp(1),
+            _size(0) {
+        reserve(capacity);
+    }
+
+    /*! Make room for capacity entries, forgetting every entry */
+    void reserve(const size_t capacity) {
+        size_t slots = 1;
+        while (slots < capacity * GENOME_TABLE_LOAD) {
+            slots <<= 1;
+        }
+        _slots.assign(slots, Slot{0, 0, 0});
+        _mask = slots - 1;
+        _stamp = 1;
+        _size = 0;
+    }
+
+    void clear() noexcept {
+        _size = 0;
+        if (++_stamp == 0) {
+            // Wrapped, so stale slots could look current again
+            for (Slot& slot : _slots) {
+                slot.stamp = 0;
+            }
+            _stamp = 1;
+        }
+    }
+
+    auto size() const noexcept -> size_t {
+        return _size;
+    }
+
+    /*! How many entries fit without crowding the table */
+    auto capacity() const noexcept -> size_t {
+        return _slots.size() / GENOME_TABLE_LOAD;
+    }
+
+    auto full() const noexcept -> bool {
+        return _size >= capacity();
+    }
+
+    /*! The value stored for hash, or nullptr */
+    auto find(const uint64_t hash) const noexcept -> const uint32_t* {
+        for (size_t i = hash & _mask; _slots[i].stamp == _stamp; i = (i + 1) & _mask) {
+            if (_slots[i].hash == hash) {
+                return &_slots[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    /*! Add hash unless it's already there; false if it was. The caller keeps the table from filling */
+    auto insert(const uint64_t hash, const uint32_t value) noexcept -> bool {
+        size_t i = hash & _mask;
+        for (; _slots[i].stamp == _stamp; i = (i + 1) & _mask) {
+            if (_slots[i].hash == hash) {
+                return false;
+            }
+        }
+        _slots[i] = Slot{hash, _stamp, value};
+        _size++;
+        return true;
+    }
+};
+
+}  // namespace audiogene
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+
+namespace audiogene {
+
+/*!
+ * A k-d tree over the genomes of a generation, for finding the individuals
+ * closest to a preferred genome under weighted L1 distance, which is what
+ * fitness measures. Stored implicitly: the node for a range is its median,
+ * split on the dimension with the widest spread. Buffers are kept between builds.
+ */
+class GenomeIndex {
+    size_t _dimensions;
+    size_t _size;
+    // Genomes, scaled by the weights so distance is plain L1; row-major
+    std::vector<double> _points;
+    // Individual index at each tree position, and the split dimension of that node
+    std::vector<size_t> _order;
+    std::vector<uint8_t> _split;
+    std::vector<double> _query;
+    // How far the query is from the cell being searched, in each dimension
+    std::vector<double> _offsets;
+    // Max-heap of the best (distance, individual) found so far
+    std::vector<std::pair<double, size_t>> _heap;
+
+    void build(size_t lo, size_t hi);
+    void search(size_t lo, size_t hi, size_t k, double bound);
+    auto coordinate(size_t position, size_t dimension) const noexcept -> double;
+
+ public:
+    GenomeIndex();
+
+    /*! Index the genomes of individuals; weights scale each gene's distance */
+    void build(const Individuals& individuals, const std::vector<double>& weights);
+    /*! Indices of the k individuals closest to ideal, closest first */
+    void nearest(const Genome& ideal, const std::vector<double>& weights, size_t k, std::vector<size_t>* result);
+    auto size() const noexcept -> size_t;
+};
+
+}  // namespace audiogene
@@ -25,6 +25,7 @@
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -32,31 +33,61 @@
 #include <utility>
 #include <vector>
 
+#include "genome.hpp"
 #include "instruction.hpp"
 
 namespace audiogene {
 
 class Individual {
     uint32_t _id;
-    Instructions _instructions;
+    std::shared_ptr<const Genes> _genes;
+    Genome _genome;
+    StepSizes _steps;
+    // Each gene's contribution to fitness; empty until scored
+    std::vector<double> _scores;
+    double _fitness;
 
-    static uint32_t s_id;
+    static std::atomic<uint32_t> s_id;
  public:
     /*! Create an individual from config values */
     explicit Individual(const std::map<std::string, std::map<std::string, std::string>>& instructions);
-    explicit Individual(Instructions instructions);
+    explicit Individual(const Instructions& instructions);
+    Individual(std::shared_ptr<const Genes> genes, Genome genome);
 
-    auto instructions() const noexcept -> Instructions;
+    auto id() const noexcept -> uint32_t;
+    /*! Take a new id and forget the scores, for when the genome has been rewritten in place */
+    void renew() noexcept;
+
+    auto genes() const noexcept -> const Genes&;
+    auto genome() const noexcept -> const Genome&;
+    auto mutableGenome() noexcept -> Genome*;
+    auto steps() const noexcept -> const StepSizes&;
+    auto mutableSteps() noexcept -> StepSizes*;
+
+    auto scores() const noexcept -> const std::vector<double>&;
+    auto mutableScores() noexcept -> std::vector<double>*;
+
+    auto fitness() const noexcept -> double;
+    void setFitness(double fitness) noexcept;
+
+    auto instructions() const -> Instructions;
     auto instruction(const std::string& name) const -> Instruction;
 
     template<typename OStream>
     friend OStream &operator<<(OStream &os, const Individual &obj) {
         os << "Individual " << obj._id << std::endl;
-        for (const std::pair<AttributeName, Instruction> &i : obj._instructions) {
-            os << "\t" << i.second << "\n";
+        for (size_t i = 0; i < obj._genome.size(); i++) {
+            const Gene& gene = (*obj._genes)[i];
+            os << "\tInstruction " << gene.name << ": current: " << obj._genome[i]
+               << ", min: " << gene.min << ", max: " << gene.max << "\n";
         }
         return os;
     }
 };
 
+using Individuals = std::vector<Individual>;
+
+/*! How spread out the genomes are: each gene's standard deviation as a fraction of its range, averaged over genes */
+auto diversity(const Individuals& individuals) -> double;
+
 }  // namespace audiogene
@@ -24,6 +24,7 @@
 
 #include <cstdint>
 #include <map>
+#include <stdexcept>
 #include <vector>
 #include <string>
 
@@ -34,12 +35,48 @@ enum class ExpressionActivates {
     OverBar  //!< Gradually make the change over the next bar
 };
 
+/*! How a gene's values are held when niching packs genomes. Auto picks from the gene's range */
+enum class ExpressionEncoding {
+    Auto,
+    Double,
+    Float32,  //!< Single precision
+    Int16,  //!< Whole numbers; only for genes that round and fit in 16 bits
+    Fixed16  //!< 65536 evenly spaced steps across the range
+};
+
+inline auto expressionEncoding(const std::string& name) -> ExpressionEncoding {
+    if (name == "auto") {
+        return ExpressionEncoding::Auto;
+    } else if (name == "double") {
+        return ExpressionEncoding::Double;
+    } else if (name == "float32") {
+        return ExpressionEncoding::Float32;
+    } else if (name == "int16") {
+        return ExpressionEncoding::Int16;
+    } else if (name == "fixed16") {
+        return ExpressionEncoding::Fixed16;
+    }
+    throw std::runtime_error("Unknown gene encoding " + name);
+}
+
 struct Expression {
     double min;
     double max;
     double current;
     bool round;
     ExpressionActivates activates;
+    ExpressionEncoding encoding;
+
+    Expression(const double min, const double max, const double current, const bool round,
+               const ExpressionActivates activates):
+            min(min),
+            max(max),
+            current(current),
+            round(round),
+            activates(activates),
+            encoding(ExpressionEncoding::Auto) {
+        // empty constructor
+    }
 
     explicit Expression(const std::map<std::string, std::string>& d) {
         try {
@@ -55,6 +92,9 @@ struct Expression {
             } else {
                 activates = ExpressionActivates::OnBar;
             }
+
+            const auto found = d.find("encoding");
+            encoding = found == d.end() ? ExpressionEncoding::Auto : expressionEncoding(found->second);
         } catch (const std::out_of_range& e) {
             throw std::runtime_error("Failed to create expression");
         }
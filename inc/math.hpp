@@ -24,6 +24,8 @@
 
 #include <chrono>
 #include <random>
+#include <sstream>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -35,7 +37,21 @@ class Math {
 
  public:
     Math() {
-        _rng.seed(std::chrono::system_clock::now().time_since_epoch().count());
+        // Mix in the random device so engines created in the same tick still differ
+        std::random_device device;
+        _rng.seed(std::chrono::system_clock::now().time_since_epoch().count() ^ device());
+    }
+
+    /*! Serialize the random engine so a sequence can be resumed */
+    std::string state() const {
+        std::ostringstream out;
+        out << _rng;
+        return out.str();
+    }
+
+    void restore(const std::string& state) {
+        std::istringstream in(state);
+        in >> _rng;
     }
 
     bool flipCoin() const {
@@ -45,7 +61,17 @@ class Math {
 
     bool didEventOccur(const double probability) const {
         std::uniform_real_distribution<double> d(0.0, 1.0);
-        return d(_rng) >= probability;
+        return d(_rng) < probability;
+    }
+
+    /*! How many trials fail before one succeeds, when each succeeds with the given probability */
+    template<
+        typename T,
+        typename = typename std::enable_if<std::is_integral<T>::value, T>::type
+    >
+    T geometric(const double probability) const {
+        std::geometric_distribution<T> d(probability);
+        return d(_rng);
     }
 
     template<
@@ -91,17 +117,43 @@ class Math {
         return d(_rng);
     }
 
+    template<
+        typename T,
+        typename = typename std::enable_if<std::is_integral<T>::value, T>::type
+    >
+    T uniformInt(const T min, const T max) const {
+        std::uniform_int_distribution<T> d(min, max);
+        return d(_rng);
+    }
+
+    /*! Uniform in [min, max) */
+    template<
+        typename T,
+        typename = typename std::enable_if<std::is_floating_point<T>::value, T>::type
+    >
+    T uniformReal(const T min, const T max) const {
+        std::uniform_real_distribution<T> d(min, max);
+        return d(_rng);
+    }
+
     template<
         typename T
     >
-    std::pair<int, int> uniquePair(const std::vector<T>& container) const {
-        std::uniform_int_distribution<int> choose(0, std::distance(container.begin(), container.end() - 1));
-        int first = choose(_rng);
-        int second;
-        do {
-            second = choose(_rng);
-        } while (second == first);
-        return std::make_pair(first, second);
+    std::pair<size_t, size_t> uniquePair(const std::vector<T>& container) const {
+        return uniquePair(container.size());
+    }
+
+    /*! Two different indices in [0, n) */
+    std::pair<size_t, size_t> uniquePair(const size_t n) const {
+        // Choose the second from the n - 1 that remain, so no retries are needed
+        std::uniform_int_distribution<size_t> first(0, n - 1);
+        std::uniform_int_distribution<size_t> rest(0, n - 2);
+        const size_t a = first(_rng);
+        size_t b = rest(_rng);
+        if (b >= a) {
+            b++;
+        }
+        return std::make_pair(a, b);
     }
 };
 
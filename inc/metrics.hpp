@@ -0,0 +1,247 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace audiogene {
+
+constexpr uint8_t HISTOGRAM_SUB_BUCKET_BITS = 4;
+constexpr size_t HISTOGRAM_SUB_BUCKETS = 1u << HISTOGRAM_SUB_BUCKET_BITS;
+constexpr size_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+/*! A monotonically increasing count. Safe to increment from any thread */
+class Counter {
+    std::atomic<uint64_t> _value;
+
+ public:
+    Counter(): _value(0) {}
+
+    void increment(const uint64_t n = 1) noexcept {
+        _value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    auto value() const noexcept -> uint64_t {
+        return _value.load(std::memory_order_relaxed);
+    }
+};
+
+/*! A value that can go up and down, such as a queue depth or the best fitness */
+class Gauge {
+    std::atomic<double> _value;
+
+ public:
+    Gauge(): _value(0) {}
+
+    void set(const double value) noexcept {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    auto value() const noexcept -> double {
+        return _value.load(std::memory_order_relaxed);
+    }
+};
+
+/*!
+ * A log-linear histogram in the style of HdrHistogram.
+ * Every power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets, so any
+ * recorded value is within ~6% of its bucket bound regardless of magnitude.
+ * Recording is a single relaxed atomic increment per field.
+ */
+class Histogram {
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+
+ public:
+    Histogram(): _count(0), _sum(0) {
+        for (std::atomic<uint64_t>& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static auto bucketOf(const uint64_t value) noexcept -> size_t {
+        if (value < HISTOGRAM_SUB_BUCKETS) {
+            return value;
+        }
+        const size_t msb = 63 - __builtin_clzll(value);
+        const size_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+        return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+    }
+
+    /*! The largest value that falls into the given bucket */
+    static auto upperBound(const size_t bucket) noexcept -> uint64_t {
+        if (bucket < HISTOGRAM_SUB_BUCKETS) {
+            return bucket;
+        }
+        const size_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+        const uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+        return ((HISTOGRAM_SUB_BUCKETS + sub) << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+    void record(const uint64_t value) noexcept {
+        _buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    auto count() const noexcept -> uint64_t {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    auto sum() const noexcept -> uint64_t {
+        return _sum.load(std::memory_order_relaxed);
+    }
+
+    auto bucket(const size_t i) const noexcept -> uint64_t {
+        return _buckets[i].load(std::memory_order_relaxed);
+    }
+
+    /*! Approximate value at quantile q (0..1) */
+    auto quantile(const double q) const noexcept -> uint64_t {
+        const uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        const auto target = static_cast<uint64_t>(q * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += bucket(i);
+            if (seen > target) {
+                return upperBound(i);
+            }
+        }
+        return upperBound(HISTOGRAM_BUCKETS - 1);
+    }
+};
+
+/*! Records the microseconds between construction and destruction into a histogram */
+class ScopedTimer {
+    Histogram& _histogram;
+    const std::chrono::steady_clock::time_point _start;
+
+ public:
+    explicit ScopedTimer(Histogram& histogram):
+            _histogram(histogram),
+            _start(std::chrono::steady_clock::now()) {
+        // empty constructor
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        _histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - _start).count());
+    }
+};
+
+/*! The name of one instance of a metric, told apart from the others by a Prometheus label */
+inline auto labelled(const std::string& name, const std::string& label, const std::string& value) -> std::string {
+    return name + "{" + label + "=\"" + value + "\"}";
+}
+
+/*!
+ * Process-wide registry of metrics.
+ * Registering takes a lock, so look metrics up once and keep the reference;
+ * updating a metric never locks.
+ */
+class Metrics {
+    template<typename T>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<T> metric;
+    };
+
+    mutable std::mutex _registryMutex;
+    std::map<std::string, Entry<Counter>> _counters;
+    std::map<std::string, Entry<Gauge>> _gauges;
+    std::map<std::string, Entry<Histogram>> _histograms;
+
+    template<typename T>
+    static auto lookup(std::map<std::string, Entry<T>>* metrics, const std::string& name, const std::string& help) -> T& {
+        auto it = metrics->find(name);
+        if (it == metrics->end()) {
+            it = metrics->emplace(name, Entry<T>{help, std::make_unique<T>()}).first;
+        }
+        return *it->second.metric;
+    }
+
+    Metrics() = default;
+
+ public:
+    static auto instance() -> Metrics& {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    auto counter(const std::string& name, const std::string& help) -> Counter& {
+        std::lock_guard<std::mutex> l(_registryMutex);
+        return lookup(&_counters, name, help);
+    }
+
+    auto gauge(const std::string& name, const std::string& help) -> Gauge& {
+        std::lock_guard<std::mutex> l(_registryMutex);
+        return lookup(&_gauges, name, help);
+    }
+
+    auto histogram(const std::string& name, const std::string& help) -> Histogram& {
+        std::lock_guard<std::mutex> l(_registryMutex);
+        return lookup(&_histograms, name, help);
+    }
+
+    /*! Render every registered metric in the Prometheus text exposition format */
+    auto prometheus() const -> std::string;
+};
+
+/*! Periodically writes the Prometheus text of all metrics to a file */
+class MetricsExporter {
+    std::shared_ptr<spdlog::logger> _logger;
+    const std::string _path;
+    const std::chrono::seconds _interval;
+
+    std::mutex _stopMutex;
+    std::condition_variable _stopCV;
+    bool _stop;
+    std::thread _thread;
+
+ public:
+    MetricsExporter(std::string path, std::chrono::seconds interval);
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    ~MetricsExporter();
+
+    auto write() const -> bool;
+};
+
+}  // namespace audiogene
@@ -31,6 +31,7 @@
 #include <memory>
 
 #include "audience.hpp"
+#include "metrics.hpp"
 
 namespace audiogene {
 
@@ -44,6 +45,9 @@ class MIDI: public Audience {
     const std::map<int, std::pair<AttributeName, int>> _mapping;
     std::unique_ptr<RtMidiIn> midiin;
 
+    Counter& _messages;
+    Histogram& _callbackDuration;
+
  public:
     MIDI();
     // mapping is {"attribute": {"direction":"key"},...}
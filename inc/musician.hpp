@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include "instruction.hpp"
 #include "individual.hpp"
 
@@ -29,7 +31,15 @@ namespace audiogene {
 class Musician {
  public:
     virtual ~Musician() = default;
+    /*! Wait for the next request for a conductor; false once the show has ended */
     virtual auto requestConductor() -> bool = 0;
+    /*! End the show; any wait for a request returns false, as does every later one. Safe from any thread */
+    virtual void endShow() = 0;
+    /*!
+     * When the conductor for the last request is needed by; the far future if there's no hurry.
+     * Each request's deadline is only given once
+     */
+    virtual auto deadline() -> std::chrono::steady_clock::time_point = 0;
     virtual void setConductor(const Individual& conductor) = 0;
 };
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "genome.hpp"
+#include "genomehash.hpp"
+#include "individual.hpp"
+#include "packedgenomes.hpp"
+
+namespace audiogene {
+
+constexpr double NICHE_RADIUS = 0.1;
+constexpr double SHARING_ALPHA = 1;
+constexpr size_t CLEARING_CAPACITY = 1;
+// Most genes the neighbour grid is laid over; every one more triples the cells a search visits
+constexpr size_t GRID_DIMENSIONS = 6;
+// Genomes per cell the grid aims for: fuller cells mean more distances, emptier ones more cells to look in
+constexpr double GRID_OCCUPANCY = 8;
+
+enum class NichingMethod {
+    None,
+    Crowding,  //!< Deterministic crowding: a child replaces the more similar of its parents if it's as fit
+    Sharing,  //!< Fitness is shared with everyone within radius
+    Clearing  //!< Only the capacity fittest within radius of each other keep their fitness
+};
+
+auto nichingMethod(const std::string& name) -> NichingMethod;
+
+struct NichingConfig {
+    NichingMethod method;
+    //! Genomes are in the same niche when no gene differs by more than this fraction of its range
+    double radius;
+    //! How sharply sharing falls off with distance; 1 is linear
+    double alpha;
+    //! Winners per niche when clearing
+    size_t capacity;
+
+    NichingConfig():
+            method(NichingMethod::None),
+            radius(NICHE_RADIUS),
+            alpha(SHARING_ALPHA),
+            capacity(CLEARING_CAPACITY) {
+        // empty constructor
+    }
+};
+
+/*!
+ * The distances between the genomes of a generation, where distance is the
+ * largest difference of any gene as a fraction of its range.
+ * Genomes are packed a gene at a time in each gene's encoding, so the distances
+ * from one genome to a run of others are a loop the compiler vectorises. They're sorted into a grid
+ * of radius wide cells over the most spread out genes, so finding everyone
+ * within radius only looks at neighbouring cells, and each cell is one run.
+ * Genes are added to the grid while its cells would still hold GRID_OCCUPANCY
+ * genomes on average.
+ * Buffers are kept between builds.
+ */
+class NeighbourGrid {
+    size_t _size;
+    size_t _genes;
+    double _radius;
+    // Cells along each grid gene
+    int64_t _cells;
+    std::vector<std::pair<double, size_t>> _spreads;
+    std::vector<size_t> _gridGenes;
+    // Each gene scaled to 0..1, a gene at a time, in individual order
+    std::vector<double> _scratch;
+    // The genomes in cell order
+    PackedGenomes _packed;
+    // Individual at each position, and each individual's position
+    std::vector<size_t> _order;
+    std::vector<size_t> _position;
+    std::vector<uint64_t> _keys;
+    // Cell key to the index of its run of positions
+    GenomeTable _cellIndex;
+    std::vector<std::pair<size_t, size_t>> _runs;
+    std::vector<float> _distances;
+
+    auto cellOf(size_t position, size_t dimension) const noexcept -> int64_t;
+
+ public:
+    NeighbourGrid();
+
+    void build(const Individuals& individuals, double radius);
+    /*! Every individual closer than radius to individual i, including i, with its distance */
+    void neighbours(size_t i, std::vector<std::pair<size_t, double>>* result);
+    auto size() const noexcept -> size_t;
+
+    static auto distance(const Genes& genes, const Genome& a, const Genome& b) noexcept -> double;
+};
+
+/*!
+ * Fitness sharing and clearing, which derate individuals in crowded niches so
+ * selection spreads out over several peaks instead of collapsing onto one.
+ * Crowding needs no derating; the population pairs its children with parents itself.
+ */
+class Niching {
+    const NichingConfig _config;
+    NeighbourGrid _grid;
+    std::vector<std::pair<size_t, double>> _neighbours;
+    std::vector<size_t> _order;
+    std::vector<size_t> _rank;
+    // Whether each individual has been cleared, or kept as one of a niche's winners
+    std::vector<uint8_t> _states;
+    double _niches;
+
+    void share(const Individuals& individuals, double least, std::vector<double>* fitness);
+    void clear(const Individuals& individuals, double least, std::vector<double>* fitness);
+
+ public:
+    explicit Niching(const NichingConfig& config);
+
+    auto method() const noexcept -> NichingMethod;
+    /*! Whether derate() does anything */
+    auto derates() const noexcept -> bool;
+    /*! Each individual's fitness once niches are taken into account */
+    void derate(const Individuals& individuals, std::vector<double>* fitness);
+    /*! How many niches the last derating found; with sharing, the sum of everyone's share */
+    auto niches() const noexcept -> double;
+};
+
+}  // namespace audiogene
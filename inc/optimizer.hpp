@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "preference.hpp"
+#include "reactions.hpp"
+
+namespace audiogene {
+
+/*! Something that evolves conductors towards the audience's preferences */
+class Optimizer {
+ public:
+    virtual ~Optimizer() = default;
+
+    virtual void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) = 0;
+    /*! Use these preferences for the next generation without waiting on a queue */
+    virtual void setPreferences(const Preferences& preferences) = 0;
+    virtual void nextGeneration() = 0;
+    /*!
+     * Work on the next generation until it's done or the deadline passes, and
+     * say whether it's done. An unfinished generation carries on from where it
+     * stopped on the next call; until then fittest() is the best of it so far.
+     * Optimizers that can't stop part way through finish the generation.
+     * A generation with a deadline never waits for the audience's first
+     * preferences; it's unfinished straight away if there are none yet.
+     */
+    virtual auto advance(const std::chrono::steady_clock::time_point /* deadline */) -> bool {
+        nextGeneration();
+        return true;
+    }
+    virtual auto fittest() -> Individual = 0;
+    /*! Up to n individuals from across the search; by default just the fittest */
+    virtual auto sample(const size_t n) -> Individuals {
+        return n == 0 ? Individuals() : Individuals(1, fittest());
+    }
+    /*!
+     * Blend the audience's reactions into the fitness of conductors that have
+     * played. Only optimizers that keep individuals between generations can;
+     * by default they're ignored.
+     */
+    virtual void setReactions(const std::shared_ptr<const Reactions>& /* reactions */) {}
+    virtual auto generation() const -> uint32_t = 0;
+    /*! How spread out the search is, as a fraction of each gene's range; near 0 once it has converged */
+    virtual auto diversity() const -> double = 0;
+
+    virtual auto checkpoint() const -> Checkpoint = 0;
+    virtual void restore(const Checkpoint& checkpoint) = 0;
+    /*! Start the search from these individuals rather than the seed, judged by the opening preferences */
+    virtual void warmStart(const Individuals& seeds, const Preferences& preferences) = 0;
+
+    virtual void print(std::ostream& os) const = 0;
+
+    template<typename OStream>
+    friend OStream &operator<<(OStream &os, const Optimizer &obj) {
+        obj.print(os);
+        return os;
+    }
+};
+
+}  // namespace audiogene
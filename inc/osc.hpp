@@ -26,6 +26,7 @@
 #include <lo/lo_cpp.h>
 #include <spdlog/spdlog.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <iostream>
 #include <memory>
@@ -34,6 +35,7 @@
 
 #include "individual.hpp"
 #include "instruction.hpp"
+#include "metrics.hpp"
 #include "musician.hpp"
 
 namespace audiogene {
@@ -44,6 +46,8 @@ constexpr char DEFAULT_SERVER_PORT[] = "57120";
 
 //TODO make a config value
 constexpr uint8_t REQUEST_WAIT_FOR_S = 120;
+// The share of the time to the next bar that a conductor may take to find; the rest is for sending it
+constexpr double DEADLINE_SHARE = 0.8;
 
 class OSC: public Musician {
     std::shared_ptr<spdlog::logger> _logger;
@@ -52,7 +56,18 @@ class OSC: public Musician {
 
     std::mutex _nextMutex;
     std::condition_variable _nextCV;
+    std::chrono::steady_clock::time_point _deadline;
+    bool _ended;
 
+    Counter& _messagesSent;
+    Counter& _sendFailures;
+    Counter& _requests;
+    Counter& _requestTimeouts;
+    Histogram& _sendDuration;
+    Histogram& _requestWait;
+
+    void request(double secondsToBar);
+    auto send(const std::string& path, const lo::Message& message) -> bool;
     bool send(const std::string& path, const std::string& msg);
  public:
     OSC();
@@ -60,6 +75,8 @@ class OSC: public Musician {
     ~OSC() final = default;
 
     auto requestConductor() -> bool final;
+    void endShow() final;
+    auto deadline() -> std::chrono::steady_clock::time_point final;
     void setConductor(const Individual& conductor) final;
 };
 
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+
+namespace audiogene {
+
+/*!
+ * A generation's genomes stored a gene at a time, each gene in its own encoding.
+ * Int16 genes keep their whole numbers and fixed16 genes their step across the
+ * range, so their columns are a quarter the size of doubles; float32 columns
+ * are half the size. Distances are worked
+ * out in single precision, which fits twice as many genes to a vector as double.
+ * Each gene is packed as the nearest value its encoding holds; individuals keep
+ * full precision, so the rounding only reaches niching distances.
+ * Buffers are kept between packs.
+ */
+class PackedGenomes {
+    struct Column {
+        ExpressionEncoding encoding;
+        // Start of the column in the buffer for its encoding
+        size_t offset;
+        // What one unit of the stored value is as a fraction of the range
+        double scale;
+        double min;
+        double max;
+    };
+
+    size_t _size;
+    std::vector<Column> _columns;
+    std::vector<double> _doubles;
+    std::vector<float> _floats;
+    std::vector<int16_t> _wholes;
+    std::vector<uint16_t> _steps;
+
+ public:
+    PackedGenomes();
+
+    /*! Pack the genomes of individuals, in the given order */
+    void pack(const Individuals& individuals, const std::vector<size_t>& order);
+    auto size() const noexcept -> size_t;
+    /*! Gene g of the genome at position p, unpacked */
+    auto value(size_t p, size_t g) const noexcept -> double;
+    /*!
+     * The largest difference of any gene, as a fraction of its range, between
+     * the genome at position from and each of those at [begin, end), into out
+     */
+    void distances(size_t from, size_t begin, size_t end, float* out) const noexcept;
+};
+
+}  // namespace audiogene
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace audiogene {
+
+enum class ConductorPolicy {
+    Sum,  //!< The best total over all objectives, as if there were only one
+    Balanced,  //!< The best worst objective, so no gene is badly off
+    Closest  //!< The nearest to meeting every objective perfectly
+};
+
+auto conductorPolicy(const std::string& name) -> ConductorPolicy;
+
+struct ParetoConfig {
+    bool enabled;
+    ConductorPolicy policy;
+
+    ParetoConfig():
+            enabled(false),
+            policy(ConductorPolicy::Balanced) {
+        // empty constructor
+    }
+};
+
+/*!
+ * NSGA-II ranking of n points with m objectives, all maximized.
+ * Fronts are found by efficient non-dominated sorting with sequential search
+ * (ENS-SS): points are visited in lexicographic order so each only needs
+ * comparing against the fronts found so far, newest member first. Once the
+ * fronts hold `needed` points, anything they all dominate is left unranked,
+ * so a large population only pays for the fronts it keeps.
+ * Buffers are kept between calls.
+ */
+class ParetoRanking {
+    size_t _m;
+    const double* _objectives;
+    std::vector<size_t> _lexicographic;
+    std::vector<std::vector<size_t>> _fronts;
+    size_t _frontCount;
+    std::vector<size_t> _unranked;
+    std::vector<double> _crowding;
+    std::vector<size_t> _scratch;
+    std::vector<size_t> _order;
+
+    auto dominates(size_t a, size_t b) const noexcept -> bool;
+    void crowd(const std::vector<size_t>& front);
+
+ public:
+    ParetoRanking();
+
+    /*! objectives is row-major, n rows of m */
+    void rank(const std::vector<double>& objectives, size_t m, size_t needed);
+
+    /*! Every point, by front and then most isolated first; exact for at least the first `needed` */
+    auto order() const noexcept -> const std::vector<size_t>&;
+    /*! The non-dominated points */
+    auto front() const noexcept -> const std::vector<size_t>&;
+    auto crowding(size_t i) const noexcept -> double;
+
+    /*! Which point of the first front to put forward */
+    auto choose(ConductorPolicy policy) const -> size_t;
+};
+
+}  // namespace audiogene
@@ -25,34 +25,95 @@
 #include <spdlog/spdlog.h>
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
+#include <cstdint>
 #include <future>
 #include <map>
 #include <memory>
 #include <string>
 
 #include "audience.hpp"
+#include "checkpoint.hpp"
+#include "elitearchive.hpp"
+#include "individual.hpp"
+#include "metrics.hpp"
 #include "musician.hpp"
+#include "optimizer.hpp"
+#include "reactions.hpp"
+#include "showarchive.hpp"
+#include "surrogate.hpp"
+#include "trace.hpp"
 
 namespace audiogene {
 
 using KeyMap = std::map<std::string, std::map<std::string, std::string>>;
 
+constexpr int METRICS_INTERVAL_S = 10;
+constexpr int TRACE_INTERVAL_S = 30;
+constexpr int CHECKPOINT_EVERY_GENERATIONS = 8;
+constexpr int MIGRATION_INTERVAL = 5;
+constexpr int MIGRANTS = 2;
+
+/*! How much evolving to do between conductor requests */
+struct GenerationBudget {
+    //! At most this many generations per request
+    uint32_t perRequest;
+    //! And for at most this long; zero leaves it to the musician's deadline
+    std::chrono::milliseconds time;
+    //! Stop early once the fittest improves by less than minImprovement in a
+    //! generation while diversity is below minDiversity
+    double minImprovement;
+    double minDiversity;
+
+    GenerationBudget():
+            perRequest(1),
+            time(0),
+            minImprovement(0),
+            minDiversity(0) {
+        // empty constructor
+    }
+};
+
 class Performance {
     std::shared_ptr<spdlog::logger> _logger;
     YAML::Node _config;
+    const bool _resume;
 
     std::shared_ptr<audiogene::Audience> audience;
     std::unique_ptr<Musician> musician;
 
+    std::unique_ptr<MetricsExporter> _metricsExporter;
+    std::unique_ptr<trace::Exporter> _traceExporter;
+
+    Histogram& _generationsPerRequest;
+    Counter& _convergedRequests;
+
     void seatAudience();
     void assembleMusicians();
+    void exportMetrics();
+    void exportTrace();
+    auto formConductors(const Individual& seed) -> std::unique_ptr<Optimizer>;
+    /*! The MAP-Elites archive, or nullptr if it isn't enabled */
+    auto formArchive(const Individual& seed) -> std::unique_ptr<EliteArchive>;
+    /*! The elites kept from earlier shows, or nullptr if they aren't */
+    auto openShowArchive(const Individual& seed) -> std::unique_ptr<ShowArchive>;
+    /*! The model of the audience's response, or nullptr if it isn't enabled */
+    auto formSurrogate(const Individual& seed) -> std::unique_ptr<Surrogate>;
+    /*! Where the audience's reactions are counted, or nullptr if they don't count */
+    auto formReactions() -> std::shared_ptr<Reactions>;
+    auto generationBudget() -> GenerationBudget;
+    /*! Run as many generations as the budget allows before the deadline; returns how many finished */
+    auto evolve(Optimizer* conductors, const GenerationBudget& budget,
+                std::chrono::steady_clock::time_point deadline) -> uint32_t;
 
  public:
-    explicit Performance(const YAML::Node& config);
+    explicit Performance(const YAML::Node& config, bool resume = false);
     Performance(const Performance&) = delete;
     Performance& operator=(Performance const&) = delete;
 
     auto play() -> std::future<void>;
+    /*! Stop asking for conductors; play's future is ready once the show's elites are recorded */
+    void end();
 };
 
 }  // namespace audiogene
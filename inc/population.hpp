@@ -25,64 +25,290 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/ostr.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
-#include <mutex>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "audience.hpp"
 #include "blockingqueue.hpp"
+#include "checkpoint.hpp"
 #include "genetics.hpp"
+#include "genomehash.hpp"
+#include "genomeindex.hpp"
 #include "individual.hpp"
 #include "math.hpp"
+#include "metrics.hpp"
+#include "niching.hpp"
+#include "optimizer.hpp"
+#include "pareto.hpp"
+#include "selection.hpp"
 
 namespace audiogene {
 
 constexpr uint8_t PREFERENCES_WAIT_FOR_S = 5;
+// Large populations are summarized rather than logged in full
+constexpr size_t PRINT_INDIVIDUALS = 16;
+// How many times a child that duplicates someone is mutated again before it's kept anyway
+constexpr uint8_t DUPLICATE_RETRIES = 3;
+// Genomes whose scores are remembered, per individual
+constexpr size_t MEMO_PER_INDIVIDUAL = 2;
+// Children bred between looks at the clock when a generation has a deadline
+constexpr size_t GENERATION_CHUNK = 256;
 
-using Individuals = std::vector<Individual>;
+// Defaults for adaptive sizing
+constexpr double SIZING_FACTOR = 2;
+constexpr double SIZING_SHRINK_DIVERSITY = 0.01;
+constexpr uint32_t SIZING_PATIENCE = 5;
+constexpr double SIZING_GROW_SHIFT = 0.2;
 
-class Population {
+/*! When and how far the population resizes itself */
+struct SizingConfig {
+    bool enabled;
+    size_t minSize;
+    size_t maxSize;
+    //! Grow or shrink by this factor at a time
+    double factor;
+    //! Shrink after patience generations in a row below this diversity, with preferences unchanged
+    double shrinkDiversity;
+    uint32_t patience;
+    //! Grow with random immigrants when a preference moves by more than this fraction of its range
+    double growShift;
+
+    SizingConfig():
+            enabled(false),
+            minSize(0),
+            maxSize(0),
+            factor(SIZING_FACTOR),
+            shrinkDiversity(SIZING_SHRINK_DIVERSITY),
+            patience(SIZING_PATIENCE),
+            growShift(SIZING_GROW_SHIFT) {
+        // empty constructor
+    }
+};
+
+struct PopulationConfig {
+    size_t size;
+    //! The fittest carry over unchanged each generation
+    size_t topN;
+    MutationConfig mutation;
+    SelectionConfig selection;
+    ParetoConfig pareto;
+    SizingConfig sizing;
+    NichingConfig niching;
+    //! Keep a k-d tree of genomes so new preferences can pick a conductor without rescoring
+    bool spatialIndex;
+    //! Remember the scores of recent genomes until preferences change
+    bool memoize;
+    //! Mutate children again while they're identical to someone else in their generation
+    bool deduplicate;
+    //! Labels the population's gauges when it's one of an archipelago's islands
+    std::string island;
+
+    PopulationConfig(const size_t size, const size_t topN, const double mutationProbability):
+            size(size),
+            topN(topN),
+            mutation(mutationProbability),
+            spatialIndex(false),
+            memoize(false),
+            deduplicate(false) {
+        // empty constructor
+    }
+};
+
+class Population final : public Optimizer {
     mutable std::shared_ptr<spdlog::logger> _logger;
-    const Math _math;
-    const Genetics _genetics;
+    Math _math;
+    Genetics _genetics;
 
-    const size_t _size;
+    // Changes between generations when sizing is adaptive
+    size_t _size;
+    const SizingConfig _sizing;
+    // Generations in a row that were converged with steady preferences
+    uint32_t _calm;
+    // Two preallocated generations: children are bred into _offspring from the
+    // parents in _individuals, then the two are swapped
     Individuals _individuals;
+    Individuals _offspring;
     uint32_t _generation;
+    // A generation in progress: the next child to breed, the fittest bred so far, how
+    // many so far beat their parents, and the time spent on it over every call
+    std::atomic<bool> _breeding;
+    size_t _firstChild;
+    size_t _nextChild;
+    size_t _partialFittest;
+    size_t _improved;
+    std::chrono::steady_clock::duration _generationTime;
+    // Only the fittest _topN are kept in order; the rest are left where selection put them
     const size_t _topN;
+    std::unique_ptr<Selection> _selection;
+    // In multi-objective mode each gene's similarity is its own objective
+    const ParetoConfig _pareto;
+    ParetoRanking _ranking;
+    std::vector<double> _objectives;
+    // Sharing and clearing derate crowded niches; crowding pits each child against a parent instead
+    Niching _niching;
+    // What selection draws by: fitness, derated by any niching, in population order
+    std::vector<double> _fitness;
+    std::vector<size_t> _ranked;
+    std::vector<double> _rankedFitness;
+    // Crowding pairs parents at random; each has a slot in the next generation
+    std::vector<size_t> _partners;
+    // How far apart genomes are, per unit of each gene, as fitness sees it
+    const bool _spatialIndex;
+    GenomeIndex _index;
+    std::vector<double> _distanceWeights;
+    std::vector<size_t> _nearest;
+    Genome _query;
+    // Scores of genomes seen since preferences last changed, a row of _memoScores each
+    const bool _memoize;
+    GenomeTable _memo;
+    std::vector<double> _memoScores;
+    // Every genome in the generation being bred
+    const bool _deduplicate;
+    GenomeTable _present;
+    // The genes are the ones compiled into the schema, so scoring is unrolled
+    const bool _staticSchema;
+    // Who conducts: the fittest, unless new preferences found someone closer in the index
+    size_t _conductor;
+
+    // Where the audience's preferences arrive; each generation takes the newest without waiting
+    std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>> _preferencesQueue;
+    // The newest preferences not yet scored against, and whether there are any
+    Preferences _incomingPreferences;
+    bool _haveIncoming;
+    // The preferences the current generation is scored against; empty until the first arrive
+    Preferences _generationPreferences;
+    // The preferred value of each gene, in genome order, and which of them moved
+    // since individuals were last scored
+    Genome _ideal;
+    std::vector<size_t> _changedGenes;
+    // The furthest a preference moved, as a fraction of its range, since the last generation began
+    double _shift;
+    bool _haveIdeal;
+    // The audience's reactions to conductors that have played, if they count
+    std::shared_ptr<const Reactions> _reactions;
 
-    // When it's time to create a new generation, get preferences from the audience
-    // and sort individuals based on that
-    Preferences _audiencePreferences;
-    std::timed_mutex _havePreferences;
+    Histogram& _generationDuration;
+    Histogram& _preferencesWait;
+    Counter& _preferencesTimeouts;
+    Counter& _preferencesReceived;
+    Gauge& _preferencesQueueDepth;
+    Gauge& _generationGauge;
+    Gauge& _bestFitness;
+    Gauge& _meanFitness;
+    Gauge& _worstFitness;
+    Gauge& _successRate;
+    Gauge& _stepScale;
+    Gauge& _frontSize;
+    Counter& _memoHits;
+    Counter& _memoMisses;
+    Counter& _duplicates;
+    Counter& _duplicatesKept;
+    Counter& _generationsDeferred;
+    Gauge& _sizeGauge;
+    Counter& _grown;
+    Counter& _shrunk;
+    Gauge& _diversity;
+    Gauge& _niches;
+    Counter& _parentsKept;
 
     void initializePopulation(const Individual& seed);
+    /*! Take the latest preferences, carry the elites over and get ready to breed.
+        False if there still aren't any preferences to score against by the deadline */
+    auto beginGeneration(std::chrono::steady_clock::time_point deadline) -> bool;
+    /*! Take the newest preferences in the queue, if any, without waiting */
+    void takePreferences();
+    /*! Score against the incoming preferences from now on; true if there were any */
+    auto applyPreferences() -> bool;
+    /*! Make room for random immigrants at the start of the generation being bred */
+    void grow();
+    /*! Drop the least fit once the population has been converged for long enough */
+    void adaptSize(double spread);
+    /*! Size the genome tables for the current population */
+    void reserveTables();
+    /*! Breed up to GENERATION_CHUNK children */
+    void breedChunk();
+    /*! Breed and score one child, counting it if it beat its parents */
+    void breedChild(const std::pair<size_t, size_t>& parents, Individual* child);
+    /*! Breed the children of the next pair of partners, each keeping its slot only if it's as fit as a parent */
+    void crowd();
+    /*! Put parent back in slot if it's fitter than the child there */
+    void keepFitter(size_t slot, size_t parent);
+    /*! Swap in the children, rank them and adapt */
+    void finishGeneration();
+    /*! Score everyone against preferences, only the genes that changed if they've been scored before */
+    void scorePopulation(const Preferences& preferences);
+    /*! Copy everyone's per-gene scores into _objectives for multi-objective ranking */
+    void copyObjectives();
     void sortPopulation();
-    auto similarity(const Individual& individual) -> double;
+    void rankPopulation();
+    /*! Derate crowded niches and keep the topN by derated fitness, the fittest first */
+    void nichePopulation();
+    /*! Selection draws by plain fitness */
+    void copyFitness();
+    void indexPopulation();
+    /*! Leaves the indices of the k individuals closest to preferences in _nearest */
+    void findClosest(const Preferences& preferences, size_t k);
+    void recordFitness();
+    void updateIdeal(const Preferences& preferences);
+    /*! Update an individual's per-gene scores and fitness; unchanged genes keep their score */
+    void score(Individual* individual);
+    /*! Score every gene of genome into scores, or copy them from the memo */
+    void scoreGenome(const Genes& genes, const Genome& genome, std::vector<double>* scores);
 
     // These are related to the genetics of a population
     // Maybe these should be in a different class
-    auto getParents(const Individuals& fittest) -> std::pair<Individual, Individual>;
-    auto breed(const std::pair<Individual, Individual>& parents) -> Individual;
-    void mutate(Individual child);
+    auto getParents() -> std::pair<size_t, size_t>;
+    void breed(const std::pair<size_t, size_t>& parents, Individual* child);
+    /*! Add a child to the generation, mutating it again while it duplicates someone already there */
+    void admit(Individual* child);
 
  public:
     Population() = delete;
-    Population(const uint8_t n, const Individual& seed, const double mutationProbability, const size_t topN);
-    ~Population() = default;
+    Population(const PopulationConfig& config, const Individual& seed);
+    ~Population() final = default;
+
+    void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) final;
+    void setPreferences(const Preferences& preferences) final;
+
+    auto fittest() -> Individual final;
+    auto fitness() const -> double;
+    /*! Every (size / n)th individual, starting with the fittest */
+    auto sample(size_t n) -> Individuals final;
 
-    void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue);
+    void nextGeneration() final;
+    auto advance(std::chrono::steady_clock::time_point deadline) -> bool final;
+    auto generation() const -> uint32_t final;
+    auto diversity() const -> double final;
 
-    auto fittest() -> Individual;
+    auto checkpoint() const -> Checkpoint final;
+    void restore(const Checkpoint& checkpoint) final;
+    void warmStart(const Individuals& seeds, const Preferences& preferences) final;
+    void setReactions(const std::shared_ptr<const Reactions>& reactions) final;
 
-    void nextGeneration();
+    /*! The k individuals closest to the given preferences, closest first. Needs the spatial index */
+    auto closest(const Preferences& preferences, size_t k) -> Individuals;
+
+    /*! Copies of the n fittest individuals */
+    auto emigrants(size_t n) const -> Individuals;
+    /*! Replace the least fit individuals with the given ones */
+    void immigrate(const Individuals& immigrants);
+
+    void print(std::ostream& os) const final;
 
     template<typename OStream>
     friend OStream &operator<<(OStream &os, const Population &obj) {
-        os << "Population \n";
-        for (const Individual &individual : obj._individuals) {
-            os << "\t" << individual << std::endl;
+        os << "Population of " << obj._size << "\n";
+        const size_t shown = std::min(obj._size, PRINT_INDIVIDUALS);
+        for (size_t i = 0; i < shown; i++) {
+            os << "\t" << obj._individuals[i] << std::endl;
+        }
+        if (shown < obj._size) {
+            os << "\t... and " << obj._size - shown << " more" << std::endl;
         }
         return os;
     }
@@ -35,6 +35,13 @@ struct Preference {
     double max;
     double current;
 
+    Preference(const double min, const double max, const double current):
+            min(min),
+            max(max),
+            current(current) {
+        // empty constructor
+    }
+
     explicit Preference(const Attribute& attribute) {
         try {
             current = std::stoi(attribute.at("current"));
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "metrics.hpp"
+
+namespace audiogene {
+
+constexpr size_t REACTION_SLOTS = 1024;
+// How much the audience's reactions count against matching their preferences
+constexpr double REACTION_WEIGHT = 0.2;
+
+struct ReactionConfig {
+    bool enabled;
+    //! Conductors remembered at once, rounded up to a power of two
+    size_t slots;
+    double weight;
+
+    ReactionConfig():
+            enabled(false),
+            slots(REACTION_SLOTS),
+            weight(REACTION_WEIGHT) {
+        // empty constructor
+    }
+};
+
+/*! What the audience did while one conductor played */
+struct ReactionSlot {
+    //! The conductor's id plus one; 0 is empty
+    std::atomic<uint32_t> conductor;
+    std::atomic<uint32_t> bars;
+    std::atomic<uint32_t> inputs;
+    //! Inputs that reversed the previous one for the same preference
+    std::atomic<uint32_t> reversals;
+};
+
+/*!
+ * The audience's activity, attributed to whichever conductor was playing.
+ * A conductor's slot is picked by its id, so finding it is arithmetic, and a
+ * newer conductor whose id lands on the same slot takes it over. Only the
+ * generation thread says who's playing; input callbacks add to the playing
+ * conductor's slot with relaxed atomic increments and never wait. An input
+ * that arrives as the conductor changes may count for either of them.
+ */
+class Reactions {
+    const size_t _mask;
+    const double _weight;
+    std::unique_ptr<ReactionSlot[]> _slots;
+    std::atomic<ReactionSlot*> _playing;
+    // Times a different conductor has started playing
+    std::atomic<uint64_t> _changes;
+
+    Counter& _inputs;
+    Counter& _reversals;
+
+    auto slotOf(uint32_t conductor) const noexcept -> ReactionSlot&;
+
+ public:
+    explicit Reactions(const ReactionConfig& config);
+    Reactions(const Reactions&) = delete;
+    Reactions& operator=(const Reactions&) = delete;
+
+    /*! The conductor is playing the next bar */
+    void play(uint32_t conductor) noexcept;
+
+    /*! How many times a different conductor has started playing; safe from any thread */
+    auto changes() const noexcept -> uint64_t {
+        return _changes.load(std::memory_order_acquire);
+    }
+
+    /*! The audience gave an input; safe from any thread */
+    void react(const bool reversal) noexcept {
+        ReactionSlot* playing = _playing.load(std::memory_order_acquire);
+        if (playing == nullptr) {
+            return;
+        }
+        playing->inputs.fetch_add(1, std::memory_order_relaxed);
+        _inputs.increment();
+        if (reversal) {
+            playing->reversals.fetch_add(1, std::memory_order_relaxed);
+            _reversals.increment();
+        }
+    }
+
+    /*!
+     * Fitness with the audience's reactions to the conductor blended in, or
+     * unchanged if it hasn't played. Approval is 1 / (1 + inputs per bar),
+     * with reversals counted twice, so an audience that leaves it alone
+     * approves fully.
+     */
+    auto blend(uint32_t conductor, double fitness) const noexcept -> double;
+};
+
+}  // namespace audiogene
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "genome.hpp"
+
+#ifdef AUDIOGENE_STATIC_SCHEMA
+// Written by genschema from the genes of the config given to AUDIOGENE_SCHEMA
+#include "generated/schema.hpp"
+#endif
+
+namespace audiogene {
+namespace schema {
+
+/*! The compiled description of gene I: name(), min(), max() and round(), all constexpr */
+template<size_t I>
+struct StaticGene;
+
+#ifdef AUDIOGENE_STATIC_SCHEMA
+constexpr bool COMPILED = true;
+#else
+constexpr bool COMPILED = false;
+// Without a compiled schema there are no static genes, and every genome takes the dynamic path
+constexpr size_t GENES = 0;
+#endif
+
+// Crossover picks each gene's parent from one bit of a single random word
+static_assert(GENES <= 64, "A compiled schema can have at most 64 genes");
+
+/*!
+ * The per-gene loops, unrolled over the genes of the compiled schema.
+ * Each step handles gene I with its range known at compile time and recurses
+ * to the next, so the compiler sees straight-line code with constant ranges.
+ */
+template<size_t I, size_t N = GENES>
+struct Unrolled {
+    using G = StaticGene<I>;
+
+    static auto matches(const Genes& genes) -> bool {
+        return genes[I].name == G::name() && genes[I].min == G::min() && genes[I].max == G::max() &&
+               genes[I].round == G::round() && Unrolled<I + 1, N>::matches(genes);
+    }
+
+    /*! As Math::similarity, summed */
+    static auto similarity(const double* ideal, const double* genome, double* scores) noexcept -> double {
+        scores[I] = 1 - std::abs(ideal[I] - genome[I]) / G::max() - G::min();
+        return scores[I] + Unrolled<I + 1, N>::similarity(ideal, genome, scores);
+    }
+
+    static void combine(const uint64_t picks, const double* first, const double* second, double* child) noexcept {
+        child[I] = ((picks >> I) & 1) != 0 ? first[I] : second[I];
+        Unrolled<I + 1, N>::combine(picks, first, second, child);
+    }
+};
+
+template<size_t N>
+struct Unrolled<N, N> {
+    static auto matches(const Genes& /* genes */) -> bool {
+        return true;
+    }
+
+    static auto similarity(const double* /* ideal */, const double* /* genome */, double* /* scores */) noexcept
+            -> double {
+        return 0;
+    }
+
+    static void combine(const uint64_t /* picks */, const double* /* first */, const double* /* second */,
+                        double* /* child */) noexcept {}
+};
+
+/*! Whether these are the genes the schema was compiled for, in the same order and with the same ranges */
+inline auto matches(const Genes& genes) -> bool {
+    return COMPILED && genes.size() == GENES && Unrolled<0>::matches(genes);
+}
+
+/*! Score every gene of a genome against the ideal, returning the sum; only for genes that match */
+inline auto similarity(const Genome& ideal, const Genome& genome, double* scores) noexcept -> double {
+    return Unrolled<0>::similarity(ideal.data(), genome.data(), scores);
+}
+
+/*! Take gene i from first if bit i of picks is set, else from second; only for genomes of GENES genes */
+inline void combine(const uint64_t picks, const Genome& first, const Genome& second, Genome* child) noexcept {
+    Unrolled<0>::combine(picks, first.data(), second.data(), child->data());
+}
+
+}  // namespace schema
+}  // namespace audiogene
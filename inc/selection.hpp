@@ -0,0 +1,145 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "math.hpp"
+
+namespace audiogene {
+
+constexpr size_t TOURNAMENT_SIZE = 3;
+constexpr double RANK_PRESSURE = 1.5;
+
+enum class SelectionStrategy {
+    Truncation,  //!< Uniformly from the fittest topN
+    Tournament,  //!< The fittest of tournamentSize individuals drawn uniformly
+    Roulette,  //!< Proportional to fitness, drawn from an alias table
+    StochasticUniversal,  //!< Proportional to fitness, all parents drawn in one evenly spaced sweep
+    Rank  //!< Linear ranking, the fittest rankPressure times as likely as average
+};
+
+auto selectionStrategy(const std::string& name) -> SelectionStrategy;
+
+struct SelectionConfig {
+    SelectionStrategy strategy;
+    size_t tournamentSize;
+    double rankPressure;
+
+    SelectionConfig():
+            strategy(SelectionStrategy::Truncation),
+            tournamentSize(TOURNAMENT_SIZE),
+            rankPressure(RANK_PRESSURE) {
+        // empty constructor
+    }
+};
+
+/*!
+ * Chooses parents from a scored generation, by the fitness of each individual
+ * (which niching may have derated).
+ * prepare() does any per-generation work, after which every draw is O(1)
+ * (O(tournamentSize) for tournaments).
+ */
+class Selection {
+ public:
+    virtual ~Selection() = default;
+
+    static auto create(const SelectionConfig& config, size_t topN) -> std::unique_ptr<Selection>;
+
+    /*! Get ready to make draws by fitness. It must stay unchanged until the last draw */
+    virtual void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) = 0;
+    /*! The index of one parent */
+    virtual auto select(const Math& math) -> size_t = 0;
+    /*! The indices of the two parents of one child. They may be the same individual */
+    virtual auto parents(const Math& math) -> std::pair<size_t, size_t> {
+        const size_t first = select(math);
+        return std::make_pair(first, select(math));
+    }
+};
+
+/*! The original strategy: two different individuals from the fittest topN */
+class TruncationSelection final : public Selection {
+    const size_t _topN;
+
+ public:
+    explicit TruncationSelection(size_t topN);
+
+    void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) final;
+    auto select(const Math& math) -> size_t final;
+    auto parents(const Math& math) -> std::pair<size_t, size_t> final;
+};
+
+class TournamentSelection final : public Selection {
+    const size_t _size;
+    const std::vector<double>* _fitness;
+
+ public:
+    explicit TournamentSelection(size_t size);
+
+    void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) final;
+    auto select(const Math& math) -> size_t final;
+};
+
+/*! Fitness proportionate selection using Vose's alias method */
+class RouletteSelection final : public Selection {
+    std::vector<double> _weights;
+    std::vector<double> _probability;
+    std::vector<size_t> _alias;
+    std::vector<size_t> _small;
+    std::vector<size_t> _large;
+
+ public:
+    void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) final;
+    auto select(const Math& math) -> size_t final;
+};
+
+/*! Fitness proportionate selection with minimal spread, shuffled so pairs are random */
+class StochasticUniversalSelection final : public Selection {
+    std::vector<double> _weights;
+    std::vector<size_t> _picks;
+    size_t _next;
+
+ public:
+    StochasticUniversalSelection();
+
+    void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) final;
+    auto select(const Math& math) -> size_t final;
+};
+
+/*! Linear ranking; ranks are drawn by inverting the ranking's distribution */
+class RankSelection final : public Selection {
+    const double _pressure;
+    std::vector<size_t> _order;
+
+ public:
+    explicit RankSelection(double pressure);
+
+    void prepare(const std::vector<double>& fitness, size_t draws, const Math& math) final;
+    auto select(const Math& math) -> size_t final;
+};
+
+}  // namespace audiogene
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+constexpr uint32_t SHOW_ARCHIVE_MAGIC = 0x41534741;  // "AGSA"
+constexpr uint32_t SHOW_ARCHIVE_VERSION = 1;
+constexpr size_t SHOW_ARCHIVE_CAPACITY = 1024;
+constexpr uint32_t SHOW_ARCHIVE_EVERY_GENERATIONS = 8;
+constexpr size_t WARM_START_ELITES = 8;
+constexpr size_t WARM_START_SAMPLES = 24;
+// Elites whose preferences are closer than this, in ranges, satisfied the same audience; only the fitter is kept
+constexpr double SHOW_ARCHIVE_RADIUS = 0.02;
+
+/*!
+ * On-disk layout of a show archive.
+ * The header is followed by the gene names and then capacity records, each
+ * 8-byte aligned so the file can be mapped and the records used in place.
+ * A record is the preferred value of each gene, the elite's genome and its
+ * fitness against those preferences, all doubles in name order.
+ */
+struct ShowArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t geneCount;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t count;  //!< records in use
+    uint64_t next;  //!< the oldest record, overwritten next once full
+    uint64_t namesOffset;  //!< gene names, each NUL-terminated
+    uint64_t namesSize;
+    uint64_t recordsOffset;  //!< capacity x (2 x geneCount + 1)
+};
+
+struct ShowArchiveConfig {
+    bool enabled;
+    std::string file;
+    //! Records a new archive file has room for
+    size_t capacity;
+    //! Record the fittest conductor this often, and when the show ends
+    uint32_t everyGenerations;
+    //! Archived elites nearest the opening preferences to start from
+    size_t elites;
+    //! Latin hypercube samples to start from alongside them
+    size_t samples;
+
+    ShowArchiveConfig():
+            enabled(false),
+            capacity(SHOW_ARCHIVE_CAPACITY),
+            everyGenerations(SHOW_ARCHIVE_EVERY_GENERATIONS),
+            elites(WARM_START_ELITES),
+            samples(WARM_START_SAMPLES) {
+        // empty constructor
+    }
+};
+
+/*!
+ * Elite conductors kept from show to show.
+ * The archive is a file mapped into memory, so records are written in place
+ * and survive the process. Each record is indexed by the preferences its
+ * conductor satisfied; a new elite replaces one recorded for nearly the same
+ * preferences only if it's fitter, and the oldest is overwritten once the
+ * file is full. A show warm starts from the elites recorded nearest its
+ * opening preferences, plus a Latin hypercube sample of the gene ranges so
+ * the search still covers them.
+ */
+class ShowArchive {
+    std::shared_ptr<spdlog::logger> _logger;
+    const Math _math;
+    const std::shared_ptr<const Genes> _genes;
+    const std::string _path;
+    const uint32_t _everyGenerations;
+    const size_t _elites;
+    const size_t _samples;
+
+    int _fd;
+    void* _map;
+    size_t _mapSize;
+    ShowArchiveHeader* _header;
+    double* _records;
+    size_t _stride;
+    // Where each configured gene's column is in the file
+    std::vector<size_t> _order;
+
+    // Scratch for finding the nearest records
+    std::vector<double> _query;
+    std::vector<std::pair<double, size_t>> _distances;
+
+    Gauge& _stored;
+    Counter& _recorded;
+
+    void create(size_t capacity);
+    void open();
+    void close() noexcept;
+    auto recordAt(size_t i) const noexcept -> double*;
+    /*! Fill _query with the preferred values as fractions of each gene's range */
+    void normalize(const Preferences& preferences);
+    /*! Fill _distances with every record's distance from _query, in ranges */
+    void measure();
+    void latinHypercube(size_t n, Individuals* samples) const;
+
+ public:
+    /*! The seed's genes give the archive's genes and their ranges */
+    ShowArchive(const ShowArchiveConfig& config, const Individual& seed);
+    ShowArchive(const ShowArchive&) = delete;
+    ShowArchive& operator=(const ShowArchive&) = delete;
+    ~ShowArchive();
+
+    /*! Keep conductor as the elite for these preferences, if it's the fittest recorded near them */
+    void record(const Individual& conductor, const Preferences& preferences);
+    /*! Up to k elites recorded for the preferences nearest these, nearest first */
+    auto nearest(const Preferences& preferences, size_t k) -> Individuals;
+    /*! Individuals to start a show from: the nearest elites, then Latin hypercube samples */
+    auto warmStart(const Preferences& preferences) -> Individuals;
+    auto everyGenerations() const noexcept -> uint32_t;
+    auto size() const noexcept -> size_t;
+};
+
+}  // namespace audiogene
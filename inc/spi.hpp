@@ -27,6 +27,7 @@
 #include <memory>
 
 #include "audience.hpp"
+#include "metrics.hpp"
 
 namespace audiogene {
 
@@ -39,6 +40,10 @@ class SPI: public Audience {
     std::shared_ptr<spdlog::logger> _logger;
     std::thread spiListenerThread;
 
+    Counter& _polls;
+    Counter& _events;
+    Histogram& _transferDuration;
+
  public:
     SPI();
     ~SPI() final = default;
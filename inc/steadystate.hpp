@@ -0,0 +1,138 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "genetics.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "optimizer.hpp"
+#include "population.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+// Children bred per hold of the population lock
+constexpr size_t STEADY_STATE_BATCH = 32;
+
+/*!
+ * A steady-state GA.
+ * A background thread breeds one child at a time from tournament-selected
+ * parents. A child fitter than the least fit individual replaces it, found at
+ * the top of a min-heap, so each step is O(log N). New preferences are picked
+ * up between batches, and the conductor is always the fittest so far.
+ * nextGeneration() only marks time for checkpoints and metrics.
+ */
+class SteadyState final : public Optimizer {
+    mutable std::shared_ptr<spdlog::logger> _logger;
+    Math _math;
+    Genetics _genetics;
+    const size_t _tournamentSize;
+    const std::chrono::microseconds _pause;
+
+    // Everything below is guarded by _populationMutex and changed by the breeding thread
+    mutable std::mutex _populationMutex;
+    Individuals _individuals;
+    // Indices into _individuals, least fit on top
+    std::vector<size_t> _heap;
+    size_t _fittest;
+    Individual _child;
+    std::vector<double> _ideal;
+    Preferences _audiencePreferences;
+    std::shared_ptr<const Reactions> _reactions;
+    uint32_t _generation;
+
+    // Preferences waiting for the breeding thread
+    std::mutex _incomingMutex;
+    Preferences _incoming;
+    std::atomic<bool> _haveIncoming;
+
+    // A copy of the fittest, so reading it never waits on a batch
+    mutable std::mutex _conductorMutex;
+    Individual _conductor;
+
+    std::condition_variable _wakeCV;
+    std::mutex _wakeMutex;
+    bool _stop;
+    std::thread _breeder;
+    std::atomic<uint64_t> _bred;
+
+    Counter& _steps;
+    Counter& _replacements;
+    Counter& _preferencesReceived;
+    Gauge& _generationGauge;
+    Gauge& _bestFitness;
+    Gauge& _worstFitness;
+
+    void run();
+    void breed();
+    void applyPreferences();
+    void score(Individual* individual) const;
+    /*! Score everyone again and rebuild the heap */
+    void rescore();
+    void reheap();
+    /*! Copy the fittest to where fittest() can read it */
+    void publish();
+    auto tournament() const -> size_t;
+    auto lessFit(size_t lhs, size_t rhs) const -> bool;
+
+ public:
+    /*! Uses the config's size, mutation and tournament size; pause is how long to rest between batches */
+    SteadyState(const PopulationConfig& config, const Individual& seed, std::chrono::microseconds pause);
+    SteadyState(const SteadyState&) = delete;
+    SteadyState& operator=(const SteadyState&) = delete;
+    ~SteadyState() final;
+
+    void setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) final;
+    void setPreferences(const Preferences& preferences) final;
+
+    void nextGeneration() final;
+    auto fittest() -> Individual final;
+    auto generation() const -> uint32_t final;
+    auto diversity() const -> double final;
+    /*! Children bred so far */
+    auto steps() const -> uint64_t;
+
+    auto checkpoint() const -> Checkpoint final;
+    void restore(const Checkpoint& checkpoint) final;
+    void warmStart(const Individuals& seeds, const Preferences& preferences) final;
+    void setReactions(const std::shared_ptr<const Reactions>& reactions) final;
+
+    void print(std::ostream& os) const final;
+};
+
+}  // namespace audiogene
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "metrics.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+// How much each observation counts for less than the next one; the audience's tastes drift
+constexpr double SURROGATE_FORGETTING = 0.98;
+// How much predicted contentment is worth against fitness when picking the conductor
+constexpr double SURROGATE_WEIGHT = 0.5;
+constexpr size_t SURROGATE_CANDIDATES = 1024;
+// Initial variance of each weight; large, so the first observations set them
+constexpr double SURROGATE_PRIOR = 1000;
+
+struct SurrogateConfig {
+    bool enabled;
+    double forgetting;
+    double weight;
+    //! Individuals from across the search screened for each conductor
+    size_t candidates;
+
+    SurrogateConfig():
+            enabled(false),
+            forgetting(SURROGATE_FORGETTING),
+            weight(SURROGATE_WEIGHT),
+            candidates(SURROGATE_CANDIDATES) {
+        // empty constructor
+    }
+};
+
+/*!
+ * An online model of how the audience responds to a conductor.
+ * Every conductor played is followed by the audience moving their
+ * preferences, or not. The response is how little they moved, as a fraction
+ * of each gene's range, so a conductor they were content with scores near 0
+ * and one that drove them away scores below it. Recursive least squares with
+ * a forgetting factor fits the response to each gene's value and its square,
+ * which costs one small matrix update per conductor played and one dot
+ * product per candidate screened. Until it has seen as many conductors as it
+ * has weights, it doesn't screen.
+ */
+class Surrogate {
+    std::shared_ptr<spdlog::logger> _logger;
+    const Genes _genes;
+    const double _forgetting;
+    const double _weight;
+    const size_t _candidates;
+    // A bias, then each gene and its square, normalized to the gene's range
+    const size_t _features;
+
+    std::vector<double> _weights;
+    // Inverse correlation of the features, _features x _features, row-major
+    std::vector<double> _P;
+    uint64_t _observations;
+    double _error;
+
+    // Scratch, preallocated
+    std::vector<double> _x;
+    std::vector<double> _Px;
+
+    Histogram& _updateDuration;
+    Histogram& _screenDuration;
+    Gauge& _errorGauge;
+    Counter& _observed;
+    Counter& _picked;
+
+    void featuresOf(const Genome& genome, double* x) const noexcept;
+
+ public:
+    /*! The seed's genes give the ranges features are normalized by */
+    Surrogate(const SurrogateConfig& config, const Individual& seed);
+
+    /*! Learn from how the audience's preferences moved after conductor played */
+    void observe(const Individual& conductor, const Preferences& before, const Preferences& after);
+    /*! The predicted response to a genome; 0 is content, below is driven away */
+    auto predict(const Genome& genome) const noexcept -> double;
+    /*!
+     * Replace conductor with whichever candidate has the best fitness plus
+     * weighted predicted response, if that isn't the conductor. Says whether
+     * it was replaced.
+     */
+    auto screen(const Individuals& candidates, Individual* conductor) -> bool;
+    /*! How many candidates to screen at a time */
+    auto candidates() const noexcept -> size_t;
+    /*! Recent mean absolute error of the prediction for each conductor, made before learning its response */
+    auto error() const noexcept -> double;
+};
+
+}  // namespace audiogene
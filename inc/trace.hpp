@@ -0,0 +1,161 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scoped trace events, written out in the Chrome trace-event format.
+// Build with AUDIOGENE_TRACING defined to compile them in; otherwise the macros
+// expand to nothing and cost nothing.
+#ifdef AUDIOGENE_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) audiogene::trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) audiogene::trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_THREAD_NAME(name) static_cast<void>(0)
+#endif
+
+namespace audiogene {
+namespace trace {
+
+constexpr size_t TRACE_BUFFER_EVENTS = 1u << 16;
+
+struct Event {
+    const char* name;  //!< Must be a string literal
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+/*!
+ * Events recorded by a single thread, in a ring that keeps the most recent
+ * TRACE_BUFFER_EVENTS so a stall late in a show is still in the trace.
+ * Only the owning thread writes. It claims an event before overwriting its
+ * slot and publishes it after, so the exporter can copy the ring without a
+ * lock and discard any slot that was overwritten while it copied.
+ */
+class ThreadBuffer {
+    struct Slot {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> startNs;
+        std::atomic<uint64_t> durationNs;
+    };
+
+    std::vector<Slot> _slots;
+    std::atomic<uint64_t> _claimed;
+    std::atomic<uint64_t> _published;
+    const uint32_t _tid;
+    std::atomic<const char*> _name;
+
+ public:
+    explicit ThreadBuffer(uint32_t tid);
+
+    void push(const Event& event) noexcept {
+        const uint64_t index = _claimed.load(std::memory_order_relaxed);
+        _claimed.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot& slot = _slots[index % _slots.size()];
+        slot.name.store(event.name, std::memory_order_relaxed);
+        slot.startNs.store(event.startNs, std::memory_order_relaxed);
+        slot.durationNs.store(event.durationNs, std::memory_order_relaxed);
+        _published.store(index + 1, std::memory_order_release);
+    }
+
+    /*! The events still in the ring, oldest first */
+    auto events() const -> std::vector<Event>;
+
+    /*! How many events have been overwritten by newer ones */
+    auto overwritten() const noexcept -> uint64_t {
+        const uint64_t published = _published.load(std::memory_order_relaxed);
+        return published > _slots.size() ? published - _slots.size() : 0;
+    }
+
+    void name(const char* name) noexcept {
+        _name.store(name, std::memory_order_relaxed);
+    }
+
+    auto name() const noexcept -> const char* {
+        return _name.load(std::memory_order_relaxed);
+    }
+
+    auto tid() const noexcept -> uint32_t {
+        return _tid;
+    }
+};
+
+auto now() noexcept -> uint64_t;
+
+/*! The calling thread's buffer, registered on first use */
+auto threadBuffer() -> ThreadBuffer&;
+
+/*! Name the calling thread in the trace. The name must be a string literal */
+void setThreadName(const char* name);
+
+/*! Write every thread's events to path as Chrome trace-event JSON */
+auto write(const std::string& path) -> bool;
+
+class Scope {
+    const char* _name;
+    const uint64_t _start;
+
+ public:
+    explicit Scope(const char* name): _name(name), _start(now()) {}
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+        threadBuffer().push(Event{_name, _start, now() - _start});
+    }
+};
+
+/*! Periodically rewrites the trace file so a running show can be inspected */
+class Exporter {
+    std::shared_ptr<spdlog::logger> _logger;
+    const std::string _path;
+    const std::chrono::seconds _interval;
+
+    std::mutex _stopMutex;
+    std::condition_variable _stopCV;
+    bool _stop;
+    std::thread _thread;
+
+ public:
+    Exporter(std::string path, std::chrono::seconds interval);
+    Exporter(const Exporter&) = delete;
+    Exporter& operator=(const Exporter&) = delete;
+    ~Exporter();
+};
+
+}  // namespace trace
+}  // namespace audiogene
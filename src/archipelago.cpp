@@ -0,0 +1,354 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "archipelago.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace audiogene {
+
+namespace {
+
+/*! A random stream for one island, seeded from the saved one so resuming twice gives the same islands */
+auto islandRng(const std::string& state, const size_t island) -> std::string {
+    std::default_random_engine rng;
+    std::istringstream in(state);
+    in >> rng;
+    std::seed_seq seed{static_cast<uint32_t>(rng()), static_cast<uint32_t>(island)};
+    rng.seed(seed);
+    std::ostringstream out;
+    out << rng;
+    return out.str();
+}
+
+}  // namespace
+
+auto migrationTopology(const std::string& name) -> MigrationTopology {
+    if (name == "ring") {
+        return MigrationTopology::Ring;
+    }
+    if (name == "full") {
+        return MigrationTopology::FullyConnected;
+    }
+    if (name == "random") {
+        return MigrationTopology::Random;
+    }
+    throw std::runtime_error("Unknown migration topology " + name);
+}
+
+Archipelago::Archipelago(const size_t islands,
+                         const PopulationConfig& island,
+                         const Individual& seed,
+                         const uint32_t migrationInterval,
+                         const size_t migrants,
+                         const MigrationTopology topology):
+        _logger(spdlog::get("log")),
+        _generation(0),
+        _migrationInterval(migrationInterval),
+        _migrants(migrants),
+        _topology(topology),
+        _round(0),
+        _pending(0),
+        _stop(false),
+        _forwarded(false),
+        _migrations(Metrics::instance().counter("audiogene_island_migrations_total", "Individuals moved between islands")),
+        _generationGauge(Metrics::instance().gauge("audiogene_generation", "Current generation")),
+        _bestFitness(Metrics::instance().gauge("audiogene_fitness_best", "Fitness of the fittest individual")) {
+    if (islands < 2) {
+        throw std::runtime_error("An archipelago needs at least two islands");
+    }
+    _logger->info("Making {} islands of {} individuals", islands, island.size);
+    for (size_t i = 0; i < islands; i++) {
+        PopulationConfig config(island);
+        config.island = std::to_string(i);
+        _islands.push_back(std::make_unique<Population>(config, seed));
+    }
+
+    for (size_t i = 0; i < islands; i++) {
+        _workers.emplace_back([this, i] () {
+            TRACE_THREAD_NAME("island");
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> l(_roundMutex);
+            while (true) {
+                _roundCV.wait(l, [this, &seen] () { return _stop || _round != seen; });
+                if (_stop) {
+                    return;
+                }
+                seen = _round;
+                l.unlock();
+                _islands[i]->nextGeneration();
+                l.lock();
+                if (--_pending == 0) {
+                    _doneCV.notify_all();
+                }
+            }
+        });
+    }
+}
+
+Archipelago::~Archipelago() {
+    {
+        std::lock_guard<std::mutex> l(_roundMutex);
+        _stop = true;
+    }
+    _roundCV.notify_all();
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+void Archipelago::setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) {
+    // Every island needs to hear every preference, so fan the queue out
+    _preferencesQueue = preferencesQueue;
+    _islandQueues.clear();
+    for (const std::unique_ptr<Population>& island : _islands) {
+        _islandQueues.push_back(std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>());
+        island->setPreferences(_islandQueues.back());
+    }
+}
+
+void Archipelago::forwardPreferences(const bool wait) {
+    if (!_preferencesQueue) {
+        return;
+    }
+    Preferences preferences;
+    bool received = false;
+    while (_preferencesQueue->try_dequeue(preferences)) {
+        received = true;
+    }
+    if (!received && !_forwarded && wait) {
+        // The islands have nothing to score against until the audience says what they like
+        received = _preferencesQueue->wait_dequeue_timed(preferences, std::chrono::seconds(PREFERENCES_WAIT_FOR_S));
+    }
+    if (!received) {
+        return;
+    }
+    for (const auto& islandQueue : _islandQueues) {
+        islandQueue->enqueue(preferences);
+    }
+    _forwarded = true;
+}
+
+void Archipelago::setPreferences(const Preferences& preferences) {
+    for (const std::unique_ptr<Population>& island : _islands) {
+        island->setPreferences(preferences);
+    }
+}
+
+void Archipelago::nextGeneration() {
+    advance(std::chrono::steady_clock::time_point::max());
+}
+
+auto Archipelago::advance(const std::chrono::steady_clock::time_point deadline) -> bool {
+    forwardPreferences(deadline == std::chrono::steady_clock::time_point::max());
+    if (_preferencesQueue && !_forwarded) {
+        // The islands have nothing to score against yet
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> l(_roundMutex);
+        _pending = _islands.size();
+        _round++;
+        _roundCV.notify_all();
+        _doneCV.wait(l, [this] () { return _pending == 0; });
+    }
+    _generation++;
+
+    if (_migrationInterval > 0 && _generation % _migrationInterval == 0) {
+        migrate();
+    }
+    _generationGauge.set(_generation);
+    _bestFitness.set(fittestIsland().fitness());
+    return true;
+}
+
+void Archipelago::migrate() {
+    TRACE_SCOPE("migration");
+    // Take every island's emigrants before anyone receives, so elites only move one hop
+    std::vector<Individuals> emigrants;
+    for (const std::unique_ptr<Population>& island : _islands) {
+        emigrants.push_back(island->emigrants(_migrants));
+    }
+
+    const size_t islands = _islands.size();
+    std::vector<Individuals> immigrants(islands);
+    for (size_t from = 0; from < islands; from++) {
+        switch (_topology) {
+            case MigrationTopology::Ring: {
+                Individuals& to = immigrants[(from + 1) % islands];
+                to.insert(to.end(), emigrants[from].begin(), emigrants[from].end());
+                break;
+            }
+            case MigrationTopology::FullyConnected:
+                for (size_t to = 0; to < islands; to++) {
+                    if (to != from) {
+                        immigrants[to].insert(immigrants[to].end(), emigrants[from].begin(), emigrants[from].end());
+                    }
+                }
+                break;
+            case MigrationTopology::Random: {
+                const size_t offset = 1 + _math.uniformInt<size_t>(0, islands - 2);
+                Individuals& to = immigrants[(from + offset) % islands];
+                to.insert(to.end(), emigrants[from].begin(), emigrants[from].end());
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < islands; i++) {
+        _islands[i]->immigrate(immigrants[i]);
+        _migrations.increment(immigrants[i].size());
+    }
+    _logger->debug("Migrated between {} islands", islands);
+}
+
+auto Archipelago::fittestIsland() -> Population& {
+    return **std::max_element(_islands.begin(), _islands.end(),
+            [] (const std::unique_ptr<Population>& lhs, const std::unique_ptr<Population>& rhs) {
+        return lhs->fitness() < rhs->fitness();
+    });
+}
+
+void Archipelago::warmStart(const Individuals& seeds, const Preferences& preferences) {
+    // Deal the seeds out to the islands in turn, so each starts somewhere different
+    const size_t islands = _islands.size();
+    for (size_t i = 0; i < islands; i++) {
+        Individuals island;
+        for (size_t j = i; j < seeds.size(); j += islands) {
+            island.push_back(seeds[j]);
+        }
+        _islands[i]->warmStart(island, preferences);
+    }
+}
+
+void Archipelago::setReactions(const std::shared_ptr<const Reactions>& reactions) {
+    for (const std::unique_ptr<Population>& island : _islands) {
+        island->setReactions(reactions);
+    }
+}
+
+auto Archipelago::fittest() -> Individual {
+    return fittestIsland().fittest();
+}
+
+auto Archipelago::sample(const size_t n) -> Individuals {
+    Individuals sample;
+    const size_t share = (n + _islands.size() - 1) / _islands.size();
+    for (const std::unique_ptr<Population>& island : _islands) {
+        const Individuals islanders = island->sample(std::min(share, n - sample.size()));
+        sample.insert(sample.end(), islanders.begin(), islanders.end());
+    }
+    return sample;
+}
+
+auto Archipelago::generation() const -> uint32_t {
+    return _generation;
+}
+
+auto Archipelago::diversity() const -> double {
+    // Within islands; islands that settled on different answers are still converged
+    double total = 0;
+    for (const std::unique_ptr<Population>& island : _islands) {
+        total += island->diversity();
+    }
+    return total / _islands.size();
+}
+
+auto Archipelago::checkpoint() const -> Checkpoint {
+    // Islands are stored back to back; the random state is the first island's
+    Checkpoint checkpoint = _islands.front()->checkpoint();
+    checkpoint.generation = _generation;
+    checkpoint.islands.push_back(checkpoint.fitness.size());
+    for (size_t i = 1; i < _islands.size(); i++) {
+        const Checkpoint island = _islands[i]->checkpoint();
+        checkpoint.genomes.insert(checkpoint.genomes.end(), island.genomes.begin(), island.genomes.end());
+        checkpoint.fitness.insert(checkpoint.fitness.end(), island.fitness.begin(), island.fitness.end());
+        checkpoint.islands.push_back(island.fitness.size());
+    }
+    return checkpoint;
+}
+
+void Archipelago::restore(const Checkpoint& checkpoint) {
+    if (checkpoint.fitness.empty()) {
+        throw std::runtime_error("Checkpoint has no individuals");
+    }
+    // Each island gets back its own block, so they stay apart across a resume. A checkpoint from
+    // a different number of islands, or a single population, is dealt out to the islands in turn
+    const size_t geneCount = checkpoint.genes.size();
+    const size_t islands = _islands.size();
+    const bool ownBlocks = checkpoint.islands.size() == islands
+            && std::accumulate(checkpoint.islands.begin(), checkpoint.islands.end(), uint64_t(0)) == checkpoint.fitness.size();
+    size_t blockStart = 0;
+    for (size_t i = 0; i < islands; i++) {
+        Checkpoint island(checkpoint);
+        island.genomes.clear();
+        island.fitness.clear();
+        island.islands.clear();
+        if (ownBlocks) {
+            const size_t blockEnd = blockStart + checkpoint.islands[i];
+            island.genomes.assign(checkpoint.genomes.begin() + blockStart * geneCount,
+                                  checkpoint.genomes.begin() + blockEnd * geneCount);
+            island.fitness.assign(checkpoint.fitness.begin() + blockStart, checkpoint.fitness.begin() + blockEnd);
+            blockStart = blockEnd;
+        } else {
+            for (size_t j = i; j < checkpoint.fitness.size(); j += islands) {
+                island.genomes.insert(island.genomes.end(),
+                                      checkpoint.genomes.begin() + j * geneCount,
+                                      checkpoint.genomes.begin() + (j + 1) * geneCount);
+                island.fitness.push_back(checkpoint.fitness[j]);
+            }
+        }
+        if (island.fitness.empty()) {
+            island.genomes.assign(checkpoint.genomes.begin(), checkpoint.genomes.begin() + geneCount);
+            island.fitness.push_back(checkpoint.fitness.front());
+        }
+        // Only the first island's random state is saved; the others mustn't repeat its draws
+        if (i > 0) {
+            island.populationRng = islandRng(checkpoint.populationRng, i);
+            island.geneticsRng = islandRng(checkpoint.geneticsRng, i);
+        }
+        _islands[i]->restore(island);
+    }
+    _generation = checkpoint.generation;
+}
+
+void Archipelago::print(std::ostream& os) const {
+    for (size_t i = 0; i < _islands.size(); i++) {
+        os << "Island " << i << ": ";
+        _islands[i]->print(os);
+    }
+}
+
+}  // namespace audiogene
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "checkpoint.hpp"
+
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t PREFERENCE_FIELDS = 3;
+
+auto align(const uint64_t offset) -> uint64_t {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+auto readString(const std::vector<char>& data, uint64_t* offset, const uint64_t end) -> std::string {
+    const auto terminator = std::find(data.begin() + *offset, data.begin() + end, '\0');
+    if (terminator == data.begin() + end) {
+        throw std::runtime_error("Corrupt checkpoint string");
+    }
+    std::string s(data.begin() + *offset, terminator);
+    *offset += s.size() + 1;
+    return s;
+}
+
+}  // namespace
+
+auto writeCheckpoint(const std::string& path, const Checkpoint& checkpoint) -> bool {
+    const size_t geneCount = checkpoint.genes.size();
+    const size_t individualCount = checkpoint.fitness.size();
+    if (checkpoint.genomes.size() != geneCount * individualCount) {
+        return false;
+    }
+    if (!checkpoint.islands.empty()
+            && std::accumulate(checkpoint.islands.begin(), checkpoint.islands.end(), uint64_t(0)) != individualCount) {
+        return false;
+    }
+
+    std::vector<char> names;
+    for (const AttributeName& gene : checkpoint.genes) {
+        names.insert(names.end(), gene.begin(), gene.end());
+        names.push_back('\0');
+    }
+    std::vector<double> preferences;
+    for (const AttributeName& gene : checkpoint.genes) {
+        const auto found = checkpoint.preferences.find(gene);
+        if (found == checkpoint.preferences.end()) {
+            // No preferences have come in for this gene yet
+            return false;
+        }
+        const Preference& preference = found->second;
+        preferences.push_back(preference.min);
+        preferences.push_back(preference.max);
+        preferences.push_back(preference.current);
+    }
+    std::vector<char> rng;
+    rng.insert(rng.end(), checkpoint.populationRng.begin(), checkpoint.populationRng.end());
+    rng.push_back('\0');
+    rng.insert(rng.end(), checkpoint.geneticsRng.begin(), checkpoint.geneticsRng.end());
+    rng.push_back('\0');
+
+    CheckpointHeader header{};
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.generation = checkpoint.generation;
+    header.geneCount = geneCount;
+    header.individualCount = individualCount;
+    header.namesOffset = align(sizeof(CheckpointHeader));
+    header.namesSize = names.size();
+    header.preferencesOffset = align(header.namesOffset + header.namesSize);
+    header.genomesOffset = align(header.preferencesOffset + preferences.size() * sizeof(double));
+    header.fitnessOffset = align(header.genomesOffset + checkpoint.genomes.size() * sizeof(double));
+    header.islandCount = checkpoint.islands.size();
+    header.islandsOffset = align(header.fitnessOffset + checkpoint.fitness.size() * sizeof(double));
+    header.rngOffset = align(header.islandsOffset + checkpoint.islands.size() * sizeof(uint64_t));
+    header.rngSize = rng.size();
+
+    std::vector<char> data(header.rngOffset + header.rngSize, '\0');
+    std::memcpy(&data[0], &header, sizeof(header));
+    std::copy(names.begin(), names.end(), data.begin() + header.namesOffset);
+    std::memcpy(&data[header.preferencesOffset], preferences.data(), preferences.size() * sizeof(double));
+    std::memcpy(&data[header.genomesOffset], checkpoint.genomes.data(), checkpoint.genomes.size() * sizeof(double));
+    std::memcpy(&data[header.fitnessOffset], checkpoint.fitness.data(), checkpoint.fitness.size() * sizeof(double));
+    std::memcpy(&data[header.islandsOffset], checkpoint.islands.data(), checkpoint.islands.size() * sizeof(uint64_t));
+    std::copy(rng.begin(), rng.end(), data.begin() + header.rngOffset);
+
+    const std::string tmpPath = path + ".tmp";
+    FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = written && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+auto readCheckpoint(const std::string& path) -> Checkpoint {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Failed to open checkpoint " + path);
+    }
+    const std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    CheckpointHeader header{};
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error("Checkpoint is truncated");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != CHECKPOINT_MAGIC) {
+        throw std::runtime_error("Not a checkpoint file");
+    }
+    if (header.version != CHECKPOINT_VERSION) {
+        throw std::runtime_error("Unsupported checkpoint version " + std::to_string(header.version));
+    }
+    // Each offset and size is checked against the file before it's added or multiplied, so none can overflow
+    const uint64_t size = data.size();
+    if (header.namesOffset < sizeof(header)
+            || header.namesOffset > size
+            || header.namesSize > size - header.namesOffset
+            || header.preferencesOffset < header.namesOffset + header.namesSize
+            || header.preferencesOffset > size
+            || header.genomesOffset < header.preferencesOffset
+            || header.genomesOffset > size
+            || header.fitnessOffset < header.genomesOffset
+            || header.fitnessOffset > size
+            || header.islandsOffset < header.fitnessOffset
+            || header.islandsOffset > size
+            || header.rngOffset < header.islandsOffset
+            || header.rngOffset > size
+            || header.rngSize > size - header.rngOffset
+            || header.geneCount > (header.genomesOffset - header.preferencesOffset) / sizeof(double) / PREFERENCE_FIELDS
+            || header.individualCount > (header.islandsOffset - header.fitnessOffset) / sizeof(double)
+            || header.islandCount > (header.rngOffset - header.islandsOffset) / sizeof(uint64_t)
+            || (header.individualCount > 0
+                && header.geneCount > (header.fitnessOffset - header.genomesOffset) / sizeof(double) / header.individualCount)) {
+        throw std::runtime_error("Checkpoint is truncated");
+    }
+    const uint64_t genomeValues = header.individualCount * header.geneCount;
+
+    Checkpoint checkpoint;
+    checkpoint.generation = header.generation;
+
+    uint64_t offset = header.namesOffset;
+    for (uint32_t i = 0; i < header.geneCount; i++) {
+        checkpoint.genes.push_back(readString(data, &offset, header.namesOffset + header.namesSize));
+    }
+
+    std::vector<double> preferences(header.geneCount * PREFERENCE_FIELDS);
+    std::memcpy(preferences.data(), data.data() + header.preferencesOffset, preferences.size() * sizeof(double));
+    for (uint32_t i = 0; i < header.geneCount; i++) {
+        checkpoint.preferences.emplace(checkpoint.genes[i], Preference(preferences[i * PREFERENCE_FIELDS],
+                                                                       preferences[i * PREFERENCE_FIELDS + 1],
+                                                                       preferences[i * PREFERENCE_FIELDS + 2]));
+    }
+
+    checkpoint.genomes.resize(genomeValues);
+    std::memcpy(checkpoint.genomes.data(), data.data() + header.genomesOffset, genomeValues * sizeof(double));
+    checkpoint.fitness.resize(header.individualCount);
+    std::memcpy(checkpoint.fitness.data(), data.data() + header.fitnessOffset, header.individualCount * sizeof(double));
+    checkpoint.islands.resize(header.islandCount);
+    std::memcpy(checkpoint.islands.data(), data.data() + header.islandsOffset, header.islandCount * sizeof(uint64_t));
+    uint64_t islanders = 0;
+    for (const uint64_t island : checkpoint.islands) {
+        if (island > header.individualCount - islanders) {
+            throw std::runtime_error("Checkpoint islands hold more individuals than it has");
+        }
+        islanders += island;
+    }
+    if (!checkpoint.islands.empty() && islanders != header.individualCount) {
+        throw std::runtime_error("Checkpoint islands don't hold every individual");
+    }
+
+    offset = header.rngOffset;
+    checkpoint.populationRng = readString(data, &offset, header.rngOffset + header.rngSize);
+    checkpoint.geneticsRng = readString(data, &offset, header.rngOffset + header.rngSize);
+    return checkpoint;
+}
+
+Checkpointer::Checkpointer(std::string path):
+        _logger(spdlog::get("log")),
+        _path(std::move(path)),
+        _stop(false),
+        _writes(Metrics::instance().counter("audiogene_checkpoints_total", "Checkpoints written")),
+        _failures(Metrics::instance().counter("audiogene_checkpoint_failures_total", "Checkpoints that failed to write")),
+        _writeDuration(Metrics::instance().histogram("audiogene_checkpoint_write_us", "Time to write a checkpoint")) {
+    _logger->info("Checkpointing to {}", _path);
+    _thread = std::thread([this] () {
+        std::unique_lock<std::mutex> l(_pendingMutex);
+        while (true) {
+            _pendingCV.wait(l, [this] () { return _stop || _pending; });
+            if (!_pending) {
+                return;
+            }
+            std::unique_ptr<Checkpoint> checkpoint = std::move(_pending);
+            l.unlock();
+
+            bool written = false;
+            try {
+                ScopedTimer writeTimer(_writeDuration);
+                written = writeCheckpoint(_path, *checkpoint);
+            } catch (const std::exception& e) {
+                // Nothing may escape this thread; the show carries on without the checkpoint
+                _logger->error("Checkpoint failed: {}", e.what());
+            }
+            if (written) {
+                _writes.increment();
+                _logger->debug("Checkpointed generation {}", checkpoint->generation);
+            } else {
+                _failures.increment();
+                _logger->warn("Failed to write checkpoint {}", _path);
+            }
+
+            l.lock();
+        }
+    });
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> l(_pendingMutex);
+        _stop = true;
+    }
+    _pendingCV.notify_all();
+    _thread.join();
+}
+
+void Checkpointer::save(Checkpoint checkpoint) {
+    {
+        std::lock_guard<std::mutex> l(_pendingMutex);
+        _pending = std::make_unique<Checkpoint>(std::move(checkpoint));
+    }
+    _pendingCV.notify_one();
+}
+
+}  // namespace audiogene
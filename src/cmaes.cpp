@@ -0,0 +1,520 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "cmaes.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+#include "population.hpp"
+#include "trace.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t JACOBI_SWEEPS = 50;
+constexpr double MIN_EIGENVALUE = 1e-20;
+constexpr double MIN_SIGMA = 1e-12;
+constexpr double MAX_SIGMA = 1.0;
+
+auto defaultLambda(const size_t n) -> size_t {
+    return 4 + static_cast<size_t>(3 * std::log(static_cast<double>(n)));
+}
+
+}  // namespace
+
+void jacobi(const size_t n, std::vector<double>* a, std::vector<double>* v) {
+    std::vector<double>& A = *a;
+    std::vector<double>& V = *v;
+    std::fill(V.begin(), V.end(), 0.0);
+    for (size_t i = 0; i < n; i++) {
+        V[i * n + i] = 1;
+    }
+
+    for (size_t sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+        double off = 0;
+        for (size_t p = 0; p < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                off += A[p * n + q] * A[p * n + q];
+            }
+        }
+        if (off < 1e-30) {
+            return;
+        }
+
+        for (size_t p = 0; p < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                const double apq = A[p * n + q];
+                if (std::abs(apq) < 1e-300) {
+                    continue;
+                }
+                // Rotate by the angle that zeroes A[p][q]
+                const double theta = (A[q * n + q] - A[p * n + p]) / (2 * apq);
+                const double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                const double c = 1 / std::sqrt(t * t + 1);
+                const double s = t * c;
+                for (size_t k = 0; k < n; k++) {
+                    const double akp = A[k * n + p];
+                    const double akq = A[k * n + q];
+                    A[k * n + p] = c * akp - s * akq;
+                    A[k * n + q] = s * akp + c * akq;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    const double apk = A[p * n + k];
+                    const double aqk = A[q * n + k];
+                    A[p * n + k] = c * apk - s * aqk;
+                    A[q * n + k] = s * apk + c * aqk;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    const double vkp = V[k * n + p];
+                    const double vkq = V[k * n + q];
+                    V[k * n + p] = c * vkp - s * vkq;
+                    V[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+CMAES::CMAES(const Individual& seed, const size_t lambda, const double sigma):
+        _logger(spdlog::get("log")),
+        _genes(std::make_shared<const Genes>(seed.genes())),
+        _n(_genes->size()),
+        _lambda(lambda > 0 ? lambda : defaultLambda(_n)),
+        _mu(_lambda / 2),
+        _initialSigma(sigma),
+        _updates(0),
+        _evaluations(0),
+        _eigenEvaluations(0),
+        _fittest(_genes, seed.genome()),
+        _generation(0),
+        _generationDuration(Metrics::instance().histogram("audiogene_generation_duration_us",
+                "Time to produce a new generation, including waiting for preferences")),
+        _preferencesTimeouts(Metrics::instance().counter("audiogene_preferences_timeouts_total",
+                "Generations that gave up waiting for audience preferences")),
+        _eigendecompositions(Metrics::instance().counter("audiogene_cmaes_eigendecompositions_total",
+                "Times the CMA-ES covariance was decomposed")),
+        _restarts(Metrics::instance().counter("audiogene_cmaes_restarts_total",
+                "Times CMA-ES widened its search because the audience moved")),
+        _generationGauge(Metrics::instance().gauge("audiogene_generation", "Current generation")),
+        _sigmaGauge(Metrics::instance().gauge("audiogene_cmaes_sigma", "CMA-ES step size")),
+        _bestFitness(Metrics::instance().gauge("audiogene_fitness_best", "Fitness of the fittest individual")) {
+    if (_n == 0) {
+        throw std::runtime_error("CMA-ES needs at least one gene");
+    }
+    if (_mu < 1) {
+        throw std::runtime_error("CMA-ES needs at least two samples per generation");
+    }
+
+    // Log-linear recombination weights for the fittest mu
+    double total = 0;
+    for (size_t i = 0; i < _mu; i++) {
+        _weights.push_back(std::log((_lambda + 1) / 2.0) - std::log(i + 1.0));
+        total += _weights.back();
+    }
+    double squares = 0;
+    for (double& weight : _weights) {
+        weight /= total;
+        squares += weight * weight;
+    }
+    _mueff = 1 / squares;
+
+    const double n = _n;
+    _cs = (_mueff + 2) / (n + _mueff + 5);
+    _ds = 1 + 2 * std::max(0.0, std::sqrt((_mueff - 1) / (n + 1)) - 1) + _cs;
+    _cc = (4 + _mueff / n) / (n + 4 + 2 * _mueff / n);
+    _c1 = 2 / ((n + 1.3) * (n + 1.3) + _mueff);
+    _cmu = std::min(1 - _c1, 2 * (_mueff - 2 + 1 / _mueff) / ((n + 2) * (n + 2) + _mueff));
+    _chiN = std::sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n));
+
+    _mean.resize(_n);
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        _mean[i] = _math.clip((seed.genome()[i] - gene.min) / (gene.max - gene.min), 0.0, 1.0);
+    }
+    _ps.resize(_n);
+    _pc.resize(_n);
+    _C.resize(_n * _n);
+    _B.resize(_n * _n);
+    _D.resize(_n);
+    _eigenWork.resize(_n * _n);
+    _z.resize(_lambda * _n);
+    _y.resize(_lambda * _n);
+    _x.resize(_lambda * _n);
+    _yw.resize(_n);
+    _work.resize(_n);
+    _order.resize(_lambda);
+    _samples.assign(_lambda, _fittest);
+    reset();
+
+    _logger->info("Sampling {} conductors per generation from the {} best, mueff {}", _lambda, _mu, _mueff);
+}
+
+void CMAES::reset() {
+    _sigma = _initialSigma;
+    std::fill(_ps.begin(), _ps.end(), 0.0);
+    std::fill(_pc.begin(), _pc.end(), 0.0);
+    std::fill(_C.begin(), _C.end(), 0.0);
+    std::fill(_B.begin(), _B.end(), 0.0);
+    for (size_t i = 0; i < _n; i++) {
+        _C[i * _n + i] = 1;
+        _B[i * _n + i] = 1;
+    }
+    std::fill(_D.begin(), _D.end(), 1.0);
+    _updates = 0;
+    _eigenEvaluations = _evaluations;
+}
+
+void CMAES::updateIdeal(const Preferences& preferences) {
+    if (_ideal.empty()) {
+        _ideal.resize(_n);
+        for (size_t i = 0; i < _n; i++) {
+            _ideal[i] = preferences.at((*_genes)[i].name).current;
+        }
+        return;
+    }
+
+    double shift = 0;
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        const double ideal = preferences.at(gene.name).current;
+        shift = std::max(shift, std::abs(ideal - _ideal[i]) / (gene.max - gene.min));
+        _ideal[i] = ideal;
+    }
+    // The learned shape no longer fits, so start wide again from where we are
+    if (shift > CMAES_RESTART_SHIFT) {
+        _restarts.increment();
+        reset();
+    }
+}
+
+auto CMAES::score(const double* x, Individual* individual) const -> double {
+    Genome& genome = *individual->mutableGenome();
+    double similarity = 0;
+    double penalty = 0;
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        const double clipped = _math.clip(x[i], 0.0, 1.0);
+        penalty += (x[i] - clipped) * (x[i] - clipped);
+        genome[i] = gene.min + clipped * (gene.max - gene.min);
+        if (gene.round) {
+            genome[i] = std::round(genome[i]);
+        }
+        similarity += _math.similarity(_ideal[i], genome[i], gene.min, gene.max);
+    }
+    const double fitness = similarity / _n - CMAES_BOUNDARY_PENALTY * penalty;
+    individual->setFitness(fitness);
+    return fitness;
+}
+
+void CMAES::sample() {
+    TRACE_SCOPE("sampling");
+    for (size_t k = 0; k < _lambda; k++) {
+        double* z = &_z[k * _n];
+        double* y = &_y[k * _n];
+        double* x = &_x[k * _n];
+        for (size_t i = 0; i < _n; i++) {
+            z[i] = _math.normalDistribution(0.0, 1.0);
+        }
+        // y = B D z
+        for (size_t i = 0; i < _n; i++) {
+            double sum = 0;
+            for (size_t j = 0; j < _n; j++) {
+                sum += _B[i * _n + j] * _D[j] * z[j];
+            }
+            y[i] = sum;
+            x[i] = _mean[i] + _sigma * sum;
+        }
+        score(x, &_samples[k]);
+        _samples[k].renew();
+    }
+    _evaluations += _lambda;
+}
+
+void CMAES::update() {
+    TRACE_SCOPE("adaptation");
+    // Weighted mean of the fittest steps
+    std::fill(_yw.begin(), _yw.end(), 0.0);
+    for (size_t j = 0; j < _mu; j++) {
+        const double* y = &_y[_order[j] * _n];
+        for (size_t i = 0; i < _n; i++) {
+            _yw[i] += _weights[j] * y[i];
+        }
+    }
+    for (size_t i = 0; i < _n; i++) {
+        _mean[i] += _sigma * _yw[i];
+    }
+
+    // Step size path, using C^-1/2 yw = B D^-1 B' yw
+    for (size_t j = 0; j < _n; j++) {
+        double sum = 0;
+        for (size_t i = 0; i < _n; i++) {
+            sum += _B[i * _n + j] * _yw[i];
+        }
+        _work[j] = sum / _D[j];
+    }
+    const double cs = std::sqrt(_cs * (2 - _cs) * _mueff);
+    double psNorm = 0;
+    for (size_t i = 0; i < _n; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < _n; j++) {
+            sum += _B[i * _n + j] * _work[j];
+        }
+        _ps[i] = (1 - _cs) * _ps[i] + cs * sum;
+        psNorm += _ps[i] * _ps[i];
+    }
+    psNorm = std::sqrt(psNorm);
+
+    // Stall the rank-one update while the step size path is unusually long
+    _updates++;
+    const double expected = std::sqrt(1 - std::pow(1 - _cs, 2.0 * _updates)) * _chiN;
+    const bool hsig = psNorm / expected < 1.4 + 2 / (_n + 1.0);
+
+    const double cc = hsig ? std::sqrt(_cc * (2 - _cc) * _mueff) : 0;
+    for (size_t i = 0; i < _n; i++) {
+        _pc[i] = (1 - _cc) * _pc[i] + cc * _yw[i];
+    }
+
+    // Rank-one and rank-mu updates, on the upper triangle then mirrored
+    const double keep = 1 - _c1 - _cmu + (hsig ? 0 : _c1 * _cc * (2 - _cc));
+    for (size_t i = 0; i < _n; i++) {
+        for (size_t j = i; j < _n; j++) {
+            double rankMu = 0;
+            for (size_t k = 0; k < _mu; k++) {
+                const double* y = &_y[_order[k] * _n];
+                rankMu += _weights[k] * y[i] * y[j];
+            }
+            const double c = keep * _C[i * _n + j] + _c1 * _pc[i] * _pc[j] + _cmu * rankMu;
+            _C[i * _n + j] = c;
+            _C[j * _n + i] = c;
+        }
+    }
+
+    _sigma *= std::exp((_cs / _ds) * (psNorm / _chiN - 1));
+    _sigma = _math.clip(_sigma, MIN_SIGMA, MAX_SIGMA);
+
+    // The decomposition only needs to be fresh to within a fraction of the learning rate
+    if (_evaluations - _eigenEvaluations > _lambda / (_c1 + _cmu) / _n / 10) {
+        decompose();
+    }
+}
+
+void CMAES::decompose() {
+    TRACE_SCOPE("eigendecomposition");
+    _eigendecompositions.increment();
+    _eigenEvaluations = _evaluations;
+    std::copy(_C.begin(), _C.end(), _eigenWork.begin());
+    jacobi(_n, &_eigenWork, &_B);
+    for (size_t i = 0; i < _n; i++) {
+        _D[i] = std::sqrt(std::max(_eigenWork[i * _n + i], MIN_EIGENVALUE));
+    }
+}
+
+auto CMAES::takePreferences(const bool wait) -> bool {
+    if (!_preferencesQueue) {
+        return !_generationPreferences.empty();
+    }
+    // Only the newest matter; the rest were never going to be played to
+    while (_preferencesQueue->try_dequeue(_generationPreferences)) {}
+    if (_generationPreferences.empty() && wait) {
+        TRACE_SCOPE("wait for preferences");
+        _preferencesQueue->wait_dequeue_timed(_generationPreferences, std::chrono::seconds(PREFERENCES_WAIT_FOR_S));
+    }
+    return !_generationPreferences.empty();
+}
+
+void CMAES::nextGeneration() {
+    if (!takePreferences(true)) {
+        // Nobody can be scored until the audience has said what they like
+        _preferencesTimeouts.increment();
+        return;
+    }
+    generate();
+}
+
+auto CMAES::advance(const std::chrono::steady_clock::time_point deadline) -> bool {
+    // Waiting would only spend time the generation needs
+    if (!takePreferences(deadline == std::chrono::steady_clock::time_point::max())) {
+        _preferencesTimeouts.increment();
+        return false;
+    }
+    generate();
+    return true;
+}
+
+void CMAES::generate() {
+    ScopedTimer generationTimer(_generationDuration);
+    _generation = _generation + 1;
+
+    updateIdeal(_generationPreferences);
+    sample();
+    std::iota(_order.begin(), _order.end(), 0);
+    std::sort(_order.begin(), _order.end(), [this] (const size_t lhs, const size_t rhs) {
+        return _samples[lhs].fitness() > _samples[rhs].fitness();
+    });
+
+    // Keep the best conductor seen, judged by what the audience wants now
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        _work[i] = (_fittest.genome()[i] - gene.min) / (gene.max - gene.min);
+    }
+    score(_work.data(), &_fittest);
+    const Individual& best = _samples[_order.front()];
+    if (best.fitness() > _fittest.fitness()) {
+        _fittest = best;
+    }
+
+    update();
+
+    _generationGauge.set(_generation);
+    _sigmaGauge.set(_sigma);
+    _bestFitness.set(_fittest.fitness());
+}
+
+void CMAES::setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) {
+    // Read by the generations themselves, so nobody holds anything while the audience is quiet
+    _preferencesQueue = preferencesQueue;
+}
+
+void CMAES::setPreferences(const Preferences& preferences) {
+    _generationPreferences = preferences;
+}
+
+auto CMAES::fittest() -> Individual {
+    return _fittest;
+}
+
+auto CMAES::generation() const -> uint32_t {
+    return _generation;
+}
+
+auto CMAES::diversity() const -> double {
+    // The step size is already in genes normalized to their range
+    return _sigma;
+}
+
+auto CMAES::sigma() const -> double {
+    return _sigma;
+}
+
+auto CMAES::lambda() const -> size_t {
+    return _lambda;
+}
+
+auto CMAES::checkpoint() const -> Checkpoint {
+    TRACE_SCOPE("checkpoint");
+    Checkpoint checkpoint;
+    checkpoint.generation = _generation;
+    for (const Gene& gene : *_genes) {
+        checkpoint.genes.push_back(gene.name);
+    }
+    // The fittest first, then the latest samples
+    checkpoint.genomes = _fittest.genome();
+    checkpoint.fitness.push_back(_fittest.fitness());
+    for (const Individual& individual : _samples) {
+        checkpoint.genomes.insert(checkpoint.genomes.end(), individual.genome().begin(), individual.genome().end());
+        checkpoint.fitness.push_back(individual.fitness());
+    }
+    checkpoint.preferences = _generationPreferences;
+    checkpoint.populationRng = _math.state();
+    checkpoint.geneticsRng = _math.state();
+    return checkpoint;
+}
+
+void CMAES::restore(const Checkpoint& checkpoint) {
+    if (checkpoint.genes.size() != _n || checkpoint.fitness.empty()) {
+        throw std::runtime_error("Checkpoint genes don't match configured genes");
+    }
+    const size_t fittest = std::distance(checkpoint.fitness.begin(),
+            std::max_element(checkpoint.fitness.begin(), checkpoint.fitness.end()));
+
+    // Only the fittest is kept; the distribution starts again around it
+    Genome& genome = *_fittest.mutableGenome();
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        const auto it = std::find(checkpoint.genes.begin(), checkpoint.genes.end(), gene.name);
+        if (it == checkpoint.genes.end() || checkpoint.preferences.count(gene.name) == 0) {
+            throw std::runtime_error("Gene " + gene.name + " isn't in the checkpoint");
+        }
+        genome[i] = checkpoint.genomes[fittest * _n + std::distance(checkpoint.genes.begin(), it)];
+        _mean[i] = _math.clip((genome[i] - gene.min) / (gene.max - gene.min), 0.0, 1.0);
+    }
+    _fittest.setFitness(checkpoint.fitness[fittest]);
+    _fittest.renew();
+    reset();
+
+    _generation = checkpoint.generation;
+    _generationPreferences = checkpoint.preferences;
+    _ideal.clear();
+    _math.restore(checkpoint.populationRng);
+    _logger->info("Restored CMA-ES around the fittest at generation {}", _generation);
+}
+
+void CMAES::warmStart(const Individuals& seeds, const Preferences& preferences) {
+    if (seeds.empty()) {
+        return;
+    }
+    _generationPreferences = preferences;
+    _ideal.clear();
+    updateIdeal(_generationPreferences);
+
+    // Only one distribution, so centre it on whichever seed suits the opening preferences best
+    Individual candidate(_fittest);
+    double best = 0;
+    for (size_t s = 0; s < seeds.size(); s++) {
+        for (size_t i = 0; i < _n; i++) {
+            const Gene& gene = (*_genes)[i];
+            _work[i] = _math.clip((seeds[s].genome()[i] - gene.min) / (gene.max - gene.min), 0.0, 1.0);
+        }
+        const double fitness = score(_work.data(), &candidate);
+        if (s == 0 || fitness > best) {
+            best = fitness;
+            _mean = _work;
+            _fittest = candidate;
+        }
+    }
+    _fittest.renew();
+    reset();
+    _bestFitness.set(best);
+    _logger->info("Warm started CMA-ES around the fittest of {} individuals", seeds.size());
+}
+
+void CMAES::print(std::ostream& os) const {
+    os << "CMA-ES generation " << _generation << ", sigma " << _sigma << "\n";
+    for (size_t i = 0; i < _n; i++) {
+        const Gene& gene = (*_genes)[i];
+        os << "\tMean " << gene.name << ": " << gene.min + _mean[i] * (gene.max - gene.min) << "\n";
+    }
+    os << "\tFittest " << _fittest << std::endl;
+}
+
+}  // namespace audiogene
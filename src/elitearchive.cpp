@@ -0,0 +1,221 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "elitearchive.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace audiogene {
+
+EliteArchive::EliteArchive(const ArchiveConfig& config, const Individual& seed):
+        _logger(spdlog::get("log")),
+        _genes(seed.genes()),
+        _bins(config.bins),
+        _offered(config.offered),
+        _haveIncoming(false),
+        _sorting(false),
+        _stop(false),
+        _filledCount(0),
+        _cellsFilled(Metrics::instance().gauge("audiogene_archive_cells_filled",
+                "Archive cells holding an elite conductor")),
+        _elitesReplaced(Metrics::instance().counter("audiogene_archive_elites_replaced_total",
+                "Conductors that took a cell of the archive")),
+        _conductorsPicked(Metrics::instance().counter("audiogene_archive_conductors_total",
+                "Requests conducted by an elite from the archive rather than the optimizer's fittest")) {
+    if (config.descriptors.empty()) {
+        throw std::runtime_error("The archive needs at least one descriptor gene");
+    }
+    if (_bins < 1) {
+        throw std::runtime_error("The archive needs at least one bin per descriptor");
+    }
+    size_t cells = 1;
+    for (const std::string& descriptor : config.descriptors) {
+        const auto it = std::find_if(_genes.begin(), _genes.end(), [&descriptor] (const Gene& gene) {
+            return gene.name == descriptor;
+        });
+        if (it == _genes.end()) {
+            throw std::runtime_error("Archive descriptor " + descriptor + " isn't a gene");
+        }
+        _descriptors.push_back(std::distance(_genes.begin(), it));
+        if (cells > ARCHIVE_MAX_CELLS / _bins) {
+            throw std::runtime_error("The archive would have too many cells");
+        }
+        cells *= _bins;
+    }
+    _logger->info("Archiving conductors in {} cells", cells);
+    _elites.assign(cells, seed);
+    _filled.assign(cells, 0);
+    _ideal.assign(_genes.size(), 0);
+
+    _thread = std::thread([this] () { run(); });
+}
+
+EliteArchive::~EliteArchive() {
+    {
+        std::lock_guard<std::mutex> l(_incomingMutex);
+        _stop = true;
+    }
+    _wakeCV.notify_all();
+    _thread.join();
+}
+
+auto EliteArchive::offered() const noexcept -> size_t {
+    return _offered;
+}
+
+auto EliteArchive::filled() const -> size_t {
+    std::lock_guard<std::mutex> l(_cellsMutex);
+    return _filledCount;
+}
+
+auto EliteArchive::cellOf(const Genome& genome) const noexcept -> size_t {
+    size_t cell = 0;
+    for (const size_t d : _descriptors) {
+        const Gene& gene = _genes[d];
+        const double position = (genome[d] - gene.min) / (gene.max - gene.min);
+        const auto bin = static_cast<size_t>(std::max(0.0, position * _bins));
+        cell = cell * _bins + std::min(_bins - 1, bin);
+    }
+    return cell;
+}
+
+void EliteArchive::idealOf(const Preferences& preferences, Genome* ideal) const {
+    ideal->resize(_genes.size());
+    for (size_t i = 0; i < _genes.size(); i++) {
+        (*ideal)[i] = preferences.at(_genes[i].name).current;
+    }
+}
+
+void EliteArchive::score(const Genome& ideal, Individual* individual) const {
+    const Genome& genome = individual->genome();
+    double total = 0;
+    for (size_t i = 0; i < _genes.size(); i++) {
+        total += _math.similarity(ideal[i], genome[i], _genes[i].min, _genes[i].max);
+    }
+    individual->setFitness(total / _genes.size());
+}
+
+void EliteArchive::offer(const Individuals& conductors, const Preferences& preferences) {
+    {
+        std::lock_guard<std::mutex> l(_incomingMutex);
+        // Offers the thread hasn't got to yet are judged by the newer preferences too
+        _incoming.insert(_incoming.end(), conductors.begin(), conductors.end());
+        _incomingPreferences = preferences;
+        _haveIncoming = true;
+    }
+    _wakeCV.notify_all();
+}
+
+void EliteArchive::run() {
+    TRACE_THREAD_NAME("archive");
+    while (true) {
+        {
+            std::unique_lock<std::mutex> l(_incomingMutex);
+            _wakeCV.wait(l, [this] () { return _stop || _haveIncoming; });
+            if (_stop) {
+                return;
+            }
+            _offers.swap(_incoming);
+            _incoming.clear();
+            _preferences.swap(_incomingPreferences);
+            _haveIncoming = false;
+            _sorting = true;
+        }
+        sort();
+        {
+            std::lock_guard<std::mutex> l(_incomingMutex);
+            _sorting = false;
+        }
+        _idleCV.notify_all();
+    }
+}
+
+void EliteArchive::drain() {
+    std::unique_lock<std::mutex> l(_incomingMutex);
+    _idleCV.wait(l, [this] () { return !_haveIncoming && !_sorting; });
+}
+
+void EliteArchive::sort() {
+    TRACE_SCOPE("archive");
+    Genome ideal;
+    idealOf(_preferences, &ideal);
+    for (Individual& offer : _offers) {
+        score(ideal, &offer);
+    }
+
+    std::lock_guard<std::mutex> l(_cellsMutex);
+    if (ideal != _ideal) {
+        // What was fittest in each cell is judged again by what the audience wants now
+        for (size_t cell = 0; cell < _elites.size(); cell++) {
+            if (_filled[cell]) {
+                score(ideal, &_elites[cell]);
+            }
+        }
+        _ideal.swap(ideal);
+    }
+    for (const Individual& offer : _offers) {
+        const size_t cell = cellOf(offer.genome());
+        if (_filled[cell] && _elites[cell].fitness() >= offer.fitness()) {
+            continue;
+        }
+        if (!_filled[cell]) {
+            _filled[cell] = 1;
+            _filledCount++;
+        }
+        _elites[cell] = offer;
+        _elitesReplaced.increment();
+    }
+    _cellsFilled.set(_filledCount);
+}
+
+auto EliteArchive::challenge(const Preferences& preferences, Individual* conductor) const -> bool {
+    Genome ideal;
+    idealOf(preferences, &ideal);
+    Individual elite(*conductor);
+    {
+        std::lock_guard<std::mutex> l(_cellsMutex);
+        const size_t cell = cellOf(ideal);
+        if (!_filled[cell]) {
+            return false;
+        }
+        elite = _elites[cell];
+    }
+    // Judge both by plain similarity, on a copy; the conductor's own fitness may blend in reactions
+    Individual incumbent(*conductor);
+    score(ideal, &elite);
+    score(ideal, &incumbent);
+    if (elite.fitness() <= incumbent.fitness()) {
+        return false;
+    }
+    *conductor = elite;
+    _conductorsPicked.increment();
+    return true;
+}
+
+}  // namespace audiogene
@@ -24,24 +24,39 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <string>
 
 #include "math.hpp"
+#include "metrics.hpp"
+#include "schema.hpp"
 
 namespace audiogene {
 
 // Keep implementation header in source so it's not included
 class Genetics::Impl {
     mutable std::shared_ptr<spdlog::logger> _logger;
-    const Math _math;
+    Math _math;
     const double _mutationProbability;
+    const bool _selfAdaptive;
+    const bool _oneFifthRule;
+    double _stepScale;
 
-    auto mutateExpression(const Expression& orig,
-            const std::function<double(const Expression&)>&& distribution) const noexcept -> Expression;
+    Counter& _crossovers;
+    Counter& _mutations;
+    Counter& _mutationResamples;
+
+    auto mutateGene(const Gene& gene, double orig,
+            const std::function<double(const Gene&, double)>&& distribution) const noexcept -> double;
+    /*! A normal draw around current with standard deviation step, as a fraction of the range, after scaling */
+    auto mutateStep(const Gene& gene, double current, double step) const noexcept -> double;
 
  public:
-    explicit Impl(double mutationProbability);
+    explicit Impl(const MutationConfig& config);
     Impl(const Impl&) = delete;
     Impl(Impl&&) = delete;
     auto operator=(const Impl&) -> Impl& = delete;
@@ -49,101 +64,197 @@ class Genetics::Impl {
     ~Impl() = default;
 
 
-    static auto create(const Instructions& seed) -> Instructions;
-    auto combine(const std::pair<Instructions, Instructions>& parents) const noexcept -> Instructions;
-    auto mutate(const Instructions& instructions) const noexcept -> Instructions;
+    static void create(const Genes& genes, Genome* genome);
+    void randomize(const Genes& genes, Genome* genome) const noexcept;
+    void combine(const Genome& first, const Genome& second, Genome* child) const noexcept;
+    void combineSteps(const StepSizes& first, const StepSizes& second, StepSizes* child) const noexcept;
+    void mutate(const Genes& genes, Genome* genome, StepSizes* steps) const noexcept;
+    void perturb(const Genes& genes, Genome* genome, const StepSizes& steps) const noexcept;
+    auto adapt(double successRate) -> double;
+
+    auto rngState() const -> std::string;
+    void restoreRng(const std::string& state);
 };
 
-Genetics::Genetics(const double mutationProbability): _impl(new Impl(mutationProbability)) {}
+Genetics::Genetics(const MutationConfig& config): _impl(new Impl(config)) {}
 Genetics::~Genetics() = default;
 
-auto Genetics::create(const Instructions& seed) -> Instructions {
-    return Impl::create(seed);
+void Genetics::create(const Genes& genes, Genome* genome) {
+    Impl::create(genes, genome);
+}
+
+void Genetics::randomize(const Genes& genes, Genome* genome) const noexcept {
+    Pimpl()->randomize(genes, genome);
+}
+
+void Genetics::combine(const Genome& first, const Genome& second, Genome* child) const noexcept {
+    Pimpl()->combine(first, second, child);
+}
+void Genetics::combineSteps(const StepSizes& first, const StepSizes& second, StepSizes* child) const noexcept {
+    Pimpl()->combineSteps(first, second, child);
+}
+
+void Genetics::mutate(const Genes& genes, Genome* genome, StepSizes* steps) const noexcept {
+    Pimpl()->mutate(genes, genome, steps);
 }
 
-auto Genetics::combine(const std::pair<Instructions, Instructions>& parents) const noexcept -> Instructions {
-    return Pimpl()->combine(parents);
+void Genetics::perturb(const Genes& genes, Genome* genome, const StepSizes& steps) const noexcept {
+    Pimpl()->perturb(genes, genome, steps);
 }
-auto Genetics::mutate(const Instructions& instructions) const noexcept -> Instructions {
-    return Pimpl()->mutate(instructions);
+
+auto Genetics::adapt(const double successRate) -> double {
+    return Pimpl()->adapt(successRate);
+}
+
+auto Genetics::rngState() const -> std::string {
+    return Pimpl()->rngState();
+}
+
+void Genetics::restoreRng(const std::string& state) {
+    Pimpl()->restoreRng(state);
 }
 
 
 //
 // Implementation
 //
-Genetics::Impl::Impl(const double mutationProbability):
+Genetics::Impl::Impl(const MutationConfig& config):
         _logger(spdlog::get("log")),
-        _mutationProbability(mutationProbability) {
+        _mutationProbability(config.probability),
+        _selfAdaptive(config.selfAdaptive),
+        _oneFifthRule(config.oneFifthRule),
+        _stepScale(1),
+        _crossovers(Metrics::instance().counter("audiogene_genetics_crossovers_total", "Children made by crossover")),
+        _mutations(Metrics::instance().counter("audiogene_genetics_mutations_total", "Genes mutated")),
+        _mutationResamples(Metrics::instance().counter("audiogene_genetics_mutation_resamples_total",
+                "Mutations redrawn because they fell outside the gene range")) {
     // Empty constructor
 }
 
 // TODO Create individuals using an open-ended normal distribution with the median at the middle of the min/max
-auto Genetics::Impl::create(const Instructions& seed) -> Instructions {
-    Instructions newInstructions;
-    for (const auto& i : seed) {
-        const AttributeName name(i.first);
-        Expression newExpression(i.second.expression());
-        if (newExpression.round) {
-            newExpression.current = std::round(newExpression.current);
+void Genetics::Impl::create(const Genes& genes, Genome* genome) {
+    for (size_t i = 0; i < genes.size(); i++) {
+        if (genes[i].round) {
+            (*genome)[i] = std::round((*genome)[i]);
         }
-        newInstructions.emplace(name, Instruction(name, newExpression));
     }
-    return newInstructions;
 }
 
-auto Genetics::Impl::combine(const std::pair<Instructions, Instructions>& parents) const noexcept -> Instructions {
-    const Instructions parent1 = parents.first;
-    const Instructions parent2 = parents.second;
-    Instructions childInstructions;
-
-    for (const auto& kv : parent1) {
-        const AttributeName attributeName = kv.first;
-        if (_math.flipCoin()) {
-            childInstructions.emplace(attributeName, parent1.at(attributeName));
-        } else {
-            childInstructions.emplace(attributeName, parent2.at(attributeName));
-        }
+void Genetics::Impl::randomize(const Genes& genes, Genome* genome) const noexcept {
+    for (size_t i = 0; i < genes.size(); i++) {
+        const double value = genes[i].min + _math.uniformReal(0.0, 1.0) * (genes[i].max - genes[i].min);
+        (*genome)[i] = genes[i].round ? std::round(value) : value;
     }
-    return childInstructions;
 }
 
-auto Genetics::Impl::mutate(const Instructions& instructions) const noexcept -> Instructions {
-    Instructions newInstructions;
+void Genetics::Impl::combine(const Genome& first, const Genome& second, Genome* child) const noexcept {
+    if (schema::COMPILED && first.size() == schema::GENES) {
+        // One draw picks every gene's parent
+        schema::combine(_math.uniformInt<uint64_t>(0, std::numeric_limits<uint64_t>::max()), first, second, child);
+        _crossovers.increment();
+        return;
+    }
+    for (size_t i = 0; i < first.size(); i++) {
+        (*child)[i] = _math.flipCoin() ? first[i] : second[i];
+    }
+    _crossovers.increment();
+}
 
-    for (const auto& kv : instructions) {
-        const AttributeName attributeName = kv.first;
-        const Instruction instruction = kv.second;
+void Genetics::Impl::combineSteps(const StepSizes& first, const StepSizes& second,
+                                  StepSizes* child) const noexcept {
+    // Strategy parameters recombine intermediately
+    for (size_t i = 0; i < first.size(); i++) {
+        (*child)[i] = (first[i] + second[i]) / 2;
+    }
+}
 
-        // Check if we should mutate or not
-        if (_math.didEventOccur(_mutationProbability)) {
-            // do the mutation thing
-            Expression mutatedExpression(mutateExpression(instruction.expression(), [this] (const Expression& expression) {
-                // This is the mutation function
-                // It can be swapped with other mutation functions
-                return _math.normalDistribution(expression.current, _math.stddev(expression.min, expression.max));
-            }));
+auto Genetics::Impl::mutateStep(const Gene& gene, const double current, const double step) const noexcept -> double {
+    const double stddev = std::min(step * _stepScale, MAX_STEP) * (gene.max - gene.min);
+    return mutateGene(gene, current, [this, stddev] (const Gene& /* gene */, const double value) {
+        return _math.normalDistribution(value, stddev);
+    });
+}
 
-            newInstructions.emplace(attributeName, Instruction(attributeName, mutatedExpression));
-        } else {
-            newInstructions.emplace(attributeName, instruction);
+void Genetics::Impl::mutate(const Genes& genes, Genome* genome, StepSizes* steps) const noexcept {
+    if (_mutationProbability <= 0) {
+        return;
+    }
+    // Self-adaptive steps change log-normally: one draw shared by the child's mutated genes, and one
+    // per gene. Genes that aren't mutated keep their step, since nothing has tested a new one
+    const double n = genes.size();
+    const double globalRate = 1 / std::sqrt(2 * n);
+    const double localRate = 1 / std::sqrt(2 * std::sqrt(n));
+    const double shared = _selfAdaptive ? globalRate * _math.normalDistribution(0.0, 1.0) : 0;
+    const auto mutateAt = [&] (const size_t i) {
+        _mutations.increment();
+        double step = INITIAL_STEP;
+        if (_selfAdaptive) {
+            step = (*steps)[i] * std::exp(shared + localRate * _math.normalDistribution(0.0, 1.0));
+            step = _math.clip(step, MIN_STEP, MAX_STEP);
+            (*steps)[i] = step;
         }
+        (*genome)[i] = mutateStep(genes[i], (*genome)[i], step);
+    };
+    if (_mutationProbability >= 1) {
+        // Every gene mutates; geometric_distribution needs p < 1
+        for (size_t i = 0; i < genes.size(); i++) {
+            mutateAt(i);
+        }
+        return;
+    }
+    // Each gene mutates independently, so the gap to the next mutated gene is geometric.
+    // Skipping straight to it costs one draw per mutation rather than one per gene.
+    size_t i = _math.geometric<size_t>(_mutationProbability);
+    while (i < genes.size()) {
+        mutateAt(i);
+        // Compare before adding; a long enough gap would overflow
+        const size_t gap = _math.geometric<size_t>(_mutationProbability);
+        if (gap >= genes.size() - i - 1) {
+            break;
+        }
+        i += gap + 1;
+    }
+}
+
+void Genetics::Impl::perturb(const Genes& genes, Genome* genome, const StepSizes& steps) const noexcept {
+    const size_t i = _math.uniformInt<size_t>(0, genes.size() - 1);
+    _mutations.increment();
+    (*genome)[i] = mutateStep(genes[i], (*genome)[i], steps[i]);
+}
+
+auto Genetics::Impl::adapt(const double successRate) -> double {
+    if (!_oneFifthRule) {
+        return _stepScale;
+    }
+    if (successRate > TARGET_SUCCESS_RATE) {
+        _stepScale /= STEP_SCALE_FACTOR;
+    } else if (successRate < TARGET_SUCCESS_RATE) {
+        _stepScale *= STEP_SCALE_FACTOR;
     }
+    _stepScale = _math.clip(_stepScale, MIN_STEP_SCALE, MAX_STEP_SCALE);
+    return _stepScale;
+}
+
+auto Genetics::Impl::rngState() const -> std::string {
+    return _math.state();
+}
 
-    return newInstructions;
+void Genetics::Impl::restoreRng(const std::string& state) {
+    _math.restore(state);
 }
 
-auto Genetics::Impl::mutateExpression(const Expression& orig,
-        const std::function<double(const Expression&)>&& distribution) const noexcept -> Expression {
-    Expression mutatedExpression(orig);
-    do {
-        mutatedExpression.current = distribution(orig);
-    } while (!_math.inRange(mutatedExpression.current, mutatedExpression.min, mutatedExpression.max));
+auto Genetics::Impl::mutateGene(const Gene& gene, const double orig,
+        const std::function<double(const Gene&, double)>&& distribution) const noexcept -> double {
+    double mutated = distribution(gene, orig);
+    while (!_math.inRange(mutated, gene.min, gene.max)) {
+        _mutationResamples.increment();
+        mutated = distribution(gene, orig);
+    }
 
-    if (mutatedExpression.round) {
-        mutatedExpression.current = std::round(mutatedExpression.current);
+    if (gene.round) {
+        mutated = std::round(mutated);
     }
-    return mutatedExpression;
+    return mutated;
 }
 
 }  // namespace audiogene
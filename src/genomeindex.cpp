@@ -0,0 +1,168 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "genomeindex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+
+GenomeIndex::GenomeIndex():
+        _dimensions(0),
+        _size(0) {
+    // empty constructor
+}
+
+auto GenomeIndex::size() const noexcept -> size_t {
+    return _size;
+}
+
+auto GenomeIndex::coordinate(const size_t position, const size_t dimension) const noexcept -> double {
+    return _points[_order[position] * _dimensions + dimension];
+}
+
+void GenomeIndex::build(const Individuals& individuals, const std::vector<double>& weights) {
+    _size = individuals.size();
+    _dimensions = weights.size();
+    if (_dimensions > std::numeric_limits<uint8_t>::max()) {
+        throw std::runtime_error("Too many genes to index");
+    }
+    _points.resize(_size * _dimensions);
+    for (size_t i = 0; i < _size; i++) {
+        const Genome& genome = individuals[i].genome();
+        for (size_t d = 0; d < _dimensions; d++) {
+            _points[i * _dimensions + d] = genome[d] * weights[d];
+        }
+    }
+    _order.resize(_size);
+    std::iota(_order.begin(), _order.end(), 0);
+    _split.resize(_size);
+    build(0, _size);
+}
+
+void GenomeIndex::build(const size_t lo, const size_t hi) {
+    if (hi - lo <= 1) {
+        return;
+    }
+
+    // Split where the points are most spread out
+    size_t widest = 0;
+    double widestSpread = -1;
+    for (size_t d = 0; d < _dimensions; d++) {
+        double low = std::numeric_limits<double>::infinity();
+        double high = -low;
+        for (size_t p = lo; p < hi; p++) {
+            low = std::min(low, coordinate(p, d));
+            high = std::max(high, coordinate(p, d));
+        }
+        if (high - low > widestSpread) {
+            widestSpread = high - low;
+            widest = d;
+        }
+    }
+
+    const size_t mid = lo + (hi - lo) / 2;
+    std::nth_element(_order.begin() + lo, _order.begin() + mid, _order.begin() + hi,
+                     [this, widest] (const size_t a, const size_t b) {
+        return _points[a * _dimensions + widest] < _points[b * _dimensions + widest];
+    });
+    _split[mid] = static_cast<uint8_t>(widest);
+    build(lo, mid);
+    build(mid + 1, hi);
+}
+
+void GenomeIndex::nearest(const Genome& ideal, const std::vector<double>& weights, const size_t k,
+                          std::vector<size_t>* result) {
+    result->clear();
+    if (_size == 0 || k == 0) {
+        return;
+    }
+    _query.resize(_dimensions);
+    for (size_t d = 0; d < _dimensions; d++) {
+        _query[d] = ideal[d] * weights[d];
+    }
+
+    _offsets.assign(_dimensions, 0.0);
+    _heap.clear();
+    _heap.reserve(k);
+    search(0, _size, k, 0);
+
+    std::sort_heap(_heap.begin(), _heap.end());
+    for (const std::pair<double, size_t>& found : _heap) {
+        result->push_back(found.second);
+    }
+}
+
+void GenomeIndex::search(const size_t lo, const size_t hi, const size_t k, const double bound) {
+    if (lo >= hi) {
+        return;
+    }
+    const size_t mid = lo + (hi - lo) / 2;
+
+    double distance = 0;
+    for (size_t d = 0; d < _dimensions; d++) {
+        distance += std::abs(_query[d] - coordinate(mid, d));
+    }
+    if (_heap.size() < k) {
+        _heap.emplace_back(distance, _order[mid]);
+        std::push_heap(_heap.begin(), _heap.end());
+    } else if (distance < _heap.front().first) {
+        std::pop_heap(_heap.begin(), _heap.end());
+        _heap.back() = std::make_pair(distance, _order[mid]);
+        std::push_heap(_heap.begin(), _heap.end());
+    }
+    if (hi - lo == 1) {
+        return;
+    }
+
+    // Search the side the query is on first. bound is how far the query is from
+    // this node's cell; the far side's cell is at least the plane's distance
+    // away in the split dimension, so it's only searched if that could still win
+    const size_t dimension = _split[mid];
+    const double offset = _query[dimension] - coordinate(mid, dimension);
+    const bool left = offset < 0;
+    if (left) {
+        search(lo, mid, k, bound);
+    } else {
+        search(mid + 1, hi, k, bound);
+    }
+
+    const double previous = _offsets[dimension];
+    const double farBound = bound - previous + std::abs(offset);
+    if (_heap.size() < k || farBound < _heap.front().first) {
+        _offsets[dimension] = std::abs(offset);
+        if (left) {
+            search(mid + 1, hi, k, farBound);
+        } else {
+            search(lo, mid, k, farBound);
+        }
+        _offsets[dimension] = previous;
+    }
+}
+
+}  // namespace audiogene
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Writes the genes of a config as a compile-time schema, for builds with AUDIOGENE_SCHEMA set.
+// Usage: genschema <config.yaml> <schema.hpp>
+
+#include <yaml-cpp/yaml.h>
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "instruction.hpp"
+
+namespace {
+
+using KeyMap = std::map<std::string, std::map<std::string, std::string>>;
+
+auto literal(const std::string& s) -> std::string {
+    std::string quoted = "\"";
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void writeSchema(const KeyMap& genes, const std::string& source, std::ostream& out) {
+    out.precision(std::numeric_limits<double>::max_digits10);
+    out << "// Generated by genschema from " << source << "; don't edit\n\n"
+        << "#pragma once\n\n"
+        << "#include <cstddef>\n\n"
+        << "namespace audiogene {\n"
+        << "namespace schema {\n\n"
+        << "constexpr size_t GENES = " << genes.size() << ";\n\n"
+        << "template<size_t I>\n"
+        << "struct StaticGene;\n";
+    // Genes are kept in name order, as individuals are made from the config
+    size_t i = 0;
+    for (const auto& gene : genes) {
+        const audiogene::Expression expression(gene.second);
+        if (expression.max <= expression.min) {
+            throw std::runtime_error("Gene " + gene.first + " needs a max above its min");
+        }
+        out << "\ntemplate<>\n"
+            << "struct StaticGene<" << i++ << "> {\n"
+            << "    static constexpr auto name() -> const char* { return " << literal(gene.first) << "; }\n"
+            << "    static constexpr auto min() -> double { return " << expression.min << "; }\n"
+            << "    static constexpr auto max() -> double { return " << expression.max << "; }\n"
+            << "    static constexpr auto round() -> bool { return " << (expression.round ? "true" : "false")
+            << "; }\n"
+            << "};\n";
+    }
+    out << "\n}  // namespace schema\n"
+        << "}  // namespace audiogene\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {  // NOLINT
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <config.yaml> <schema.hpp>" << std::endl;
+        return -1;
+    }
+    try {
+        KeyMap genes;
+        try {
+            genes = YAML::LoadFile(argv[1])["genes"].as<KeyMap>();
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error(std::string("Missing genes: ") + e.what());
+        }
+        if (genes.empty()) {
+            throw std::runtime_error("No genes to compile");
+        }
+        std::ofstream out(argv[2]);
+        if (!out) {
+            throw std::runtime_error(std::string("Failed to open ") + argv[2]);
+        }
+        writeSchema(genes, argv[1], out);
+        if (!out.flush()) {
+            throw std::runtime_error(std::string("Failed to write ") + argv[2]);
+        }
+        return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to generate schema: " << e.what() << std::endl;
+        return -1;
+    }
+}
@@ -24,14 +24,40 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace audiogene {
 
-uint32_t Individual::s_id = 0;
+std::atomic<uint32_t> Individual::s_id(0);
+
+namespace {
+
+auto convertInstructionsToGenes(const Instructions& instructions) -> std::shared_ptr<const Genes> {
+    auto genes = std::make_shared<Genes>();
+    for (const auto& kv : instructions) {
+        genes->emplace_back(kv.first, kv.second.expression());
+    }
+    return genes;
+}
+
+auto convertInstructionsToGenome(const Instructions& instructions) -> Genome {
+    Genome genome;
+    for (const auto& kv : instructions) {
+        genome.push_back(kv.second.expression().current);
+    }
+    return genome;
+}
+
+}  // namespace
 
 auto convertMapToInstructions(const std::map<std::string, std::map<std::string, std::string>>& instructions) -> Instructions {
     Instructions r;
@@ -43,27 +69,110 @@ auto convertMapToInstructions(const std::map<std::string, std::map<std::string,
 }
 
 Individual::Individual(const std::map<std::string, std::map<std::string, std::string>>& instructions):
-        _id(s_id++),
-        _instructions(convertMapToInstructions(instructions)) {
+        Individual(convertMapToInstructions(instructions)) {
     // empty constructor
 }
 
-Individual::Individual(Instructions instructions):
-        _id(s_id++),
-        _instructions(std::move(instructions)) {
+Individual::Individual(const Instructions& instructions):
+        Individual(convertInstructionsToGenes(instructions), convertInstructionsToGenome(instructions)) {
     // empty constructor
 }
 
+Individual::Individual(std::shared_ptr<const Genes> genes, Genome genome):
+        _id(s_id++),
+        _genes(std::move(genes)),
+        _genome(std::move(genome)),
+        _steps(_genome.size(), INITIAL_STEP),
+        _fitness(0) {
+    assert(_genes->size() == _genome.size());
+}
+
+auto Individual::id() const noexcept -> uint32_t {
+    return _id;
+}
+
+void Individual::renew() noexcept {
+    _id = s_id++;
+    _scores.clear();
+}
+
+auto Individual::genes() const noexcept -> const Genes& {
+    return *_genes;
+}
+
+auto Individual::genome() const noexcept -> const Genome& {
+    return _genome;
+}
+
+auto Individual::mutableGenome() noexcept -> Genome* {
+    return &_genome;
+}
+
+auto Individual::steps() const noexcept -> const StepSizes& {
+    return _steps;
+}
+
+auto Individual::mutableSteps() noexcept -> StepSizes* {
+    return &_steps;
+}
+
+auto Individual::scores() const noexcept -> const std::vector<double>& {
+    return _scores;
+}
+
+auto Individual::mutableScores() noexcept -> std::vector<double>* {
+    return &_scores;
+}
+
+auto Individual::fitness() const noexcept -> double {
+    return _fitness;
+}
+
+void Individual::setFitness(const double fitness) noexcept {
+    _fitness = fitness;
+}
+
 auto Individual::instruction(const std::string& name) const -> Instruction {
-    try {
-        return _instructions.at(name);
-    } catch (const std::out_of_range& e) {
-        throw std::runtime_error("Failed to find instruction " + name);
+    for (size_t i = 0; i < _genome.size(); i++) {
+        const Gene& gene = (*_genes)[i];
+        if (gene.name == name) {
+            return Instruction(name, Expression(gene.min, gene.max, _genome[i], gene.round, gene.activates));
+        }
+    }
+    throw std::runtime_error("Failed to find instruction " + name);
+}
+
+auto Individual::instructions() const -> Instructions {
+    Instructions r;
+    for (size_t i = 0; i < _genome.size(); i++) {
+        const Gene& gene = (*_genes)[i];
+        r.emplace(gene.name, Instruction(gene.name, Expression(gene.min, gene.max, _genome[i], gene.round, gene.activates)));
     }
+    return r;
 }
 
-auto Individual::instructions() const noexcept -> Instructions {
-    return _instructions;
+auto diversity(const Individuals& individuals) -> double {
+    if (individuals.size() < 2) {
+        return 0;
+    }
+    const Genes& genes = individuals.front().genes();
+    std::vector<double> sums(genes.size(), 0.0);
+    std::vector<double> squares(genes.size(), 0.0);
+    for (const Individual& individual : individuals) {
+        const Genome& genome = individual.genome();
+        for (size_t i = 0; i < genome.size(); i++) {
+            sums[i] += genome[i];
+            squares[i] += genome[i] * genome[i];
+        }
+    }
+    const double n = individuals.size();
+    double total = 0;
+    for (size_t i = 0; i < genes.size(); i++) {
+        const double mean = sums[i] / n;
+        const double variance = std::max(0.0, squares[i] / n - mean * mean);
+        total += std::sqrt(variance) / (genes[i].max - genes[i].min);
+    }
+    return total / genes.size();
 }
 
 }  // namespace audiogene
@@ -25,17 +25,33 @@
 #include <spdlog/spdlog.h>
 #include <yaml-cpp/yaml.h>
 
+#include <pthread.h>
+
+#include <csignal>
+#include <exception>
 #include <future>
+#include <thread>
 
 #include "performance.hpp"
 
 // Command line argument flags
 DEFINE_string(config, "", "Configuration for the genetics");  // NOLINT
 DEFINE_string(log, "out.log", "Logfile path");  // NOLINT
+DEFINE_bool(resume, false, "Resume the population from the configured checkpoint");  // NOLINT
 
 int main(int argc, char* argv[]) {  // NOLINT
     gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+    // Interrupts end the show rather than kill it, so it can be recorded. Block them before
+    // any thread starts, so every thread inherits the mask and only sigwait sees them
+    sigset_t endSignals;
+    sigemptyset(&endSignals);
+    sigaddset(&endSignals, SIGINT);
+    sigaddset(&endSignals, SIGTERM);
+    // Sent to ourselves once the show is over, so the waiting thread can finish
+    sigaddset(&endSignals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &endSignals, nullptr);
+
     try {
         std::shared_ptr<spdlog::logger> logger;
         try {
@@ -57,9 +73,26 @@ int main(int argc, char* argv[]) {  // NOLINT
             return -1;
         }
 
-        audiogene::Performance performance(config);
+        audiogene::Performance performance(config, FLAGS_resume);
         std::future<void> presentation = performance.play();
-        presentation.get();
+        std::thread endOnSignal([&performance, &logger, endSignals] () {
+            int signal = 0;
+            if (sigwait(&endSignals, &signal) == 0 && signal != SIGUSR1) {
+                logger->info("Ending the show on signal {}", signal);
+                performance.end();
+            }
+        });
+        std::exception_ptr failure;
+        try {
+            presentation.get();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        pthread_kill(endOnSignal.native_handle(), SIGUSR1);
+        endOnSignal.join();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
         return 0;
     } catch (const std::runtime_error& e) {
         std::cout << "Failed to start performance: " << e.what() << std::endl;
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "metrics.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace audiogene {
+
+namespace {
+
+/*! A registered name split into the metric and any labels, without their braces */
+auto splitLabels(const std::string& name) -> std::pair<std::string, std::string> {
+    const size_t brace = name.find('{');
+    if (brace == std::string::npos) {
+        return std::make_pair(name, std::string());
+    }
+    return std::make_pair(name.substr(0, brace), name.substr(brace + 1, name.size() - brace - 2));
+}
+
+auto withLabels(const std::string& labels) -> std::string {
+    return labels.empty() ? std::string() : "{" + labels + "}";
+}
+
+}  // namespace
+
+auto Metrics::prometheus() const -> std::string {
+    std::lock_guard<std::mutex> l(_registryMutex);
+    std::ostringstream out;
+    // Labelled instances of a metric share its HELP and TYPE lines
+    std::set<std::string> described;
+    const auto describe = [&out, &described] (const std::string& metric, const std::string& help,
+                                              const char* type) {
+        if (described.insert(metric).second) {
+            out << "# HELP " << metric << " " << help << "\n";
+            out << "# TYPE " << metric << " " << type << "\n";
+        }
+    };
+
+    for (const auto& kv : _counters) {
+        const auto name = splitLabels(kv.first);
+        describe(name.first, kv.second.help, "counter");
+        out << kv.first << " " << kv.second.metric->value() << "\n";
+    }
+
+    for (const auto& kv : _gauges) {
+        const auto name = splitLabels(kv.first);
+        describe(name.first, kv.second.help, "gauge");
+        out << kv.first << " " << kv.second.metric->value() << "\n";
+    }
+
+    for (const auto& kv : _histograms) {
+        const Histogram& histogram = *kv.second.metric;
+        const auto name = splitLabels(kv.first);
+        const std::string bucketLabels = name.second.empty() ? std::string() : name.second + ",";
+        describe(name.first, kv.second.help, "histogram");
+        // Only emit the buckets that have something in them; there are far too
+        // many log-linear buckets to list them all
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            const uint64_t n = histogram.bucket(i);
+            if (n == 0) {
+                continue;
+            }
+            cumulative += n;
+            out << name.first << "_bucket{" << bucketLabels << "le=\"" << Histogram::upperBound(i) << "\"} "
+                << cumulative << "\n";
+        }
+        out << name.first << "_bucket{" << bucketLabels << "le=\"+Inf\"} " << histogram.count() << "\n";
+        out << name.first << "_sum" << withLabels(name.second) << " " << histogram.sum() << "\n";
+        out << name.first << "_count" << withLabels(name.second) << " " << histogram.count() << "\n";
+    }
+
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(std::string path, const std::chrono::seconds interval):
+        _logger(spdlog::get("log")),
+        _path(std::move(path)),
+        _interval(interval),
+        _stop(false) {
+    _logger->info("Exporting metrics to {} every {}s", _path, _interval.count());
+    _thread = std::thread([this] () {
+        std::unique_lock<std::mutex> l(_stopMutex);
+        while (!_stopCV.wait_for(l, _interval, [this] () { return _stop; })) {
+            if (!write()) {
+                _logger->warn("Failed to write metrics to {}", _path);
+            }
+        }
+    });
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> l(_stopMutex);
+        _stop = true;
+    }
+    _stopCV.notify_all();
+    _thread.join();
+}
+
+auto MetricsExporter::write() const -> bool {
+    // Write next to the target and rename so a scraper never sees a partial file
+    const std::string tmpPath = _path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << Metrics::instance().prometheus();
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), _path.c_str()) == 0;
+}
+
+}  // namespace audiogene
@@ -31,6 +31,8 @@
 #include <sstream>
 #include <utility>
 
+#include "trace.hpp"
+
 namespace audiogene {
 
 auto convertToMapPair(const std::map<AttributeName, std::map<std::string, std::string>>& mapping)
@@ -57,7 +59,10 @@ MIDI::MIDI(const std::string& name, const std::map<AttributeName, std::map<std::
         _logger(spdlog::get("log")),
         _name(name),
         _mapping(convertToMapPair(mapping)),
-        midiin(new RtMidiIn()) {
+        midiin(new RtMidiIn()),
+        _messages(Metrics::instance().counter("audiogene_midi_messages_total", "MIDI messages received")),
+        _callbackDuration(Metrics::instance().histogram("audiogene_midi_callback_us",
+                "Time spent handling a MIDI message")) {
     _logger->info("MIDI client created for device {}", _name);
 }
 
@@ -98,6 +103,10 @@ auto MIDI::prepare() -> bool {
         (void)timeStamp;
         size_t messageSize = message->size();
         MIDI* that = static_cast<MIDI*>(userData);
+        TRACE_THREAD_NAME("midi");
+        TRACE_SCOPE("midi message");
+        ScopedTimer callbackTimer(that->_callbackDuration);
+        that->_messages.increment();
         that->_logger->debug("Received MIDI message");
         if (messageSize > 0) {
             // we only care about note-off
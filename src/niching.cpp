@@ -0,0 +1,306 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "niching.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+
+namespace {
+
+constexpr uint8_t UNCLEARED = 0;
+constexpr uint8_t KEPT = 1;
+constexpr uint8_t CLEARED = 2;
+
+auto cellHash(const uint64_t key) noexcept -> uint64_t {
+    return hashMix(key ^ HASH_PRIME, HASH_FINAL);
+}
+
+}  // namespace
+
+auto nichingMethod(const std::string& name) -> NichingMethod {
+    if (name == "none") {
+        return NichingMethod::None;
+    } else if (name == "crowding") {
+        return NichingMethod::Crowding;
+    } else if (name == "sharing") {
+        return NichingMethod::Sharing;
+    } else if (name == "clearing") {
+        return NichingMethod::Clearing;
+    }
+    throw std::runtime_error("Unknown niching method " + name);
+}
+
+NeighbourGrid::NeighbourGrid():
+        _size(0),
+        _genes(0),
+        _radius(1),
+        _cells(1) {
+    // empty constructor
+}
+
+auto NeighbourGrid::size() const noexcept -> size_t {
+    return _size;
+}
+
+auto NeighbourGrid::distance(const Genes& genes, const Genome& a, const Genome& b) noexcept -> double {
+    double furthest = 0;
+    for (size_t g = 0; g < genes.size(); g++) {
+        furthest = std::max(furthest, std::abs(a[g] - b[g]) / (genes[g].max - genes[g].min));
+    }
+    return furthest;
+}
+
+auto NeighbourGrid::cellOf(const size_t position, const size_t dimension) const noexcept -> int64_t {
+    // Keys hold the first grid gene's cell in their most significant digit
+    uint64_t key = _keys[_order[position]];
+    for (size_t d = dimension + 1; d < _gridGenes.size(); d++) {
+        key /= _cells;
+    }
+    return static_cast<int64_t>(key % _cells);
+}
+
+void NeighbourGrid::build(const Individuals& individuals, const double radius) {
+    _size = individuals.size();
+    _radius = radius;
+    if (_size == 0) {
+        return;
+    }
+    const Genes& genes = individuals.front().genes();
+    _genes = genes.size();
+
+    // Scale every gene to its range, noting how spread out each one is
+    _scratch.resize(_size * _genes);
+    _spreads.resize(_genes);
+    for (size_t g = 0; g < _genes; g++) {
+        const double range = genes[g].max - genes[g].min;
+        double low = std::numeric_limits<double>::infinity();
+        double high = -low;
+        double* column = &_scratch[g * _size];
+        for (size_t i = 0; i < _size; i++) {
+            column[i] = range > 0 ? (individuals[i].genome()[g] - genes[g].min) / range : 0;
+            low = std::min(low, column[i]);
+            high = std::max(high, column[i]);
+        }
+        _spreads[g] = std::make_pair(high - low, g);
+    }
+
+    // Grid the genes that separate individuals the most, until cells are about full enough
+    _cells = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(1 / _radius)));
+    std::sort(_spreads.begin(), _spreads.end(), std::greater<std::pair<double, size_t>>());
+    _gridGenes.clear();
+    const size_t dimensions = std::min(GRID_DIMENSIONS, _genes);
+    for (double cells = _cells; cells * GRID_OCCUPANCY <= _size && _gridGenes.size() < dimensions; cells *= _cells) {
+        _gridGenes.push_back(_spreads[_gridGenes.size()].second);
+    }
+    _keys.resize(_size);
+    for (size_t i = 0; i < _size; i++) {
+        uint64_t key = 0;
+        for (const size_t g : _gridGenes) {
+            key = key * _cells + std::min(_cells - 1, static_cast<int64_t>(_scratch[g * _size + i] / _radius));
+        }
+        _keys[i] = key;
+    }
+
+    // Lay individuals out cell by cell
+    _order.resize(_size);
+    std::iota(_order.begin(), _order.end(), 0);
+    std::sort(_order.begin(), _order.end(), [this] (const size_t lhs, const size_t rhs) {
+        return _keys[lhs] < _keys[rhs];
+    });
+    _position.resize(_size);
+    for (size_t p = 0; p < _size; p++) {
+        _position[_order[p]] = p;
+    }
+    _packed.pack(individuals, _order);
+
+    if (_cellIndex.capacity() < _size) {
+        _cellIndex.reserve(_size);
+    } else {
+        _cellIndex.clear();
+    }
+    _runs.clear();
+    for (size_t p = 0; p < _size; p++) {
+        const uint64_t key = _keys[_order[p]];
+        if (p == 0 || key != _keys[_order[p - 1]]) {
+            _cellIndex.insert(cellHash(key), static_cast<uint32_t>(_runs.size()));
+            _runs.emplace_back(p, p);
+        }
+        _runs.back().second = p + 1;
+    }
+    _distances.resize(_size);
+}
+
+void NeighbourGrid::neighbours(const size_t i, std::vector<std::pair<size_t, double>>* result) {
+    result->clear();
+    const size_t from = _position[i];
+    const size_t dimensions = _gridGenes.size();
+    int64_t centre[GRID_DIMENSIONS];
+    size_t around = 1;
+    for (size_t d = 0; d < dimensions; d++) {
+        centre[d] = cellOf(from, d);
+        around *= 3;
+    }
+
+    // Anyone closer than radius is at most one cell away along each grid gene
+    for (size_t c = 0; c < around; c++) {
+        uint64_t key = 0;
+        size_t digits = c;
+        bool inside = true;
+        for (size_t d = 0; d < dimensions && inside; d++) {
+            const int64_t cell = centre[d] + static_cast<int64_t>(digits % 3) - 1;
+            digits /= 3;
+            inside = cell >= 0 && cell < _cells;
+            key = key * _cells + cell;
+        }
+        const uint32_t* run = inside ? _cellIndex.find(cellHash(key)) : nullptr;
+        if (run == nullptr) {
+            continue;
+        }
+        const size_t begin = _runs[*run].first;
+        const size_t end = _runs[*run].second;
+        _packed.distances(from, begin, end, _distances.data());
+        for (size_t p = begin; p < end; p++) {
+            if (_distances[p] < _radius) {
+                result->emplace_back(_order[p], _distances[p]);
+            }
+        }
+    }
+}
+
+Niching::Niching(const NichingConfig& config):
+        _config(config),
+        _niches(0) {
+    if (_config.radius <= 0 || _config.radius > 1) {
+        throw std::runtime_error("Niche radius must be over 0 and at most 1");
+    }
+    if (_config.alpha <= 0) {
+        throw std::runtime_error("Sharing alpha must be positive");
+    }
+    if (_config.capacity < 1) {
+        throw std::runtime_error("Clearing needs at least one winner per niche");
+    }
+}
+
+auto Niching::method() const noexcept -> NichingMethod {
+    return _config.method;
+}
+
+auto Niching::derates() const noexcept -> bool {
+    return _config.method == NichingMethod::Sharing || _config.method == NichingMethod::Clearing;
+}
+
+auto Niching::niches() const noexcept -> double {
+    return _niches;
+}
+
+void Niching::derate(const Individuals& individuals, std::vector<double>* fitness) {
+    const size_t n = individuals.size();
+    fitness->resize(n);
+    for (size_t i = 0; i < n; i++) {
+        (*fitness)[i] = individuals[i].fitness();
+    }
+    if (!derates() || n == 0) {
+        return;
+    }
+    // Fitness can be negative, so derate how far each is above the least fit
+    const double least = *std::min_element(fitness->begin(), fitness->end());
+    _grid.build(individuals, _config.radius);
+    if (_config.method == NichingMethod::Sharing) {
+        share(individuals, least, fitness);
+    } else {
+        clear(individuals, least, fitness);
+    }
+}
+
+void Niching::share(const Individuals& individuals, const double least, std::vector<double>* fitness) {
+    _niches = 0;
+    for (size_t i = 0; i < individuals.size(); i++) {
+        _grid.neighbours(i, &_neighbours);
+        // Everyone shares with themselves, so this is at least 1
+        double count = 0;
+        for (const std::pair<size_t, double>& neighbour : _neighbours) {
+            count += 1 - std::pow(neighbour.second / _config.radius, _config.alpha);
+        }
+        (*fitness)[i] = least + ((*fitness)[i] - least) / count;
+        _niches += 1 / count;
+    }
+}
+
+void Niching::clear(const Individuals& individuals, const double least, std::vector<double>* fitness) {
+    const size_t n = individuals.size();
+    _order.resize(n);
+    std::iota(_order.begin(), _order.end(), 0);
+    std::sort(_order.begin(), _order.end(), [&individuals] (const size_t lhs, const size_t rhs) {
+        return individuals[lhs].fitness() > individuals[rhs].fitness() ||
+               (individuals[lhs].fitness() == individuals[rhs].fitness() && lhs < rhs);
+    });
+    _rank.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        _rank[_order[k]] = k;
+    }
+    _states.assign(n, UNCLEARED);
+
+    // From the fittest down, each survivor wins its niche and clears all but the next fittest capacity - 1
+    _niches = 0;
+    const auto fitter = [this] (const std::pair<size_t, double>& lhs, const std::pair<size_t, double>& rhs) {
+        return _rank[lhs.first] < _rank[rhs.first];
+    };
+    for (size_t k = 0; k < n; k++) {
+        const size_t winner = _order[k];
+        if (_states[winner] == CLEARED) {
+            continue;
+        }
+        if (_states[winner] == UNCLEARED) {
+            _niches++;
+        }
+        _grid.neighbours(winner, &_neighbours);
+        if (_config.capacity > 1) {
+            std::sort(_neighbours.begin(), _neighbours.end(), fitter);
+        }
+        size_t winners = 1;
+        for (const std::pair<size_t, double>& neighbour : _neighbours) {
+            const size_t j = neighbour.first;
+            if (_rank[j] <= k || _states[j] == CLEARED) {
+                continue;
+            }
+            if (winners < _config.capacity) {
+                winners++;
+                _states[j] = KEPT;
+            } else {
+                _states[j] = CLEARED;
+                (*fitness)[j] = least;
+            }
+        }
+    }
+}
+
+}  // namespace audiogene
@@ -30,6 +30,8 @@
 #include <future>
 #include <mutex>
 
+#include "trace.hpp"
+
 namespace audiogene {
 
 OSC::OSC():
@@ -38,7 +40,17 @@ OSC::OSC():
 OSC::OSC(const std::string& clientPort, const std::string& serverIp, const std::string& serverPort):
         _logger(spdlog::get("log")),
         client(clientPort),
-        scLangServer(serverIp, serverPort) {
+        scLangServer(serverIp, serverPort),
+        _deadline(std::chrono::steady_clock::time_point::max()),
+        _ended(false),
+        _messagesSent(Metrics::instance().counter("audiogene_osc_messages_sent_total", "OSC messages sent to SuperCollider")),
+        _sendFailures(Metrics::instance().counter("audiogene_osc_send_failures_total", "OSC messages that failed to send")),
+        _requests(Metrics::instance().counter("audiogene_osc_requests_total", "Conductor requests from SuperCollider")),
+        _requestTimeouts(Metrics::instance().counter("audiogene_osc_request_timeouts_total",
+                "Times we gave up waiting for a conductor request")),
+        _sendDuration(Metrics::instance().histogram("audiogene_osc_send_us", "Time to send an OSC message")),
+        _requestWait(Metrics::instance().histogram("audiogene_osc_request_wait_us",
+                "Time spent waiting for SuperCollider to request a conductor")) {
     if (!client.is_valid()) {
         _logger->warn("Invalid OSC Server: client");
         throw std::runtime_error("Failed to initialize OSC");
@@ -59,9 +71,30 @@ OSC::OSC(const std::string& clientPort, const std::string& serverIp, const std::
     client.add_method("/request", "s", [this] (lo_arg **argv, int len) {
             (void)argv;
             (void)len;
-        _logger->info("Request for new conductor");
-        std::unique_lock<std::mutex> l(_nextMutex);
-        _nextCV.notify_all();
+        request(0);
+    });
+
+    // SuperCollider can say how many seconds there are until the next bar
+    client.add_method("/request", "sf", [this] (lo_arg **argv, int len) {
+            (void)len;
+        request(argv[1]->f);
+    });
+
+    // SuperCollider says when the show is over
+    client.add_method("/end", "", [this] (lo_arg **argv, int len) {
+            (void)argv;
+            (void)len;
+        _logger->info("The show has ended");
+        endShow();
+    });
+
+    client.add_method("/metrics", "", [this] (lo_arg **argv, int len) {
+            (void)argv;
+            (void)len;
+        _logger->debug("Request for metrics");
+        if (!send("/metrics", Metrics::instance().prometheus())) {
+            _logger->warn("Failed to send metrics");
+        }
     });
 
     client.start();
@@ -79,37 +112,90 @@ OSC::OSC(const std::string& clientPort, const std::string& serverIp, const std::
     }
 }
 
- auto OSC::requestConductor() -> bool {
+ void OSC::request(const double secondsToBar) {
+    TRACE_THREAD_NAME("osc");
+    TRACE_SCOPE("conductor request");
+    _logger->info("Request for new conductor");
+    _requests.increment();
     std::unique_lock<std::mutex> l(_nextMutex);
+    if (secondsToBar > 0) {
+        _deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(secondsToBar * DEADLINE_SHARE));
+    } else {
+        _deadline = std::chrono::steady_clock::time_point::max();
+    }
+    _nextCV.notify_all();
+}
+
+auto OSC::deadline() -> std::chrono::steady_clock::time_point {
+    std::lock_guard<std::mutex> l(_nextMutex);
+    // A deadline belongs to one request; the next one brings its own
+    const auto deadline = _deadline;
+    _deadline = std::chrono::steady_clock::time_point::max();
+    return deadline;
+}
+
+auto OSC::requestConductor() -> bool {
+    TRACE_SCOPE("wait for conductor request");
+    ScopedTimer waitTimer(_requestWait);
+    std::unique_lock<std::mutex> l(_nextMutex);
+    if (_ended) {
+        return false;
+    }
     // TODO(grant) make this timer modifyable
     if (_nextCV.wait_for(l, std::chrono::seconds(REQUEST_WAIT_FOR_S)) != std::cv_status::timeout) {
         _logger->info("Didn't time out waiting for signal!");
     } else {
+        _requestTimeouts.increment();
         _logger->info("Timed out waiting for signal!");
+        // Nobody asked, so nobody is waiting on a deadline
+        _deadline = std::chrono::steady_clock::time_point::max();
+    }
+    return !_ended;
+}
+
+void OSC::endShow() {
+    {
+        std::lock_guard<std::mutex> l(_nextMutex);
+        _ended = true;
     }
-    return true;
+    _nextCV.notify_all();
 }
 
 void OSC::setConductor(const Individual& conductor) {
+    TRACE_SCOPE("osc emission");
     _logger->info("Setting new conductor {}", conductor);
-    const Instructions instructions = conductor.instructions();
-    for (const auto& kv : instructions) {
-        const AttributeName attributeName = kv.first;
-        const Instruction instruction = kv.second;
+    const Genes& genes = conductor.genes();
+    const Genome& genome = conductor.genome();
+    for (size_t i = 0; i < genes.size(); i++) {
+        const AttributeName& attributeName = genes[i].name;
         lo::Message m;
-        m.add_double(instruction.expression().current);
-        int r = scLangServer.send(std::string("/gene/"+attributeName).c_str(), m);
-        if (r == -1) {
+        m.add_double(genome[i]);
+        if (!send("/gene/" + attributeName, m)) {
             _logger->warn("Failed to send OSC message {}", attributeName);
         }
     }
     _logger->info("New conductor set", conductor);
 }
 
+auto OSC::send(const std::string& path, const lo::Message& message) -> bool {
+    bool sent;
+    {
+        ScopedTimer sendTimer(_sendDuration);
+        sent = scLangServer.send(path, message) != -1;
+    }
+    if (sent) {
+        _messagesSent.increment();
+    } else {
+        _sendFailures.increment();
+    }
+    return sent;
+}
+
 auto OSC::send(const std::string& path, const std::string& msg) -> bool {
     lo::Message m;
     m.add_string(msg);
-    return scLangServer.send(path, m) != -1;
+    return send(path, m);
 }
 
 }  // namespace audiogene
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "packedgenomes.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace audiogene {
+
+namespace {
+
+template<typename T>
+void furthest(const T* column, const size_t from, const size_t begin, const size_t end, const float scale,
+              float* out) noexcept {
+    const float x = column[from];
+    // Branch-free so it vectorises
+    for (size_t p = begin; p < end; p++) {
+        const float d = std::abs(static_cast<float>(column[p]) - x) * scale;
+        out[p] = out[p] > d ? out[p] : d;
+    }
+}
+
+// Double columns are only narrowed once scaled
+void furthest(const double* column, const size_t from, const size_t begin, const size_t end, const double scale,
+              float* out) noexcept {
+    const double x = column[from];
+    for (size_t p = begin; p < end; p++) {
+        const auto d = static_cast<float>(std::abs(column[p] - x) * scale);
+        out[p] = out[p] > d ? out[p] : d;
+    }
+}
+
+}  // namespace
+
+PackedGenomes::PackedGenomes():
+        _size(0) {
+    // empty constructor
+}
+
+auto PackedGenomes::size() const noexcept -> size_t {
+    return _size;
+}
+
+void PackedGenomes::pack(const Individuals& individuals, const std::vector<size_t>& order) {
+    _size = order.size();
+    _columns.clear();
+    _doubles.clear();
+    _floats.clear();
+    _wholes.clear();
+    _steps.clear();
+    if (_size == 0) {
+        return;
+    }
+    const Genes& genes = individuals.front().genes();
+    for (size_t g = 0; g < genes.size(); g++) {
+        const Gene& gene = genes[g];
+        const double range = gene.max - gene.min;
+        const double fraction = range > 0 ? 1 / range : 0;
+        switch (gene.encoding) {
+        case ExpressionEncoding::Int16:
+            _columns.push_back(Column{gene.encoding, _wholes.size(), fraction, gene.min, gene.max});
+            for (const size_t i : order) {
+                _wholes.push_back(static_cast<int16_t>(quantize(gene, individuals[i].genome()[g])));
+            }
+            break;
+        case ExpressionEncoding::Fixed16:
+            _columns.push_back(Column{gene.encoding, _steps.size(), 1 / FIXED16_STEPS, gene.min, gene.max});
+            for (const size_t i : order) {
+                const double value = quantize(gene, individuals[i].genome()[g]);
+                const double step = std::round((value - gene.min) * fraction * FIXED16_STEPS);
+                _steps.push_back(static_cast<uint16_t>(std::min(std::max(step, 0.0), FIXED16_STEPS)));
+            }
+            break;
+        case ExpressionEncoding::Float32:
+            _columns.push_back(Column{gene.encoding, _floats.size(), fraction, gene.min, gene.max});
+            for (const size_t i : order) {
+                _floats.push_back(static_cast<float>(quantize(gene, individuals[i].genome()[g])));
+            }
+            break;
+        default:
+            _columns.push_back(Column{gene.encoding, _doubles.size(), fraction, gene.min, gene.max});
+            for (const size_t i : order) {
+                _doubles.push_back(individuals[i].genome()[g]);
+            }
+            break;
+        }
+    }
+}
+
+auto PackedGenomes::value(const size_t p, const size_t g) const noexcept -> double {
+    const Column& column = _columns[g];
+    switch (column.encoding) {
+    case ExpressionEncoding::Int16:
+        return _wholes[column.offset + p];
+    case ExpressionEncoding::Fixed16:
+        return fixed16Value(column.min, column.max, _steps[column.offset + p]);
+    case ExpressionEncoding::Float32:
+        return _floats[column.offset + p];
+    default:
+        return _doubles[column.offset + p];
+    }
+}
+
+void PackedGenomes::distances(const size_t from, const size_t begin, const size_t end, float* out) const noexcept {
+    std::fill(out + begin, out + end, 0.0F);
+    for (const Column& column : _columns) {
+        switch (column.encoding) {
+        case ExpressionEncoding::Int16:
+            furthest(&_wholes[column.offset], from, begin, end, static_cast<float>(column.scale), out);
+            break;
+        case ExpressionEncoding::Fixed16:
+            furthest(&_steps[column.offset], from, begin, end, static_cast<float>(column.scale), out);
+            break;
+        case ExpressionEncoding::Float32:
+            furthest(&_floats[column.offset], from, begin, end, static_cast<float>(column.scale), out);
+            break;
+        default:
+            furthest(&_doubles[column.offset], from, begin, end, column.scale, out);
+            break;
+        }
+    }
+}
+
+}  // namespace audiogene
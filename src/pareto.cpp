@@ -0,0 +1,194 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "pareto.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace audiogene {
+
+auto conductorPolicy(const std::string& name) -> ConductorPolicy {
+    if (name == "sum") {
+        return ConductorPolicy::Sum;
+    } else if (name == "balanced") {
+        return ConductorPolicy::Balanced;
+    } else if (name == "closest") {
+        return ConductorPolicy::Closest;
+    }
+    throw std::runtime_error("Unknown conductor policy " + name);
+}
+
+ParetoRanking::ParetoRanking():
+        _m(0),
+        _objectives(nullptr),
+        _frontCount(0) {
+    // empty constructor
+}
+
+auto ParetoRanking::dominates(const size_t a, const size_t b) const noexcept -> bool {
+    const double* x = _objectives + a * _m;
+    const double* y = _objectives + b * _m;
+    bool better = false;
+    for (size_t i = 0; i < _m; i++) {
+        if (x[i] < y[i]) {
+            return false;
+        }
+        better = better || x[i] > y[i];
+    }
+    return better;
+}
+
+void ParetoRanking::rank(const std::vector<double>& objectives, const size_t m, const size_t needed) {
+    _m = m;
+    _objectives = objectives.data();
+    const size_t n = m > 0 ? objectives.size() / m : 0;
+
+    // Lexicographically descending, so nothing can be dominated by a point after it
+    _lexicographic.resize(n);
+    std::iota(_lexicographic.begin(), _lexicographic.end(), 0);
+    std::sort(_lexicographic.begin(), _lexicographic.end(), [this] (const size_t a, const size_t b) {
+        const double* x = _objectives + a * _m;
+        const double* y = _objectives + b * _m;
+        return std::lexicographical_compare(y, y + _m, x, x + _m);
+    });
+
+    for (size_t f = 0; f < _frontCount; f++) {
+        _fronts[f].clear();
+    }
+    _frontCount = 0;
+    _unranked.clear();
+    size_t ranked = 0;
+
+    for (const size_t point : _lexicographic) {
+        size_t f = 0;
+        for (; f < _frontCount; f++) {
+            const std::vector<size_t>& front = _fronts[f];
+            // The latest members are the likeliest to dominate
+            const auto dominated = std::any_of(front.rbegin(), front.rend(), [this, point] (const size_t member) {
+                return dominates(member, point);
+            });
+            if (!dominated) {
+                break;
+            }
+        }
+        if (f == _frontCount) {
+            if (ranked >= needed) {
+                _unranked.push_back(point);
+                continue;
+            }
+            if (_fronts.size() == _frontCount) {
+                _fronts.emplace_back();
+            }
+            _frontCount++;
+        }
+        _fronts[f].push_back(point);
+        ranked++;
+    }
+
+    _crowding.assign(n, 0.0);
+    _order.clear();
+    for (size_t f = 0; f < _frontCount; f++) {
+        std::vector<size_t>& front = _fronts[f];
+        crowd(front);
+        std::stable_sort(front.begin(), front.end(), [this] (const size_t a, const size_t b) {
+            return _crowding[a] > _crowding[b];
+        });
+        _order.insert(_order.end(), front.begin(), front.end());
+    }
+    _order.insert(_order.end(), _unranked.begin(), _unranked.end());
+}
+
+void ParetoRanking::crowd(const std::vector<size_t>& front) {
+    if (front.size() <= 2) {
+        for (const size_t point : front) {
+            _crowding[point] = std::numeric_limits<double>::infinity();
+        }
+        return;
+    }
+
+    _scratch.assign(front.begin(), front.end());
+    for (size_t objective = 0; objective < _m; objective++) {
+        std::sort(_scratch.begin(), _scratch.end(), [this, objective] (const size_t a, const size_t b) {
+            return _objectives[a * _m + objective] < _objectives[b * _m + objective];
+        });
+        const double low = _objectives[_scratch.front() * _m + objective];
+        const double high = _objectives[_scratch.back() * _m + objective];
+        _crowding[_scratch.front()] = std::numeric_limits<double>::infinity();
+        _crowding[_scratch.back()] = std::numeric_limits<double>::infinity();
+        if (high <= low) {
+            continue;
+        }
+        for (size_t i = 1; i + 1 < _scratch.size(); i++) {
+            const double gap = _objectives[_scratch[i + 1] * _m + objective] - _objectives[_scratch[i - 1] * _m + objective];
+            _crowding[_scratch[i]] += gap / (high - low);
+        }
+    }
+}
+
+auto ParetoRanking::order() const noexcept -> const std::vector<size_t>& {
+    return _order;
+}
+
+auto ParetoRanking::front() const noexcept -> const std::vector<size_t>& {
+    return _fronts.front();
+}
+
+auto ParetoRanking::crowding(const size_t i) const noexcept -> double {
+    return _crowding[i];
+}
+
+auto ParetoRanking::choose(const ConductorPolicy policy) const -> size_t {
+    if (_frontCount == 0) {
+        throw std::runtime_error("Nothing has been ranked");
+    }
+
+    const auto score = [this, policy] (const size_t point) {
+        const double* x = _objectives + point * _m;
+        switch (policy) {
+        case ConductorPolicy::Balanced:
+            return *std::min_element(x, x + _m);
+        case ConductorPolicy::Closest: {
+            double distance = 0;
+            for (size_t i = 0; i < _m; i++) {
+                distance += (1 - x[i]) * (1 - x[i]);
+            }
+            return -distance;
+        }
+        case ConductorPolicy::Sum:
+        default:
+            return std::accumulate(x, x + _m, 0.0);
+        }
+    };
+
+    const std::vector<size_t>& first = front();
+    return *std::max_element(first.begin(), first.end(), [&score] (const size_t a, const size_t b) {
+        return score(a) < score(b);
+    });
+}
+
+}  // namespace audiogene
@@ -25,6 +25,7 @@
 #include <spdlog/spdlog.h>
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
 #include <cstdlib>
 #include <functional>
 #include <future>
@@ -36,23 +37,78 @@
 #include <thread>
 #include <vector>
 
+#include "archipelago.hpp"
 #include "audience.hpp"
+#include "cmaes.hpp"
+#include "elitearchive.hpp"
 #include "individual.hpp"
 #include "midi.hpp"
 #include "musician.hpp"
+#include "niching.hpp"
+#include "optimizer.hpp"
+#include "pareto.hpp"
+#include "reactions.hpp"
+#include "schema.hpp"
 #include "osc.hpp"
 #include "population.hpp"
+#include "selection.hpp"
+#include "showarchive.hpp"
 #include "spi.hpp"
+#include "steadystate.hpp"
+#include "surrogate.hpp"
+#include "trace.hpp"
 
 namespace audiogene {
 
-Performance::Performance(const YAML::Node& config):
+Performance::Performance(const YAML::Node& config, const bool resume):
         _logger(spdlog::get("log")),
-        _config(config) {
+        _config(config),
+        _resume(resume),
+        _generationsPerRequest(Metrics::instance().histogram("audiogene_generations_per_request",
+                "Generations finished between conductor requests")),
+        _convergedRequests(Metrics::instance().counter("audiogene_converged_requests_total",
+                "Requests that stopped evolving early because the population had converged")) {
+    exportMetrics();
+    exportTrace();
     seatAudience();
     assembleMusicians();
 }
 
+void Performance::exportMetrics() {
+    YAML::Node metricsNode = _config["metrics"];
+    if (!metricsNode) {
+        _logger->info("Metrics export disabled");
+        return;
+    }
+
+    std::string path;
+    int intervalS;
+    try {
+        path = metricsNode["file"].as<std::string>();
+        intervalS = metricsNode["intervalS"] ? metricsNode["intervalS"].as<int>() : METRICS_INTERVAL_S;
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Metrics misconfigured");
+    }
+    _metricsExporter = std::make_unique<MetricsExporter>(path, std::chrono::seconds(intervalS));
+}
+
+void Performance::exportTrace() {
+    YAML::Node traceNode = _config["trace"];
+    if (!traceNode) {
+        return;
+    }
+
+    std::string path;
+    int intervalS;
+    try {
+        path = traceNode["file"].as<std::string>();
+        intervalS = traceNode["intervalS"] ? traceNode["intervalS"].as<int>() : TRACE_INTERVAL_S;
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Trace misconfigured");
+    }
+    _traceExporter = std::make_unique<trace::Exporter>(path, std::chrono::seconds(intervalS));
+}
+
 void Performance::seatAudience() {
     audiogene::Audience* audienceSource;
 
@@ -115,8 +171,284 @@ void Performance::assembleMusicians() {
     // musician->send("/notify", "1");
 }
 
+auto Performance::formConductors(const Individual& seed) -> std::unique_ptr<Optimizer> {
+    // Only sharing and clearing pack genomes; anywhere else a coarse encoding does nothing
+    const auto warnUnpacked = [this, &seed] () {
+        for (const Gene& gene : seed.genes()) {
+            if (gene.encoding == ExpressionEncoding::Float32 || gene.encoding == ExpressionEncoding::Fixed16) {
+                _logger->warn("Gene {} has a packed encoding, but only sharing and clearing use it", gene.name);
+            }
+        }
+    };
+    std::string optimizer;
+    try {
+        optimizer = _config["optimizer"].as<std::string>("genetic");
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Optimizer misconfigured");
+    }
+    if (optimizer == "cmaes") {
+        size_t lambda = 0;
+        double sigma = CMAES_SIGMA;
+        try {
+            YAML::Node cmaesNode = _config["cmaes"];
+            if (cmaesNode) {
+                lambda = cmaesNode["lambda"].as<size_t>(0);
+                sigma = cmaesNode["sigma"].as<double>(CMAES_SIGMA);
+            }
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("CMA-ES misconfigured");
+        }
+        warnUnpacked();
+        _logger->info("Evolving with CMA-ES");
+        return std::make_unique<CMAES>(seed, lambda, sigma);
+    } else if (optimizer != "genetic" && optimizer != "steadyState") {
+        throw std::runtime_error("Unknown optimizer " + optimizer);
+    }
+
+    PopulationConfig population(0, 0, 0);
+    try {
+        population.size = _config["populationSize"].as<size_t>();
+        population.topN = _config["keepFittest"].as<size_t>();
+        population.mutation.probability = _config["mutationProb"].as<double>();
+        YAML::Node mutationNode = _config["mutation"];
+        if (mutationNode) {
+            population.mutation.selfAdaptive = mutationNode["selfAdaptive"].as<bool>(false);
+            population.mutation.oneFifthRule = mutationNode["oneFifthRule"].as<bool>(false);
+        }
+        population.spatialIndex = _config["spatialIndex"].as<bool>(false);
+        population.memoize = _config["memoize"].as<bool>(false);
+        population.deduplicate = _config["deduplicate"].as<bool>(false);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Genetics misconfigured");
+    }
+
+    SelectionConfig& selection = population.selection;
+    YAML::Node selectionNode = _config["selection"];
+    if (selectionNode) {
+        try {
+            selection.strategy = selectionStrategy(selectionNode["strategy"].as<std::string>("truncation"));
+            selection.tournamentSize = selectionNode["tournamentSize"].as<size_t>(TOURNAMENT_SIZE);
+            selection.rankPressure = selectionNode["rankPressure"].as<double>(RANK_PRESSURE);
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("Selection misconfigured");
+        }
+    }
+
+    NichingConfig& niching = population.niching;
+    YAML::Node nichingNode = _config["niching"];
+    if (nichingNode) {
+        try {
+            niching.method = nichingMethod(nichingNode["method"].as<std::string>("none"));
+            niching.radius = nichingNode["radius"].as<double>(NICHE_RADIUS);
+            niching.alpha = nichingNode["alpha"].as<double>(SHARING_ALPHA);
+            niching.capacity = nichingNode["capacity"].as<size_t>(CLEARING_CAPACITY);
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("Niching misconfigured");
+        }
+    }
+    if (niching.method != NichingMethod::Sharing && niching.method != NichingMethod::Clearing) {
+        warnUnpacked();
+    }
+
+    SizingConfig& sizing = population.sizing;
+    YAML::Node adaptiveSizeNode = _config["adaptiveSize"];
+    if (adaptiveSizeNode) {
+        try {
+            sizing.enabled = adaptiveSizeNode["enabled"].as<bool>(false);
+            sizing.minSize = adaptiveSizeNode["min"].as<size_t>(population.topN);
+            sizing.maxSize = adaptiveSizeNode["max"].as<size_t>(population.size);
+            sizing.factor = adaptiveSizeNode["factor"].as<double>(SIZING_FACTOR);
+            sizing.shrinkDiversity = adaptiveSizeNode["shrinkBelowDiversity"].as<double>(SIZING_SHRINK_DIVERSITY);
+            sizing.patience = adaptiveSizeNode["patience"].as<uint32_t>(SIZING_PATIENCE);
+            sizing.growShift = adaptiveSizeNode["growAboveShift"].as<double>(SIZING_GROW_SHIFT);
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("Adaptive size misconfigured");
+        }
+    }
+
+    ParetoConfig& pareto = population.pareto;
+    YAML::Node multiObjectiveNode = _config["multiObjective"];
+    if (multiObjectiveNode) {
+        try {
+            pareto.enabled = multiObjectiveNode["enabled"].as<bool>(false);
+            pareto.policy = conductorPolicy(multiObjectiveNode["policy"].as<std::string>("balanced"));
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("Multi-objective ranking misconfigured");
+        }
+    }
+
+    if (optimizer == "steadyState") {
+        std::chrono::microseconds pause(0);
+        try {
+            YAML::Node steadyStateNode = _config["steadyState"];
+            if (steadyStateNode) {
+                pause = std::chrono::microseconds(steadyStateNode["pauseMicroseconds"].as<int64_t>(0));
+            }
+        } catch (const YAML::Exception& e) {
+            throw std::runtime_error("Steady state misconfigured");
+        }
+        _logger->info("Evolving one child at a time");
+        return std::make_unique<SteadyState>(population, seed, pause);
+    }
+
+    YAML::Node islandsNode = _config["islands"];
+    if (!islandsNode || islandsNode["count"].as<int>(1) < 2) {
+        return std::make_unique<Population>(population, seed);
+    }
+
+    size_t islands;
+    uint32_t migrationInterval;
+    size_t migrants;
+    MigrationTopology topology;
+    try {
+        islands = islandsNode["count"].as<int>();
+        migrationInterval = islandsNode["migrationInterval"].as<int>(MIGRATION_INTERVAL);
+        migrants = islandsNode["migrants"].as<int>(MIGRANTS);
+        topology = migrationTopology(islandsNode["topology"].as<std::string>("ring"));
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Islands misconfigured");
+    }
+    _logger->info("Evolving on {} islands", islands);
+    return std::make_unique<Archipelago>(islands, population, seed, migrationInterval, migrants, topology);
+}
+
+auto Performance::formArchive(const Individual& seed) -> std::unique_ptr<EliteArchive> {
+    ArchiveConfig archive;
+    YAML::Node archiveNode = _config["archive"];
+    if (!archiveNode) {
+        return nullptr;
+    }
+    try {
+        archive.enabled = archiveNode["enabled"].as<bool>(false);
+        archive.descriptors = archiveNode["descriptors"].as<std::vector<std::string>>();
+        archive.bins = archiveNode["bins"].as<size_t>(ARCHIVE_BINS);
+        archive.offered = archiveNode["offered"].as<size_t>(ARCHIVE_OFFERED);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Archive misconfigured");
+    }
+    if (!archive.enabled) {
+        return nullptr;
+    }
+    return std::make_unique<EliteArchive>(archive, seed);
+}
+
+auto Performance::openShowArchive(const Individual& seed) -> std::unique_ptr<ShowArchive> {
+    ShowArchiveConfig showArchive;
+    YAML::Node showArchiveNode = _config["showArchive"];
+    if (!showArchiveNode) {
+        return nullptr;
+    }
+    try {
+        showArchive.enabled = showArchiveNode["enabled"].as<bool>(false);
+        showArchive.file = showArchiveNode["file"].as<std::string>();
+        showArchive.capacity = showArchiveNode["capacity"].as<size_t>(SHOW_ARCHIVE_CAPACITY);
+        showArchive.everyGenerations = showArchiveNode["everyGenerations"].as<uint32_t>(SHOW_ARCHIVE_EVERY_GENERATIONS);
+        showArchive.elites = showArchiveNode["warmElites"].as<size_t>(WARM_START_ELITES);
+        showArchive.samples = showArchiveNode["warmSamples"].as<size_t>(WARM_START_SAMPLES);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Show archive misconfigured");
+    }
+    if (!showArchive.enabled) {
+        return nullptr;
+    }
+    return std::make_unique<ShowArchive>(showArchive, seed);
+}
+
+auto Performance::formSurrogate(const Individual& seed) -> std::unique_ptr<Surrogate> {
+    SurrogateConfig surrogate;
+    YAML::Node surrogateNode = _config["surrogate"];
+    if (!surrogateNode) {
+        return nullptr;
+    }
+    try {
+        surrogate.enabled = surrogateNode["enabled"].as<bool>(false);
+        surrogate.forgetting = surrogateNode["forgetting"].as<double>(SURROGATE_FORGETTING);
+        surrogate.weight = surrogateNode["weight"].as<double>(SURROGATE_WEIGHT);
+        surrogate.candidates = surrogateNode["candidates"].as<size_t>(SURROGATE_CANDIDATES);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Surrogate misconfigured");
+    }
+    if (!surrogate.enabled) {
+        return nullptr;
+    }
+    return std::make_unique<Surrogate>(surrogate, seed);
+}
+
+auto Performance::formReactions() -> std::shared_ptr<Reactions> {
+    ReactionConfig reactions;
+    YAML::Node reactionsNode = _config["reactions"];
+    if (!reactionsNode) {
+        return nullptr;
+    }
+    try {
+        reactions.enabled = reactionsNode["enabled"].as<bool>(false);
+        reactions.slots = reactionsNode["slots"].as<size_t>(REACTION_SLOTS);
+        reactions.weight = reactionsNode["weight"].as<double>(REACTION_WEIGHT);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Reactions misconfigured");
+    }
+    if (!reactions.enabled) {
+        return nullptr;
+    }
+    _logger->info("Blending audience reactions into fitness with weight {}", reactions.weight);
+    return std::make_shared<Reactions>(reactions);
+}
+
+auto Performance::generationBudget() -> GenerationBudget {
+    GenerationBudget budget;
+    YAML::Node generationsNode = _config["generations"];
+    if (!generationsNode) {
+        return budget;
+    }
+    try {
+        budget.perRequest = generationsNode["perRequest"].as<uint32_t>(1);
+        budget.time = std::chrono::milliseconds(generationsNode["budgetMilliseconds"].as<int64_t>(0));
+        budget.minImprovement = generationsNode["minImprovement"].as<double>(0);
+        budget.minDiversity = generationsNode["minDiversity"].as<double>(0);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Generations misconfigured");
+    }
+    if (budget.perRequest < 1) {
+        throw std::runtime_error("Need at least one generation per request");
+    }
+    return budget;
+}
+
+auto Performance::evolve(Optimizer* conductors, const GenerationBudget& budget,
+                         const std::chrono::steady_clock::time_point deadline) -> uint32_t {
+    TRACE_SCOPE("evolve");
+    std::chrono::steady_clock::time_point end = deadline;
+    if (budget.time.count() > 0) {
+        end = std::min(end, std::chrono::steady_clock::now() + budget.time);
+    }
+
+    uint32_t generations = 0;
+    double fitness = conductors->fittest().fitness();
+    while (generations < budget.perRequest) {
+        // An unfinished generation carries on next request. So does one still without preferences,
+        // rather than waiting for them again in each generation of this one
+        if (!conductors->advance(end)) {
+            break;
+        }
+        generations++;
+        const double fitter = conductors->fittest().fitness();
+        // Diversity costs a pass over the population, so only look when progress has stalled
+        if (fitter - fitness < budget.minImprovement && conductors->diversity() < budget.minDiversity) {
+            _convergedRequests.increment();
+            break;
+        }
+        fitness = fitter;
+        if (std::chrono::steady_clock::now() >= end) {
+            break;
+        }
+    }
+    _generationsPerRequest.record(generations);
+    return generations;
+}
+
 auto Performance::play() -> std::future<void> {
     return std::async(std::launch::async, [this] () {
+        TRACE_THREAD_NAME("generation");
         // The input is from an audience
         // So we want an audience to guide the presentation
         // An audience gives feedback on various criteria
@@ -135,39 +467,136 @@ auto Performance::play() -> std::future<void> {
         audience->initializePreferences(attributes);
 
         // Generate potential Conductors
-        double mutationProbability;
-        size_t populationSize;
-        size_t topN;
+        Individual seed(attributes);
+        if (schema::COMPILED && !schema::matches(seed.genes())) {
+            _logger->warn("The genes configured aren't the ones compiled in; using the dynamic path");
+        }
+        std::unique_ptr<Optimizer> conductors = formConductors(seed);
+        std::unique_ptr<EliteArchive> archive = formArchive(seed);
+        std::unique_ptr<ShowArchive> showArchive = openShowArchive(seed);
+        std::unique_ptr<Surrogate> surrogate = formSurrogate(seed);
+
+        std::string checkpointPath;
+        int checkpointEvery = CHECKPOINT_EVERY_GENERATIONS;
         try {
-            mutationProbability = _config["mutationProb"].as<double>();
-            populationSize = _config["populationSize"].as<int>();
-            topN = _config["keepFittest"].as<int>();
+            YAML::Node checkpointNode = _config["checkpoint"];
+            if (checkpointNode) {
+                checkpointPath = checkpointNode["file"].as<std::string>();
+                if (checkpointNode["everyGenerations"]) {
+                    checkpointEvery = checkpointNode["everyGenerations"].as<int>();
+                }
+            }
         } catch (const YAML::Exception& e) {
-            throw std::runtime_error("Genetics misconfigured");
+            throw std::runtime_error("Checkpoint misconfigured");
+        }
+
+        if (_resume) {
+            if (checkpointPath.empty()) {
+                throw std::runtime_error("Can't resume without a checkpoint file configured");
+            }
+            _logger->info("Resuming from {}", checkpointPath);
+            const Checkpoint checkpoint = readCheckpoint(checkpointPath);
+            conductors->restore(checkpoint);
+            audience->restorePreferences(checkpoint.preferences);
+        } else if (showArchive) {
+            // Start from what suited similar audiences before, rather than from copies of the seed
+            const Preferences preferences = audience->snapshot();
+            conductors->warmStart(showArchive->warmStart(preferences), preferences);
+        }
+        _logger->info("Initial population: {}", *conductors);
+
+        std::unique_ptr<Checkpointer> checkpointer;
+        if (!checkpointPath.empty()) {
+            checkpointer = std::make_unique<Checkpointer>(checkpointPath);
+        }
+
+        // Whatever the audience does during a bar counts for or against whoever is conducting it
+        std::shared_ptr<Reactions> reactions = formReactions();
+        if (reactions) {
+            audience->attributeReactions(reactions);
+            conductors->setReactions(reactions);
         }
-        Individual seed(attributes);
-        Population conductors(populationSize, seed, mutationProbability, topN);
-        _logger->info("Initial population: {}", conductors);
 
         // Connect audience to conductor population
         // The conductors should keep asking for the reaction of the audience
-        conductors.setPreferences(preferencesQueue);
+        conductors->setPreferences(preferencesQueue);
 
         _logger->flush();
 
+        const GenerationBudget budget = generationBudget();
+        uint32_t checkpointed = conductors->generation();
+        uint32_t archived = conductors->generation();
+        // The conductor last played and the preferences it was played to, for the surrogate to learn from
+        std::unique_ptr<Individual> played;
+        Preferences playedTo;
+
         // Make new generations
         uint8_t i = 0;
         while (musician->requestConductor()) {
             // Get the latest preferences from the audience
-            audience->gatherPreferences();
+            const Preferences gathered = audience->gatherPreferences();
+            if (surrogate && played) {
+                surrogate->observe(*played, playedTo, gathered);
+            }
             std::cout << "loop " << +i++ << std::endl;
             _logger->info("Getting new generation");
-            conductors.nextGeneration();
-            _logger->info("New population: {}", conductors);
-            musician->setConductor(conductors.fittest());
+            // Send whoever is fittest by the deadline
+            const uint32_t generations = evolve(conductors.get(), budget, musician->deadline());
+            Individual conductor = conductors->fittest();
+            if (surrogate) {
+                // Fitness says who matches the preferences; the surrogate, who the audience will stay with
+                TRACE_SCOPE("surrogate");
+                if (surrogate->screen(conductors->sample(surrogate->candidates()), &conductor)) {
+                    _logger->debug("Surrogate picked the conductor, error is {}", surrogate->error());
+                }
+            }
+            if (archive) {
+                // A cell of the archive may already suit where the audience has jumped to
+                TRACE_SCOPE("archive");
+                const Preferences preferences = audience->snapshot();
+                if (generations > 0) {
+                    archive->offer(conductors->sample(archive->offered()), preferences);
+                }
+                if (archive->challenge(preferences, &conductor)) {
+                    _logger->info("Conducting with an elite from the archive");
+                }
+            }
+            musician->setConductor(conductor);
+            if (reactions) {
+                reactions->play(conductor.id());
+            }
+            if (surrogate) {
+                playedTo = audience->snapshot();
+                played = std::make_unique<Individual>(conductor);
+            }
+            if (generations > 0) {
+                TRACE_SCOPE("logging");
+                _logger->info("Ran {} generations, diversity is {}", generations, conductors->diversity());
+                _logger->info("New population: {}", *conductors);
+            } else {
+                _logger->info("Generation {} unfinished by the deadline", conductors->generation());
+            }
+            if (checkpointer && conductors->generation() - checkpointed >= static_cast<uint32_t>(checkpointEvery)) {
+                checkpointer->save(conductors->checkpoint());
+                checkpointed = conductors->generation();
+            }
+            if (showArchive && conductors->generation() - archived >= showArchive->everyGenerations()) {
+                TRACE_SCOPE("show archive");
+                showArchive->record(conductors->fittest(), audience->snapshot());
+                archived = conductors->generation();
+            }
             _logger->flush();
         }
+        _logger->info("The show is over after generation {}", conductors->generation());
+        if (showArchive) {
+            // Keep where it ended for the next one
+            showArchive->record(conductors->fittest(), audience->snapshot());
+        }
     });
 }
 
+void Performance::end() {
+    musician->endShow();
+}
+
 }  // namespace audiogene
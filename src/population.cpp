@@ -25,94 +25,850 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <memory>
-#include <thread>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 #include "math.hpp"
+#include "metrics.hpp"
+#include "schema.hpp"
+#include "trace.hpp"
 
 namespace audiogene {
 
-Population::Population(const uint8_t n,
-                       const Individual& seed,
-                       const double mutationProbability,
-                       const size_t topN):
+namespace {
+
+/*! Islands label their gauges, so each island's values show up separately */
+auto gaugeName(const std::string& name, const std::string& island) -> std::string {
+    return island.empty() ? name : labelled(name, "island", island);
+}
+
+}  // namespace
+
+Population::Population(const PopulationConfig& config, const Individual& seed):
         _logger(spdlog::get("log")),
-        _genetics(mutationProbability),
-        _size(n),
+        _genetics(config.mutation),
+        _size(config.size),
+        _sizing(config.sizing),
+        _calm(0),
         _generation(0),
-        _topN(topN) {
-    _logger->info("Making {} individuals from {}", n, seed);
+        _breeding(false),
+        _firstChild(0),
+        _nextChild(0),
+        _partialFittest(0),
+        _improved(0),
+        _generationTime(0),
+        _topN(config.topN),
+        _selection(Selection::create(config.selection, config.topN)),
+        _pareto(config.pareto),
+        _niching(config.niching),
+        _spatialIndex(config.spatialIndex),
+        _memoize(config.memoize),
+        _deduplicate(config.deduplicate),
+        _staticSchema(schema::matches(seed.genes())),
+        _conductor(0),
+        _haveIncoming(false),
+        _shift(0),
+        _haveIdeal(false),
+        _generationDuration(Metrics::instance().histogram("audiogene_generation_duration_us",
+                "Time to produce a new generation, including waiting for preferences")),
+        _preferencesWait(Metrics::instance().histogram("audiogene_preferences_wait_us",
+                "Time a generation waited for the audience preferences")),
+        _preferencesTimeouts(Metrics::instance().counter("audiogene_preferences_timeouts_total",
+                "Generations that gave up waiting for audience preferences")),
+        _preferencesReceived(Metrics::instance().counter("audiogene_preferences_dequeued_total",
+                "Preference updates taken from the audience queue")),
+        _preferencesQueueDepth(Metrics::instance().gauge(gaugeName("audiogene_preferences_queue_depth", config.island),
+                "Approximate number of preference updates waiting to be read")),
+        _generationGauge(Metrics::instance().gauge(gaugeName("audiogene_generation", config.island),
+                "Current generation")),
+        _bestFitness(Metrics::instance().gauge(gaugeName("audiogene_fitness_best", config.island),
+                "Fitness of the fittest individual")),
+        _meanFitness(Metrics::instance().gauge(gaugeName("audiogene_fitness_mean", config.island),
+                "Mean fitness of the population")),
+        _worstFitness(Metrics::instance().gauge(gaugeName("audiogene_fitness_worst", config.island),
+                "Fitness of the least fit individual")),
+        _successRate(Metrics::instance().gauge(gaugeName("audiogene_mutation_success_rate", config.island),
+                "Fraction of children fitter than their fitter parent")),
+        _stepScale(Metrics::instance().gauge(gaugeName("audiogene_mutation_step_scale", config.island),
+                "Multiplier the 1/5th success rule applies to every mutation step")),
+        _frontSize(Metrics::instance().gauge(gaugeName("audiogene_pareto_front_size", config.island),
+                "Individuals no other individual beats on every gene")),
+        _memoHits(Metrics::instance().counter("audiogene_fitness_memo_hits_total",
+                "Genomes whose scores were remembered from an identical genome")),
+        _memoMisses(Metrics::instance().counter("audiogene_fitness_memo_misses_total",
+                "Genomes scored because no identical genome was remembered")),
+        _duplicates(Metrics::instance().counter("audiogene_duplicate_children_total",
+                "Children bred identical to someone already in their generation")),
+        _duplicatesKept(Metrics::instance().counter("audiogene_duplicate_children_kept_total",
+                "Children still a duplicate after every retry")),
+        _generationsDeferred(Metrics::instance().counter("audiogene_generations_deferred_total",
+                "Times a generation hit its deadline and was finished on a later call")),
+        _sizeGauge(Metrics::instance().gauge(gaugeName("audiogene_population_size", config.island),
+                "Individuals in the population")),
+        _grown(Metrics::instance().counter("audiogene_population_grown_total",
+                "Times the population grew because the audience moved")),
+        _shrunk(Metrics::instance().counter("audiogene_population_shrunk_total",
+                "Times the population shrank because it had converged")),
+        _diversity(Metrics::instance().gauge(gaugeName("audiogene_diversity", config.island),
+                "Each gene's standard deviation as a fraction of its range, averaged over genes")),
+        _niches(Metrics::instance().gauge(gaugeName("audiogene_niches", config.island),
+                "Niches found by fitness sharing or clearing")),
+        _parentsKept(Metrics::instance().counter("audiogene_crowding_parents_kept_total",
+                "Parents that kept their place in the next generation over a less fit child")) {
+    if (_topN < 2 || _topN > _size) {
+        throw std::runtime_error("Need at least two and at most all individuals to breed from");
+    }
+    if (_sizing.enabled && (_sizing.minSize < _topN || _size < _sizing.minSize || _size > _sizing.maxSize ||
+                            _sizing.factor <= 1)) {
+        throw std::runtime_error("Adaptive sizing needs keepFittest <= min <= populationSize <= max and a factor over 1");
+    }
+    if (_pareto.enabled && _niching.method() != NichingMethod::None) {
+        throw std::runtime_error("Niching can't be combined with multi-objective ranking");
+    }
+    _logger->info("Making {} individuals from {}", _size, seed);
+    if (_staticSchema) {
+        _logger->info("Scoring with the compiled gene schema");
+    }
     initializePopulation(seed);
+    indexPopulation();
 }
 
 void Population::initializePopulation(const Individual& seed) {
-    std::generate_n(std::back_inserter(_individuals), _size, [&seed] () -> Individual {
-        return Individual(Genetics::create(seed.instructions()));
-    });
+    Genome genome(seed.genome());
+    Genetics::create(seed.genes(), &genome);
+    const Individual individual(std::make_shared<const Genes>(seed.genes()), genome);
+    _individuals.assign(_size, individual);
+    _offspring.assign(_size, individual);
+    copyFitness();
+    _ideal.assign(genome.size(), 0);
+    _changedGenes.reserve(genome.size());
+    reserveTables();
+    _sizeGauge.set(_size);
+
+    // Fitness falls linearly with each gene's distance from the ideal; measure
+    // the slope rather than assume how similarity normalizes
+    for (const Gene& gene : seed.genes()) {
+        _distanceWeights.push_back(std::abs(_math.similarity(gene.min, gene.min + 1, gene.min, gene.max) -
+                                            _math.similarity(gene.min, gene.min, gene.min, gene.max)));
+    }
+}
+
+void Population::reserveTables() {
+    if (_memoize) {
+        _memo.reserve(_size * MEMO_PER_INDIVIDUAL);
+        _memoScores.resize(_memo.capacity() * _ideal.size());
+    }
+    if (_deduplicate) {
+        _present.reserve(_size);
+    }
+}
+
+void Population::updateIdeal(const Preferences& preferences) {
+    const Genes& genes = _individuals.front().genes();
+    _changedGenes.clear();
+    for (size_t i = 0; i < genes.size(); i++) {
+        const double ideal = preferences.at(genes[i].name).current;
+        if (ideal != _ideal[i]) {
+            if (_haveIdeal) {
+                _shift = std::max(_shift, std::abs(ideal - _ideal[i]) / (genes[i].max - genes[i].min));
+            }
+            _ideal[i] = ideal;
+            _changedGenes.push_back(i);
+        }
+    }
+    if (!_changedGenes.empty()) {
+        // Remembered scores were against the old preferences
+        _memo.clear();
+    }
+    _haveIdeal = true;
+}
+
+void Population::scoreGenome(const Genes& genes, const Genome& genome, std::vector<double>* scores) {
+    const size_t geneCount = genome.size();
+    uint64_t hash = 0;
+    if (_memoize) {
+        hash = hashGenome(genome);
+        const uint32_t* row = _memo.find(hash);
+        if (row != nullptr) {
+            _memoHits.increment();
+            const auto remembered = _memoScores.begin() + *row * geneCount;
+            std::copy(remembered, remembered + geneCount, scores->begin());
+            return;
+        }
+        _memoMisses.increment();
+    }
+
+    if (_staticSchema) {
+        schema::similarity(_ideal, genome, scores->data());
+    } else {
+        for (size_t i = 0; i < geneCount; i++) {
+            (*scores)[i] = _math.similarity(_ideal[i], genome[i], genes[i].min, genes[i].max);
+        }
+    }
+
+    if (_memoize) {
+        if (_memo.full()) {
+            // Start over rather than evict; what's remembered is mostly the last generation or two
+            _memo.clear();
+        }
+        const auto row = static_cast<uint32_t>(_memo.size());
+        _memo.insert(hash, row);
+        std::copy(scores->begin(), scores->end(), _memoScores.begin() + row * geneCount);
+    }
+}
+
+void Population::score(Individual* individual) {
+    const Genome& genome = individual->genome();
+    std::vector<double>& scores = *individual->mutableScores();
+    if (scores.size() != genome.size()) {
+        // New or rewritten, so score every gene
+        scores.resize(genome.size());
+        scoreGenome(individual->genes(), genome, &scores);
+    } else if (!_changedGenes.empty()) {
+        // Only the genes whose preference moved need scoring again
+        const Genes& genes = individual->genes();
+        for (const size_t i : _changedGenes) {
+            scores[i] = _math.similarity(_ideal[i], genome[i], genes[i].min, genes[i].max);
+        }
+    } else if (!_reactions) {
+        return;
+    }
+    const double fitness = std::accumulate(scores.begin(), scores.end(), 0.0) / scores.size();
+    // The audience may have reacted to it since, even if their preferences haven't moved
+    individual->setFitness(_reactions ? _reactions->blend(individual->id(), fitness) : fitness);
+}
+
+void Population::scorePopulation(const Preferences& preferences) {
+    // Score everyone once up front rather than on every comparison
+    TRACE_SCOPE("scoring");
+    updateIdeal(preferences);
+    for (Individual& individual : _individuals) {
+        score(&individual);
+    }
+    copyObjectives();
 }
 
-auto Population::similarity(const Individual& individual) -> double {
-    double similarity = 0;
-    for (const auto& i : individual.instructions()) {
-        const Instruction instruction = i.second;
-        const Expression expression(instruction.expression());
-        const double ideal = _audiencePreferences.at(instruction.name()).current;
-        similarity += _math.similarity(ideal, expression.current, expression.min, expression.max);
+void Population::copyObjectives() {
+    if (!_pareto.enabled) {
+        return;
+    }
+    const size_t geneCount = _ideal.size();
+    _objectives.resize(_size * geneCount);
+    for (size_t i = 0; i < _size; i++) {
+        std::copy(_individuals[i].scores().begin(), _individuals[i].scores().end(), &_objectives[i * geneCount]);
     }
-    return similarity;
 }
 
 void Population::sortPopulation() {
-    std::sort(_individuals.begin(), _individuals.end(), [this] (const Individual& lhs, const Individual& rhs) -> bool {
-        return (similarity(lhs) / lhs.instructions().size()) > (similarity(rhs) / rhs.instructions().size());
+    _conductor = 0;
+    if (_pareto.enabled) {
+        rankPopulation();
+    } else if (_niching.derates()) {
+        nichePopulation();
+    } else {
+        // Only the fittest are bred from, so only they need ordering.
+        // This keeps a generation linear in the population size.
+        TRACE_SCOPE("sorting");
+        const auto fitter = [] (const Individual& lhs, const Individual& rhs) {
+            return lhs.fitness() > rhs.fitness();
+        };
+        const auto top = _individuals.begin() + _topN;
+        if (top != _individuals.end()) {
+            std::nth_element(_individuals.begin(), top, _individuals.end(), fitter);
+        }
+        std::sort(_individuals.begin(), top, fitter);
+    }
+    if (!_niching.derates()) {
+        copyFitness();
+    }
+    indexPopulation();
+}
+
+void Population::copyFitness() {
+    _fitness.resize(_individuals.size());
+    for (size_t i = 0; i < _individuals.size(); i++) {
+        _fitness[i] = _individuals[i].fitness();
+    }
+}
+
+void Population::nichePopulation() {
+    TRACE_SCOPE("niching");
+    _niching.derate(_individuals, &_fitness);
+    _niches.set(_niching.niches());
+
+    // Reorder through the spare generation, like ranking does
+    _ranked.resize(_size);
+    std::iota(_ranked.begin(), _ranked.end(), 0);
+    const auto fitter = [this] (const size_t lhs, const size_t rhs) {
+        return _fitness[lhs] > _fitness[rhs];
+    };
+    const auto top = _ranked.begin() + _topN;
+    if (top != _ranked.end()) {
+        std::nth_element(_ranked.begin(), top, _ranked.end(), fitter);
+    }
+    std::sort(_ranked.begin(), top, fitter);
+    // The fittest conducts and is kept even if sharing its niche has derated it
+    const auto fittest = std::max_element(_individuals.begin(), _individuals.end(),
+                                          [] (const Individual& lhs, const Individual& rhs) {
+        return lhs.fitness() < rhs.fitness();
     });
+    const auto front = std::find(_ranked.begin(), _ranked.end(), std::distance(_individuals.begin(), fittest));
+    std::rotate(_ranked.begin(), front, front + 1);
+
+    _rankedFitness.resize(_size);
+    for (size_t i = 0; i < _size; i++) {
+        _offspring[i] = _individuals[_ranked[i]];
+        _rankedFitness[i] = _fitness[_ranked[i]];
+    }
+    _individuals.swap(_offspring);
+    _fitness.swap(_rankedFitness);
+}
+
+void Population::indexPopulation() {
+    if (!_spatialIndex) {
+        return;
+    }
+    TRACE_SCOPE("indexing");
+    _index.build(_individuals, _distanceWeights);
+}
+
+void Population::findClosest(const Preferences& preferences, const size_t k) {
+    const Genes& genes = _individuals.front().genes();
+    _query.resize(genes.size());
+    for (size_t i = 0; i < genes.size(); i++) {
+        _query[i] = preferences.at(genes[i].name).current;
+    }
+    _index.nearest(_query, _distanceWeights, k, &_nearest);
+}
+
+void Population::rankPopulation() {
+    TRACE_SCOPE("ranking");
+    _ranking.rank(_objectives, _ideal.size(), _topN);
+
+    // Reorder through the spare generation, with the policy's pick of the first front in front
+    const size_t conductor = _ranking.choose(_pareto.policy);
+    _offspring[0] = _individuals[conductor];
+    size_t next = 1;
+    for (const size_t i : _ranking.order()) {
+        if (i != conductor) {
+            _offspring[next++] = _individuals[i];
+        }
+    }
+    _individuals.swap(_offspring);
+    _frontSize.set(_ranking.front().size());
+}
+
+void Population::recordFitness() {
+    double total = 0;
+    double worst = _individuals.front().fitness();
+    for (const Individual& individual : _individuals) {
+        total += individual.fitness();
+        worst = std::min(worst, individual.fitness());
+    }
+    _bestFitness.set(_individuals.front().fitness());
+    _worstFitness.set(worst);
+    _meanFitness.set(total / _individuals.size());
+}
+
+auto Population::getParents() -> std::pair<size_t, size_t> {
+    TRACE_SCOPE("selection");
+    return _selection->parents(_math);
 }
 
-auto Population::getParents(const Individuals& fittest) -> std::pair<Individual, Individual> {
-    std::pair<int, int> parents = _math.uniquePair(fittest);
-    return std::make_pair(fittest.at(parents.first), fittest.at(parents.second));
+void Population::breed(const std::pair<size_t, size_t>& parents, Individual* child) {
+    const Individual& first = _individuals[parents.first];
+    const Individual& second = _individuals[parents.second];
+    {
+        TRACE_SCOPE("breeding");
+        _genetics.combine(first.genome(), second.genome(), child->mutableGenome());
+        _genetics.combineSteps(first.steps(), second.steps(), child->mutableSteps());
+        // What the child has to beat to count as a successful mutation
+        child->setFitness(std::max(first.fitness(), second.fitness()));
+    }
+    TRACE_SCOPE("mutation");
+    _genetics.mutate(child->genes(), child->mutableGenome(), child->mutableSteps());
+    child->renew();
 }
 
-auto Population::breed(const std::pair<Individual, Individual>& parents) -> Individual {
-    return Individual(_genetics.mutate(
-        _genetics.combine(std::make_pair(parents.first.instructions(), parents.second.instructions()))));
+void Population::admit(Individual* child) {
+    TRACE_SCOPE("deduplication");
+    uint64_t hash = hashGenome(child->genome());
+    for (uint8_t retry = 0; !_present.insert(hash, 0); retry++) {
+        _duplicates.increment();
+        if (retry == DUPLICATE_RETRIES) {
+            _duplicatesKept.increment();
+            return;
+        }
+        _genetics.perturb(child->genes(), child->mutableGenome(), child->steps());
+        hash = hashGenome(child->genome());
+    }
 }
 
 void Population::nextGeneration() {
-    // wait here until we have new preferences
-    // or we've reached a timeout
-    // TOOD(grant) change timer to take updateable preference
-    bool haveLock = _havePreferences.try_lock_for(std::chrono::seconds(PREFERENCES_WAIT_FOR_S));
+    advance(std::chrono::steady_clock::time_point::max());
+}
+
+auto Population::advance(const std::chrono::steady_clock::time_point deadline) -> bool {
+    const auto start = std::chrono::steady_clock::now();
+    // The elites and children are all scored against this generation's preferences
+    size_t bred = _nextChild;
+    if (!_breeding) {
+        if (!beginGeneration(deadline)) {
+            // Nobody can be scored until the audience has said what they like
+            return false;
+        }
+        bred = 0;
+    }
+    // Always make some progress, so a deadline that's already gone can't stall the generation
+    breedChunk();
+    while (_nextChild < _size) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            // Until it's finished, the fittest so far conducts
+            for (size_t i = bred; i < _nextChild; i++) {
+                if (_offspring[i].fitness() > _offspring[_partialFittest].fitness()) {
+                    _partialFittest = i;
+                }
+            }
+            _generationTime += std::chrono::steady_clock::now() - start;
+            _generationsDeferred.increment();
+            return false;
+        }
+        breedChunk();
+    }
+    finishGeneration();
+    _generationTime += std::chrono::steady_clock::now() - start;
+    _generationDuration.record(std::chrono::duration_cast<std::chrono::microseconds>(_generationTime).count());
+    _generationTime = std::chrono::steady_clock::duration::zero();
+    return true;
+}
+
+auto Population::beginGeneration(const std::chrono::steady_clock::time_point deadline) -> bool {
+    takePreferences();
+    // Only the very first generation waits; after that the last preferences stand until new
+    // ones arrive. A generation with a deadline never waits, as that's time it needs for breeding
+    const bool unbounded = deadline == std::chrono::steady_clock::time_point::max();
+    if (!_haveIncoming && _generationPreferences.empty() && _preferencesQueue && unbounded) {
+        TRACE_SCOPE("wait for preferences");
+        ScopedTimer waitTimer(_preferencesWait);
+        if (_preferencesQueue->wait_dequeue_timed(_incomingPreferences, std::chrono::seconds(PREFERENCES_WAIT_FOR_S))) {
+            _haveIncoming = true;
+            _preferencesReceived.increment();
+            takePreferences();
+        }
+    }
+    // Preferences are only read here; any that arrive mid-generation wait for it to finish
+    applyPreferences();
+    if (_generationPreferences.empty()) {
+        _preferencesTimeouts.increment();
+        return false;
+    }
+    updateIdeal(_generationPreferences);
+    _breeding = true;
     _generation = _generation + 1;
-    // copy fittest to temporary
-    Individuals fittest(_individuals.begin(), _individuals.begin() + _topN);
-    // Remove unfittest individuals
-    _individuals.erase(_individuals.begin() + _topN, _individuals.end());
-
-    // Refill with new children
-    std::generate_n(std::back_inserter(_individuals), _size - _topN, [this, &fittest] () -> Individual {
-        return breed(getParents(fittest));
-    });
 
+    // The fittest carry over unchanged, scored against the latest preferences. With crowding
+    // nobody does; a parent only loses its place to a fitter child
+    const bool crowding = _niching.method() == NichingMethod::Crowding;
+    _firstChild = crowding ? 0 : _topN;
+    std::copy(_individuals.begin(), _individuals.begin() + _firstChild, _offspring.begin());
+    for (size_t i = 0; i < _firstChild; i++) {
+        score(&_offspring[i]);
+    }
+    if (_sizing.enabled) {
+        if (_shift >= _sizing.growShift && _size < _sizing.maxSize) {
+            grow();
+        }
+        if (_shift > 0) {
+            _calm = 0;
+        }
+        _shift = 0;
+    }
+    if (_deduplicate) {
+        _present.clear();
+        for (size_t i = 0; i < _firstChild; i++) {
+            _present.insert(hashGenome(_offspring[i].genome()), 0);
+        }
+    }
+
+    if (crowding) {
+        // Parents compete with their children, so they're scored against the same preferences
+        for (Individual& parent : _individuals) {
+            score(&parent);
+        }
+        _partners.resize(_individuals.size());
+        std::iota(_partners.begin(), _partners.end(), 0);
+        for (size_t i = _partners.size() - 1; i > 0; i--) {
+            std::swap(_partners[i], _partners[_math.uniformInt<size_t>(0, i)]);
+        }
+    } else {
+        TRACE_SCOPE("selection");
+        _selection->prepare(_fitness, 2 * (_size - _firstChild), _math);
+    }
+    _nextChild = _firstChild;
+    _partialFittest = 0;
+    _improved = 0;
+    return true;
+}
+
+void Population::grow() {
+    TRACE_SCOPE("growing");
+    const auto size = std::min(_sizing.maxSize, static_cast<size_t>(std::ceil(_size * _sizing.factor)));
+    const size_t immigrants = size - _size;
+    _offspring.resize(size, _offspring.front());
+    // Newcomers go straight into the next generation, after the elites; as many children are bred as before
+    for (size_t i = _firstChild; i < _firstChild + immigrants; i++) {
+        Individual& immigrant = _offspring[i];
+        _genetics.randomize(immigrant.genes(), immigrant.mutableGenome());
+        std::fill(immigrant.mutableSteps()->begin(), immigrant.mutableSteps()->end(), INITIAL_STEP);
+        immigrant.renew();
+        score(&immigrant);
+    }
+    _logger->info("The audience moved by {} of a range, growing from {} to {}", _shift, _size, size);
+    _firstChild += immigrants;
+    _size = size;
+    reserveTables();
+    _grown.increment();
+    _sizeGauge.set(_size);
+}
+
+void Population::adaptSize(const double spread) {
+    if (_shift > 0 || spread >= _sizing.shrinkDiversity) {
+        _calm = 0;
+        return;
+    }
+    if (++_calm < _sizing.patience || _size <= _sizing.minSize) {
+        return;
+    }
+    _calm = 0;
+    // Sorted, so the elites are kept and the rest are a sample of the others
+    const auto size = std::max(_sizing.minSize, static_cast<size_t>(_size / _sizing.factor));
+    _logger->info("Converged, shrinking from {} to {}", _size, size);
+    _individuals.erase(_individuals.begin() + size, _individuals.end());
+    _offspring.erase(_offspring.begin() + size, _offspring.end());
+    _fitness.resize(size);
+    _size = size;
+    indexPopulation();
+    _shrunk.increment();
+    _sizeGauge.set(_size);
+}
+
+void Population::breedChunk() {
+    // Breed the rest in place over last generation's leftovers, scoring each as it's made
+    const size_t end = std::min(_size, _nextChild + GENERATION_CHUNK);
+    while (_nextChild < end) {
+        if (_niching.method() == NichingMethod::Crowding) {
+            crowd();
+        } else {
+            breedChild(getParents(), &_offspring[_nextChild]);
+            _nextChild++;
+        }
+    }
+}
+
+void Population::breedChild(const std::pair<size_t, size_t>& parents, Individual* child) {
+    breed(parents, child);
+    if (_deduplicate) {
+        admit(child);
+    }
+    // Children still carry the fitness of their fitter parent
+    const double before = child->fitness();
+    TRACE_SCOPE("scoring");
+    score(child);
+    if (child->fitness() > before) {
+        _improved++;
+    }
+}
+
+void Population::crowd() {
+    TRACE_SCOPE("crowding");
+    const size_t pair = _nextChild - _firstChild;
+    const size_t first = _partners[pair];
+    if (pair + 1 == _partners.size()) {
+        // The odd one out breeds with anyone, and its child only competes for its slot
+        const size_t partner = _partners[_math.uniformInt<size_t>(0, pair - 1)];
+        breedChild(std::make_pair(first, partner), &_offspring[_nextChild]);
+        keepFitter(_nextChild, first);
+        _nextChild++;
+        return;
+    }
+    const size_t second = _partners[pair + 1];
+    const std::pair<size_t, size_t> parents(first, second);
+    breedChild(parents, &_offspring[_nextChild]);
+    breedChild(parents, &_offspring[_nextChild + 1]);
+
+    // Each child competes with the parent it's more like, so niches replace themselves
+    const Genes& genes = _offspring[_nextChild].genes();
+    const Genome& x = _individuals[first].genome();
+    const Genome& y = _individuals[second].genome();
+    const Genome& a = _offspring[_nextChild].genome();
+    const Genome& b = _offspring[_nextChild + 1].genome();
+    const bool straight = NeighbourGrid::distance(genes, x, a) + NeighbourGrid::distance(genes, y, b) <=
+                          NeighbourGrid::distance(genes, x, b) + NeighbourGrid::distance(genes, y, a);
+    keepFitter(_nextChild, straight ? first : second);
+    keepFitter(_nextChild + 1, straight ? second : first);
+    _nextChild += 2;
+}
+
+void Population::keepFitter(const size_t slot, const size_t parent) {
+    if (_individuals[parent].fitness() > _offspring[slot].fitness()) {
+        _offspring[slot] = _individuals[parent];
+        _parentsKept.increment();
+    }
+}
+
+void Population::finishGeneration() {
+    _individuals.swap(_offspring);
+    if (_offspring.size() != _size) {
+        // Grown this generation; the spare needs to match
+        _offspring.resize(_size, _individuals.front());
+    }
+    takePreferences();
+    if (applyPreferences()) {
+        // Rank by any preferences that came in while breeding; only their genes are scored again
+        scorePopulation(_generationPreferences);
+    } else {
+        copyObjectives();
+    }
     sortPopulation();
-    if (haveLock) {
-        _havePreferences.unlock();
+    if (_size > _firstChild) {
+        const double successRate = static_cast<double>(_improved) / (_size - _firstChild);
+        _successRate.set(successRate);
+        _stepScale.set(_genetics.adapt(successRate));
+    }
+    const double spread = diversity();
+    _diversity.set(spread);
+    if (_sizing.enabled) {
+        adaptSize(spread);
     }
+    recordFitness();
+    _generationGauge.set(_generation);
+    _logger->debug("Generation {} has fitness {} and diversity {}", _generation, fitness(), spread);
+    _breeding = false;
 }
 
 void Population::setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) {
-    std::thread t([preferencesQueue, this] () {
-        while (true) {
-            _havePreferences.lock();
-            preferencesQueue->wait_dequeue(_audiencePreferences);
-            _havePreferences.unlock();
+    // Read by the generations themselves, so nobody holds anything while the audience is quiet
+    _preferencesQueue = preferencesQueue;
+}
+
+void Population::takePreferences() {
+    if (!_preferencesQueue) {
+        return;
+    }
+    // Only the newest matter; any older ones still queued were never going to be played to
+    while (_preferencesQueue->try_dequeue(_incomingPreferences)) {
+        _haveIncoming = true;
+        _preferencesReceived.increment();
+    }
+    _preferencesQueueDepth.set(_preferencesQueue->size_approx());
+}
+
+auto Population::applyPreferences() -> bool {
+    if (!_haveIncoming) {
+        return false;
+    }
+    _generationPreferences.swap(_incomingPreferences);
+    _haveIncoming = false;
+    return true;
+}
+
+void Population::setPreferences(const Preferences& preferences) {
+    if (_breeding) {
+        // Part way through a generation, which is ranked by these when it finishes
+        _incomingPreferences = preferences;
+        _haveIncoming = true;
+        return;
+    }
+    _generationPreferences = preferences;
+    _haveIncoming = false;
+    if (_spatialIndex) {
+        // Conduct with whoever is closest now; everyone is scored with the next generation
+        TRACE_SCOPE("nearest conductor");
+        findClosest(preferences, 1);
+        _conductor = _nearest.front();
+        return;
+    }
+    // Rank by the new preferences straight away; only the changed genes are scored again
+    scorePopulation(preferences);
+    sortPopulation();
+    recordFitness();
+}
+
+auto Population::generation() const -> uint32_t {
+    return _generation;
+}
+
+auto Population::diversity() const -> double {
+    return audiogene::diversity(_individuals);
+}
+
+auto Population::checkpoint() const -> Checkpoint {
+    TRACE_SCOPE("checkpoint");
+    Checkpoint checkpoint;
+    // These are the individuals of the last finished generation
+    checkpoint.generation = _breeding ? _generation - 1 : _generation;
+    for (const Gene& gene : _individuals.front().genes()) {
+        checkpoint.genes.push_back(gene.name);
+    }
+    checkpoint.genomes.reserve(_individuals.size() * checkpoint.genes.size());
+    for (const Individual& individual : _individuals) {
+        checkpoint.genomes.insert(checkpoint.genomes.end(), individual.genome().begin(), individual.genome().end());
+        checkpoint.fitness.push_back(individual.fitness());
+    }
+    checkpoint.preferences = _generationPreferences;
+    checkpoint.populationRng = _math.state();
+    checkpoint.geneticsRng = _genetics.rngState();
+    return checkpoint;
+}
+
+void Population::restore(const Checkpoint& checkpoint) {
+    // Gene ranges come from the configured seed, the checkpoint only holds values
+    const Genes& genes = _individuals.front().genes();
+    if (checkpoint.genes.size() != genes.size()) {
+        throw std::runtime_error("Checkpoint genes don't match configured genes");
+    }
+    // Where each configured gene is in the checkpoint's genomes
+    std::vector<size_t> order;
+    for (const Gene& gene : genes) {
+        const auto it = std::find(checkpoint.genes.begin(), checkpoint.genes.end(), gene.name);
+        if (it == checkpoint.genes.end() || checkpoint.preferences.count(gene.name) == 0) {
+            throw std::runtime_error("Gene " + gene.name + " isn't in the checkpoint");
         }
-    });
-    t.detach();
+        order.push_back(std::distance(checkpoint.genes.begin(), it));
+    }
+
+    // A generation in progress may have grown the spare buffer; the current individuals set the size
+    _size = _individuals.size();
+    _offspring.resize(_size, _individuals.front());
+    _sizeGauge.set(_size);
+
+    const size_t restored = std::min(checkpoint.fitness.size(), _size);
+    if (restored == 0) {
+        throw std::runtime_error("Checkpoint has no individuals");
+    }
+
+    // The current size wins; top up by repeating the fittest if the checkpoint was smaller
+    const size_t geneCount = genes.size();
+    for (size_t i = 0; i < _size; i++) {
+        const size_t from = i % restored;
+        Individual& individual = _individuals[i];
+        for (size_t g = 0; g < geneCount; g++) {
+            (*individual.mutableGenome())[g] = checkpoint.genomes[from * geneCount + order[g]];
+        }
+        // Step sizes aren't checkpointed; they adapt again within a few generations
+        std::fill(individual.mutableSteps()->begin(), individual.mutableSteps()->end(), INITIAL_STEP);
+        individual.setFitness(checkpoint.fitness[from]);
+        individual.renew();
+    }
+    // Niches are found again when the next generation is ranked
+    copyFitness();
+
+    _generation = checkpoint.generation;
+    _generationPreferences = checkpoint.preferences;
+    _haveIncoming = false;
+    _math.restore(checkpoint.populationRng);
+    _genetics.restoreRng(checkpoint.geneticsRng);
+    // Any generation in progress was bred from the individuals just replaced
+    _breeding = false;
+    _generationTime = std::chrono::steady_clock::duration::zero();
+    _conductor = 0;
+    indexPopulation();
+    _logger->info("Restored {} individuals at generation {}", restored, _generation);
+}
+
+void Population::warmStart(const Individuals& seeds, const Preferences& preferences) {
+    // The rest stay copies of the seed, which breeding soon replaces
+    const size_t seeded = std::min(seeds.size(), _individuals.size());
+    for (size_t i = 0; i < seeded; i++) {
+        Individual& individual = _individuals[i];
+        *individual.mutableGenome() = seeds[i].genome();
+        Genetics::create(individual.genes(), individual.mutableGenome());
+        std::fill(individual.mutableSteps()->begin(), individual.mutableSteps()->end(), INITIAL_STEP);
+        individual.renew();
+    }
+    // Rank them now so the first generation breeds from the fittest of them
+    _generationPreferences = preferences;
+    _haveIncoming = false;
+    scorePopulation(preferences);
+    sortPopulation();
+    recordFitness();
+    _logger->info("Warm started {} of {} individuals", seeded, _individuals.size());
+}
+
+void Population::setReactions(const std::shared_ptr<const Reactions>& reactions) {
+    // Before evolving starts, like the preferences
+    _reactions = reactions;
 }
 
 auto Population::fittest() -> Individual {
-    return _individuals.front();
+    if (_breeding) {
+        return _offspring[_partialFittest];
+    }
+    return _individuals[_conductor];
+}
+
+auto Population::sample(const size_t n) -> Individuals {
+    Individuals sample;
+    if (n == 0) {
+        return sample;
+    }
+    const size_t stride = std::max<size_t>(1, _individuals.size() / n);
+    sample.reserve(std::min(n, _individuals.size()));
+    for (size_t i = 0; i < _individuals.size() && sample.size() < n; i += stride) {
+        sample.push_back(_individuals[i]);
+    }
+    return sample;
+}
+
+auto Population::fitness() const -> double {
+    return _individuals.front().fitness();
+}
+
+auto Population::closest(const Preferences& preferences, const size_t k) -> Individuals {
+    if (!_spatialIndex) {
+        throw std::runtime_error("Finding the closest individuals needs the spatial index");
+    }
+    findClosest(preferences, k);
+    Individuals closest;
+    closest.reserve(_nearest.size());
+    for (const size_t i : _nearest) {
+        closest.push_back(_individuals[i]);
+    }
+    return closest;
+}
+
+auto Population::emigrants(const size_t n) const -> Individuals {
+    return Individuals(_individuals.begin(), _individuals.begin() + std::min(n, _individuals.size()));
+}
+
+void Population::immigrate(const Individuals& immigrants) {
+    const size_t n = std::min(immigrants.size(), _individuals.size() - _topN);
+    if (n == 0) {
+        return;
+    }
+    // Only the elites are kept in order, and niching or ranking may have put others before fitness,
+    // so move the least fit of the rest to the end for the immigrants to replace
+    const auto fitter = [] (const Individual& lhs, const Individual& rhs) {
+        return lhs.fitness() > rhs.fitness();
+    };
+    std::nth_element(_individuals.begin() + _topN, _individuals.end() - n, _individuals.end(), fitter);
+    std::copy(immigrants.begin(), immigrants.begin() + n, _individuals.end() - n);
+    // They were scored against another island's view of the audience. Score them against this
+    // island's last generation
+    for (auto it = _individuals.end() - n; it != _individuals.end(); ++it) {
+        it->mutableScores()->clear();
+    }
+    scorePopulation(_generationPreferences);
+    sortPopulation();
+}
+
+void Population::print(std::ostream& os) const {
+    os << *this;
 }
 
 }  // namespace audiogene
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "reactions.hpp"
+
+#include <stdexcept>
+
+namespace audiogene {
+
+namespace {
+
+auto slotMask(const size_t slots) -> size_t {
+    if (slots == 0) {
+        throw std::runtime_error("Need at least one slot for reactions");
+    }
+    size_t rounded = 1;
+    while (rounded < slots) {
+        rounded <<= 1;
+    }
+    return rounded - 1;
+}
+
+}  // namespace
+
+Reactions::Reactions(const ReactionConfig& config):
+        _mask(slotMask(config.slots)),
+        _weight(config.weight),
+        _slots(new ReactionSlot[_mask + 1]),
+        _playing(nullptr),
+        _changes(0),
+        _inputs(Metrics::instance().counter("audiogene_reactions_total",
+                "Audience inputs attributed to the conductor playing")),
+        _reversals(Metrics::instance().counter("audiogene_reaction_reversals_total",
+                "Audience inputs that reversed their previous input for the same preference")) {
+    for (size_t i = 0; i <= _mask; i++) {
+        _slots[i].conductor.store(0, std::memory_order_relaxed);
+        _slots[i].bars.store(0, std::memory_order_relaxed);
+        _slots[i].inputs.store(0, std::memory_order_relaxed);
+        _slots[i].reversals.store(0, std::memory_order_relaxed);
+    }
+}
+
+auto Reactions::slotOf(const uint32_t conductor) const noexcept -> ReactionSlot& {
+    // Ids are handed out in order, so recent conductors rarely share a slot
+    return _slots[conductor & _mask];
+}
+
+void Reactions::play(const uint32_t conductor) noexcept {
+    ReactionSlot& slot = slotOf(conductor);
+    bool changed = _playing.load(std::memory_order_relaxed) != &slot;
+    if (slot.conductor.load(std::memory_order_relaxed) != conductor + 1) {
+        // Whoever had the slot is forgotten
+        slot.bars.store(0, std::memory_order_relaxed);
+        slot.inputs.store(0, std::memory_order_relaxed);
+        slot.reversals.store(0, std::memory_order_relaxed);
+        slot.conductor.store(conductor + 1, std::memory_order_relaxed);
+        changed = true;
+    }
+    slot.bars.fetch_add(1, std::memory_order_relaxed);
+    _playing.store(&slot, std::memory_order_release);
+    if (changed) {
+        _changes.fetch_add(1, std::memory_order_release);
+    }
+}
+
+auto Reactions::blend(const uint32_t conductor, const double fitness) const noexcept -> double {
+    const ReactionSlot& slot = slotOf(conductor);
+    if (slot.conductor.load(std::memory_order_relaxed) != conductor + 1) {
+        return fitness;
+    }
+    const uint32_t bars = slot.bars.load(std::memory_order_relaxed);
+    if (bars == 0) {
+        return fitness;
+    }
+    const double inputs = slot.inputs.load(std::memory_order_relaxed) + slot.reversals.load(std::memory_order_relaxed);
+    const double approval = 1 / (1 + inputs / bars);
+    return (1 - _weight) * fitness + _weight * approval;
+}
+
+}  // namespace audiogene
@@ -0,0 +1,248 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "selection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+
+namespace {
+
+/*! Fitness shifted so the least fit has no weight. Returns the total weight */
+auto shiftedFitness(const std::vector<double>& fitness, std::vector<double>* weights) -> double {
+    const double least = *std::min_element(fitness.begin(), fitness.end());
+    weights->resize(fitness.size());
+    double total = 0;
+    for (size_t i = 0; i < fitness.size(); i++) {
+        (*weights)[i] = fitness[i] - least;
+        total += (*weights)[i];
+    }
+    // Everyone is equally fit, so everyone is equally likely
+    if (total <= 0) {
+        std::fill(weights->begin(), weights->end(), 1.0);
+        total = weights->size();
+    }
+    return total;
+}
+
+}  // namespace
+
+auto selectionStrategy(const std::string& name) -> SelectionStrategy {
+    if (name == "truncation") {
+        return SelectionStrategy::Truncation;
+    } else if (name == "tournament") {
+        return SelectionStrategy::Tournament;
+    } else if (name == "roulette") {
+        return SelectionStrategy::Roulette;
+    } else if (name == "sus") {
+        return SelectionStrategy::StochasticUniversal;
+    } else if (name == "rank") {
+        return SelectionStrategy::Rank;
+    }
+    throw std::runtime_error("Unknown selection strategy " + name);
+}
+
+auto Selection::create(const SelectionConfig& config, const size_t topN) -> std::unique_ptr<Selection> {
+    switch (config.strategy) {
+    case SelectionStrategy::Tournament:
+        return std::make_unique<TournamentSelection>(config.tournamentSize);
+    case SelectionStrategy::Roulette:
+        return std::make_unique<RouletteSelection>();
+    case SelectionStrategy::StochasticUniversal:
+        return std::make_unique<StochasticUniversalSelection>();
+    case SelectionStrategy::Rank:
+        return std::make_unique<RankSelection>(config.rankPressure);
+    case SelectionStrategy::Truncation:
+    default:
+        return std::make_unique<TruncationSelection>(topN);
+    }
+}
+
+TruncationSelection::TruncationSelection(const size_t topN):
+        _topN(topN) {
+    if (_topN < 2) {
+        throw std::runtime_error("Truncation selection needs at least two individuals");
+    }
+}
+
+void TruncationSelection::prepare(const std::vector<double>& /* fitness */, size_t /* draws */, const Math& /* math */) {
+    // The fittest topN are already at the front
+}
+
+auto TruncationSelection::select(const Math& math) -> size_t {
+    return math.uniformInt<size_t>(0, _topN - 1);
+}
+
+auto TruncationSelection::parents(const Math& math) -> std::pair<size_t, size_t> {
+    return math.uniquePair(_topN);
+}
+
+TournamentSelection::TournamentSelection(const size_t size):
+        _size(size),
+        _fitness(nullptr) {
+    if (_size < 1) {
+        throw std::runtime_error("Tournaments need at least one entrant");
+    }
+}
+
+void TournamentSelection::prepare(const std::vector<double>& fitness, size_t /* draws */, const Math& /* math */) {
+    _fitness = &fitness;
+}
+
+auto TournamentSelection::select(const Math& math) -> size_t {
+    const size_t last = _fitness->size() - 1;
+    size_t winner = math.uniformInt<size_t>(0, last);
+    for (size_t i = 1; i < _size; i++) {
+        const size_t entrant = math.uniformInt<size_t>(0, last);
+        if ((*_fitness)[entrant] > (*_fitness)[winner]) {
+            winner = entrant;
+        }
+    }
+    return winner;
+}
+
+void RouletteSelection::prepare(const std::vector<double>& fitness, size_t /* draws */, const Math& /* math */) {
+    const size_t n = fitness.size();
+    const double total = shiftedFitness(fitness, &_weights);
+
+    // Scale so the average weight is 1, then pair each light entry with a heavy one
+    _probability.resize(n);
+    _alias.resize(n);
+    _small.clear();
+    _large.clear();
+    for (size_t i = 0; i < n; i++) {
+        _weights[i] = _weights[i] * n / total;
+        if (_weights[i] < 1) {
+            _small.push_back(i);
+        } else {
+            _large.push_back(i);
+        }
+    }
+    while (!_small.empty() && !_large.empty()) {
+        const size_t light = _small.back();
+        _small.pop_back();
+        const size_t heavy = _large.back();
+        _large.pop_back();
+
+        _probability[light] = _weights[light];
+        _alias[light] = heavy;
+        _weights[heavy] = (_weights[heavy] + _weights[light]) - 1;
+        if (_weights[heavy] < 1) {
+            _small.push_back(heavy);
+        } else {
+            _large.push_back(heavy);
+        }
+    }
+    // Whatever is left over is 1 up to rounding
+    for (const size_t i : _large) {
+        _probability[i] = 1;
+        _alias[i] = i;
+    }
+    for (const size_t i : _small) {
+        _probability[i] = 1;
+        _alias[i] = i;
+    }
+}
+
+auto RouletteSelection::select(const Math& math) -> size_t {
+    const size_t i = math.uniformInt<size_t>(0, _probability.size() - 1);
+    return math.uniformReal(0.0, 1.0) < _probability[i] ? i : _alias[i];
+}
+
+StochasticUniversalSelection::StochasticUniversalSelection():
+        _next(0) {
+    // empty constructor
+}
+
+void StochasticUniversalSelection::prepare(const std::vector<double>& fitness, const size_t draws, const Math& math) {
+    const double total = shiftedFitness(fitness, &_weights);
+
+    _picks.clear();
+    _next = 0;
+    if (draws == 0) {
+        return;
+    }
+    _picks.reserve(draws);
+
+    // One spin of a wheel with draws evenly spaced pointers
+    const double spacing = total / draws;
+    double pointer = math.uniformReal(0.0, spacing);
+    double cumulative = 0;
+    for (size_t i = 0; i < _weights.size() && _picks.size() < draws; i++) {
+        cumulative += _weights[i];
+        while (pointer < cumulative && _picks.size() < draws) {
+            _picks.push_back(i);
+            pointer += spacing;
+        }
+    }
+    // Rounding can leave the last pointer just past the end
+    while (_picks.size() < draws) {
+        _picks.push_back(_weights.size() - 1);
+    }
+
+    // The sweep picks in population order, so shuffle before pairing
+    for (size_t i = _picks.size() - 1; i > 0; i--) {
+        std::swap(_picks[i], _picks[math.uniformInt<size_t>(0, i)]);
+    }
+}
+
+auto StochasticUniversalSelection::select(const Math& /* math */) -> size_t {
+    // Wrap around if more parents are asked for than were prepared
+    return _picks[_next++ % _picks.size()];
+}
+
+RankSelection::RankSelection(const double pressure):
+        _pressure(pressure) {
+    if (_pressure < 1 || _pressure > 2) {
+        throw std::runtime_error("Rank pressure must be between 1 and 2");
+    }
+}
+
+void RankSelection::prepare(const std::vector<double>& fitness, size_t /* draws */, const Math& /* math */) {
+    // The population only keeps its fittest in order, so rank everyone here
+    _order.resize(fitness.size());
+    std::iota(_order.begin(), _order.end(), 0);
+    std::sort(_order.begin(), _order.end(), [&fitness] (const size_t lhs, const size_t rhs) {
+        return fitness[lhs] > fitness[rhs];
+    });
+}
+
+auto RankSelection::select(const Math& math) -> size_t {
+    // Rank density falls linearly from pressure to 2 - pressure; invert its CDF
+    const double u = math.uniformReal(0.0, 1.0);
+    double x = u;
+    if (_pressure > 1) {
+        x = (_pressure - std::sqrt(_pressure * _pressure - 4 * (_pressure - 1) * u)) / (2 * (_pressure - 1));
+    }
+    const size_t rank = std::min(_order.size() - 1, static_cast<size_t>(x * _order.size()));
+    return _order[rank];
+}
+
+}  // namespace audiogene
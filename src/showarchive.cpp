@@ -0,0 +1,335 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "showarchive.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+
+namespace {
+
+auto align(const uint64_t offset) -> uint64_t {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+}  // namespace
+
+ShowArchive::ShowArchive(const ShowArchiveConfig& config, const Individual& seed):
+        _logger(spdlog::get("log")),
+        _genes(std::make_shared<const Genes>(seed.genes())),
+        _path(config.file),
+        _everyGenerations(config.everyGenerations),
+        _elites(config.elites),
+        _samples(config.samples),
+        _fd(-1),
+        _map(nullptr),
+        _mapSize(0),
+        _header(nullptr),
+        _records(nullptr),
+        _stride(2 * seed.genes().size() + 1),
+        _stored(Metrics::instance().gauge("audiogene_show_archive_elites", "Elite conductors in the show archive")),
+        _recorded(Metrics::instance().counter("audiogene_show_archive_recorded_total",
+                "Conductors recorded in the show archive as the elite for their preferences")) {
+    if (config.capacity == 0 || _everyGenerations == 0) {
+        throw std::runtime_error("Show archive needs room for an elite and to record at least every generation");
+    }
+    _fd = ::open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open show archive " + _path);
+    }
+    try {
+        // Two shows writing the same records would tear them
+        if (flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+            throw std::runtime_error("Show archive " + _path + " is in use");
+        }
+        struct stat status{};
+        if (fstat(_fd, &status) != 0) {
+            throw std::runtime_error("Failed to read show archive " + _path);
+        }
+        if (status.st_size == 0) {
+            create(config.capacity);
+        } else {
+            _mapSize = status.st_size;
+            open();
+        }
+    } catch (...) {
+        close();
+        throw;
+    }
+    _stored.set(_header->count);
+    _logger->info("Show archive {} holds {} of {} elites", _path, _header->count, _header->capacity);
+}
+
+ShowArchive::~ShowArchive() {
+    if (_map != nullptr) {
+        msync(_map, _mapSize, MS_SYNC);
+    }
+    close();
+}
+
+void ShowArchive::create(const size_t capacity) {
+    std::vector<char> names;
+    for (const Gene& gene : *_genes) {
+        names.insert(names.end(), gene.name.begin(), gene.name.end());
+        names.push_back('\0');
+    }
+    ShowArchiveHeader header{};
+    header.version = SHOW_ARCHIVE_VERSION;
+    header.geneCount = _genes->size();
+    header.capacity = capacity;
+    header.namesOffset = align(sizeof(ShowArchiveHeader));
+    header.namesSize = names.size();
+    header.recordsOffset = align(header.namesOffset + header.namesSize);
+    _mapSize = header.recordsOffset + capacity * _stride * sizeof(double);
+
+    if (ftruncate(_fd, _mapSize) != 0) {
+        throw std::runtime_error("Failed to size show archive " + _path);
+    }
+    _map = mmap(nullptr, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (_map == MAP_FAILED) {
+        _map = nullptr;
+        throw std::runtime_error("Failed to map show archive " + _path);
+    }
+    auto* data = static_cast<char*>(_map);
+    std::memcpy(data, &header, sizeof(header));
+    std::copy(names.begin(), names.end(), data + header.namesOffset);
+    // The magic goes in last, so a file cut short while being made isn't mistaken for an archive
+    msync(_map, _mapSize, MS_SYNC);
+    _header = static_cast<ShowArchiveHeader*>(_map);
+    _header->magic = SHOW_ARCHIVE_MAGIC;
+    msync(_map, _mapSize, MS_SYNC);
+    _records = reinterpret_cast<double*>(data + header.recordsOffset);
+    for (size_t i = 0; i < _genes->size(); i++) {
+        _order.push_back(i);
+    }
+    _logger->info("Made show archive {} with room for {} elites", _path, capacity);
+}
+
+void ShowArchive::open() {
+    if (_mapSize < sizeof(ShowArchiveHeader)) {
+        throw std::runtime_error("Show archive is truncated");
+    }
+    _map = mmap(nullptr, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (_map == MAP_FAILED) {
+        _map = nullptr;
+        throw std::runtime_error("Failed to map show archive " + _path);
+    }
+    _header = static_cast<ShowArchiveHeader*>(_map);
+    if (_header->magic != SHOW_ARCHIVE_MAGIC) {
+        throw std::runtime_error("Not a show archive");
+    }
+    if (_header->version != SHOW_ARCHIVE_VERSION) {
+        throw std::runtime_error("Unsupported show archive version " + std::to_string(_header->version));
+    }
+    if (_header->geneCount != _genes->size()) {
+        throw std::runtime_error("Show archive genes don't match configured genes");
+    }
+    // Each offset and size is checked against the file before it's added or multiplied, so none can overflow
+    const uint64_t recordSize = _stride * sizeof(double);
+    if (_header->capacity == 0
+            || _header->count > _header->capacity
+            || _header->next >= _header->capacity
+            || _header->namesOffset < sizeof(ShowArchiveHeader)
+            || _header->namesOffset > _mapSize
+            || _header->namesSize > _mapSize - _header->namesOffset
+            || _header->recordsOffset < _header->namesOffset + _header->namesSize
+            || _header->recordsOffset > _mapSize
+            || _header->recordsOffset % sizeof(double) != 0
+            || _header->capacity > (_mapSize - _header->recordsOffset) / recordSize) {
+        throw std::runtime_error("Show archive is truncated");
+    }
+
+    const char* data = static_cast<const char*>(_map);
+    std::vector<std::string> names;
+    const char* name = data + _header->namesOffset;
+    const char* end = name + _header->namesSize;
+    while (name < end && names.size() < _header->geneCount) {
+        const char* terminator = std::find(name, end, '\0');
+        if (terminator == end) {
+            throw std::runtime_error("Corrupt show archive gene name");
+        }
+        names.emplace_back(name, terminator);
+        name = terminator + 1;
+    }
+    for (const Gene& gene : *_genes) {
+        const auto it = std::find(names.begin(), names.end(), gene.name);
+        if (it == names.end()) {
+            throw std::runtime_error("Gene " + gene.name + " isn't in the show archive");
+        }
+        _order.push_back(std::distance(names.begin(), it));
+    }
+    _records = reinterpret_cast<double*>(static_cast<char*>(_map) + _header->recordsOffset);
+}
+
+void ShowArchive::close() noexcept {
+    if (_map != nullptr) {
+        munmap(_map, _mapSize);
+        _map = nullptr;
+        _header = nullptr;
+        _records = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+auto ShowArchive::recordAt(const size_t i) const noexcept -> double* {
+    return _records + i * _stride;
+}
+
+void ShowArchive::normalize(const Preferences& preferences) {
+    _query.resize(_genes->size());
+    for (size_t i = 0; i < _genes->size(); i++) {
+        const Gene& gene = (*_genes)[i];
+        _query[i] = (preferences.at(gene.name).current - gene.min) / (gene.max - gene.min);
+    }
+}
+
+void ShowArchive::measure() {
+    const size_t geneCount = _genes->size();
+    _distances.clear();
+    for (size_t r = 0; r < _header->count; r++) {
+        const double* preferred = recordAt(r);
+        double squared = 0;
+        for (size_t i = 0; i < geneCount; i++) {
+            const Gene& gene = (*_genes)[i];
+            const double d = (preferred[_order[i]] - gene.min) / (gene.max - gene.min) - _query[i];
+            squared += d * d;
+        }
+        _distances.emplace_back(std::sqrt(squared), r);
+    }
+}
+
+void ShowArchive::record(const Individual& conductor, const Preferences& preferences) {
+    normalize(preferences);
+    measure();
+
+    const size_t geneCount = _genes->size();
+    size_t slot = _header->count;
+    const auto nearest = std::min_element(_distances.begin(), _distances.end());
+    if (nearest != _distances.end() && nearest->first < SHOW_ARCHIVE_RADIUS) {
+        if (conductor.fitness() <= recordAt(nearest->second)[2 * geneCount]) {
+            return;
+        }
+        slot = nearest->second;
+    } else if (_header->count == _header->capacity) {
+        slot = _header->next;
+        _header->next = (_header->next + 1) % _header->capacity;
+    }
+
+    double* record = recordAt(slot);
+    for (size_t i = 0; i < geneCount; i++) {
+        record[_order[i]] = preferences.at((*_genes)[i].name).current;
+        record[geneCount + _order[i]] = conductor.genome()[i];
+    }
+    record[2 * geneCount] = conductor.fitness();
+    // Counted only once it's written
+    if (slot == _header->count) {
+        _header->count++;
+    }
+    msync(_map, _mapSize, MS_ASYNC);
+    _recorded.increment();
+    _stored.set(_header->count);
+}
+
+auto ShowArchive::nearest(const Preferences& preferences, const size_t k) -> Individuals {
+    normalize(preferences);
+    measure();
+    const size_t n = std::min(k, _distances.size());
+    std::partial_sort(_distances.begin(), _distances.begin() + n, _distances.end());
+
+    const size_t geneCount = _genes->size();
+    Individuals elites;
+    elites.reserve(n);
+    for (size_t e = 0; e < n; e++) {
+        const double* record = recordAt(_distances[e].second);
+        Genome genome(geneCount);
+        for (size_t i = 0; i < geneCount; i++) {
+            // Ranges may have been configured differently when it was recorded
+            const Gene& gene = (*_genes)[i];
+            genome[i] = _math.clip(record[geneCount + _order[i]], gene.min, gene.max);
+            if (gene.round) {
+                genome[i] = std::round(genome[i]);
+            }
+        }
+        elites.emplace_back(_genes, std::move(genome));
+        elites.back().setFitness(record[2 * geneCount]);
+    }
+    return elites;
+}
+
+void ShowArchive::latinHypercube(const size_t n, Individuals* samples) const {
+    if (n == 0) {
+        return;
+    }
+    // Each gene's range is cut into n strata and every sample takes a different one
+    const size_t geneCount = _genes->size();
+    std::vector<double> values(n * geneCount);
+    std::vector<size_t> strata(n);
+    for (size_t i = 0; i < geneCount; i++) {
+        const Gene& gene = (*_genes)[i];
+        std::iota(strata.begin(), strata.end(), 0);
+        for (size_t j = n - 1; j > 0; j--) {
+            std::swap(strata[j], strata[_math.uniformInt<size_t>(0, j)]);
+        }
+        for (size_t j = 0; j < n; j++) {
+            const double value = gene.min + (strata[j] + _math.uniformReal(0.0, 1.0)) / n * (gene.max - gene.min);
+            values[j * geneCount + i] = gene.round ? std::round(value) : value;
+        }
+    }
+    for (size_t j = 0; j < n; j++) {
+        samples->emplace_back(_genes, Genome(values.begin() + j * geneCount, values.begin() + (j + 1) * geneCount));
+    }
+}
+
+auto ShowArchive::warmStart(const Preferences& preferences) -> Individuals {
+    Individuals seeds = nearest(preferences, _elites);
+    const size_t elites = seeds.size();
+    latinHypercube(_samples, &seeds);
+    _logger->info("Warm starting from {} archived elites and {} samples", elites, seeds.size() - elites);
+    return seeds;
+}
+
+auto ShowArchive::everyGenerations() const noexcept -> uint32_t {
+    return _everyGenerations;
+}
+
+auto ShowArchive::size() const noexcept -> size_t {
+    return _header->count;
+}
+
+}  // namespace audiogene
@@ -26,9 +26,14 @@
 
 #include <functional>
 
+#include "trace.hpp"
+
 namespace audiogene {
 
-SPI::SPI() {
+SPI::SPI():
+        _polls(Metrics::instance().counter("audiogene_spi_polls_total", "SPI controller polls")),
+        _events(Metrics::instance().counter("audiogene_spi_events_total", "Inputs read from the SPI controller")),
+        _transferDuration(Metrics::instance().histogram("audiogene_spi_transfer_us", "Time spent in an SPI transfer")) {
     _logger = spdlog::get("log");
 }
 
@@ -42,19 +47,26 @@ auto SPI::prepare() -> bool {
 
     // make a new thread to listen to SPI
     spiListenerThread = std::thread([this] () {
+        TRACE_THREAD_NAME("spi");
         std::array<unsigned char, 1> buf{ {SIGNAL} };
         // TODO(grant) change to some broadcast mechanism
         int stop = 0;
         // main loop
         while (stop == 0) {
             buf[0] = SIGNAL;
-            wiringPiSPIDataRW(SPI_CHANNEL, buf.data(), 1);
+            {
+                TRACE_SCOPE("spi transfer");
+                ScopedTimer transferTimer(_transferDuration);
+                wiringPiSPIDataRW(SPI_CHANNEL, buf.data(), 1);
+            }
+            _polls.increment();
             if (buf.at(0) != 0) {
                 unsigned char data = buf.at(0);
                 // loop through bits to see which are set
                 for (size_t i = 0; i < sizeof(data) * BYTE_SIZE; i++) {
                     if ((data & 1u << i) != 0) {
                         _logger->info("Received data from controller {}", i);
+                        _events.increment();
                         // TODO(grant) actually determine which preference was updated and update
                         preferenceUpdated("", {});
                     }
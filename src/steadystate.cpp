@@ -0,0 +1,373 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "steadystate.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace audiogene {
+
+SteadyState::SteadyState(const PopulationConfig& config, const Individual& seed, const std::chrono::microseconds pause):
+        _logger(spdlog::get("log")),
+        _genetics(config.mutation),
+        _tournamentSize(config.selection.tournamentSize),
+        _pause(pause),
+        _fittest(0),
+        _child(std::make_shared<const Genes>(seed.genes()), seed.genome()),
+        _generation(0),
+        _haveIncoming(false),
+        _conductor(_child),
+        _stop(false),
+        _bred(0),
+        _steps(Metrics::instance().counter("audiogene_steady_state_children_total",
+                "Children bred by the steady-state GA")),
+        _replacements(Metrics::instance().counter("audiogene_steady_state_replacements_total",
+                "Children that replaced the least fit individual")),
+        _preferencesReceived(Metrics::instance().counter("audiogene_preferences_dequeued_total",
+                "Preference updates taken from the audience queue")),
+        _generationGauge(Metrics::instance().gauge("audiogene_generation", "Current generation")),
+        _bestFitness(Metrics::instance().gauge("audiogene_fitness_best", "Fitness of the fittest individual")),
+        _worstFitness(Metrics::instance().gauge("audiogene_fitness_worst", "Fitness of the least fit individual")) {
+    if (config.size < 2) {
+        throw std::runtime_error("Need at least two individuals to breed from");
+    }
+    if (_tournamentSize < 1) {
+        throw std::runtime_error("Tournaments need at least one entrant");
+    }
+    _logger->info("Breeding {} individuals one at a time from {}", config.size, seed);
+    Genetics::create(_child.genes(), _child.mutableGenome());
+    _individuals.assign(config.size, _child);
+    _heap.resize(config.size);
+    std::iota(_heap.begin(), _heap.end(), 0);
+    _conductor = _child;
+
+    _breeder = std::thread([this] () { run(); });
+}
+
+SteadyState::~SteadyState() {
+    {
+        std::lock_guard<std::mutex> l(_wakeMutex);
+        _stop = true;
+    }
+    _wakeCV.notify_all();
+    _breeder.join();
+}
+
+void SteadyState::run() {
+    TRACE_THREAD_NAME("steady state");
+    {
+        // Nothing can be scored until the audience has said what it wants
+        std::unique_lock<std::mutex> l(_wakeMutex);
+        _wakeCV.wait(l, [this] () { return _stop || _haveIncoming; });
+        if (_stop) {
+            return;
+        }
+    }
+
+    while (true) {
+        {
+            TRACE_SCOPE("steady state batch");
+            std::lock_guard<std::mutex> l(_populationMutex);
+            if (_haveIncoming) {
+                applyPreferences();
+            }
+            for (size_t i = 0; i < STEADY_STATE_BATCH; i++) {
+                breed();
+            }
+        }
+
+        std::unique_lock<std::mutex> l(_wakeMutex);
+        if (_pause.count() > 0) {
+            _wakeCV.wait_for(l, _pause, [this] () { return _stop || _haveIncoming; });
+        }
+        if (_stop) {
+            return;
+        }
+        l.unlock();
+        // Let checkpoints and printing have the population between batches
+        std::this_thread::yield();
+    }
+}
+
+auto SteadyState::lessFit(const size_t lhs, const size_t rhs) const -> bool {
+    // std's heaps put the greatest on top, so the least fit compares greatest
+    return _individuals[lhs].fitness() > _individuals[rhs].fitness();
+}
+
+auto SteadyState::tournament() const -> size_t {
+    size_t winner = _math.uniformInt<size_t>(0, _individuals.size() - 1);
+    for (size_t i = 1; i < _tournamentSize; i++) {
+        const size_t entrant = _math.uniformInt<size_t>(0, _individuals.size() - 1);
+        if (_individuals[entrant].fitness() > _individuals[winner].fitness()) {
+            winner = entrant;
+        }
+    }
+    return winner;
+}
+
+void SteadyState::score(Individual* individual) const {
+    const Genes& genes = individual->genes();
+    const Genome& genome = individual->genome();
+    double total = 0;
+    for (size_t i = 0; i < genome.size(); i++) {
+        total += _math.similarity(_ideal[i], genome[i], genes[i].min, genes[i].max);
+    }
+    const double fitness = total / genome.size();
+    individual->setFitness(_reactions ? _reactions->blend(individual->id(), fitness) : fitness);
+}
+
+void SteadyState::breed() {
+    const Individual& first = _individuals[tournament()];
+    const Individual& second = _individuals[tournament()];
+    _genetics.combine(first.genome(), second.genome(), _child.mutableGenome());
+    _genetics.combineSteps(first.steps(), second.steps(), _child.mutableSteps());
+    _genetics.mutate(_child.genes(), _child.mutableGenome(), _child.mutableSteps());
+    _child.renew();
+    score(&_child);
+    _bred++;
+    _steps.increment();
+
+    const size_t worst = _heap.front();
+    if (_child.fitness() <= _individuals[worst].fitness()) {
+        return;
+    }
+    // Take the least fit off the heap, overwrite it, and sift it back in
+    std::pop_heap(_heap.begin(), _heap.end(), [this] (const size_t lhs, const size_t rhs) {
+        return lessFit(lhs, rhs);
+    });
+    _individuals[worst] = _child;
+    std::push_heap(_heap.begin(), _heap.end(), [this] (const size_t lhs, const size_t rhs) {
+        return lessFit(lhs, rhs);
+    });
+    _replacements.increment();
+
+    // Only the fittest can have been the least fit when everyone is equal
+    if (worst == _fittest || _child.fitness() > _individuals[_fittest].fitness()) {
+        _fittest = worst;
+        publish();
+    }
+}
+
+void SteadyState::applyPreferences() {
+    TRACE_SCOPE("steady state preferences");
+    {
+        std::lock_guard<std::mutex> l(_incomingMutex);
+        _audiencePreferences = _incoming;
+        _haveIncoming = false;
+    }
+    const Genes& genes = _child.genes();
+    _ideal.resize(genes.size());
+    for (size_t i = 0; i < genes.size(); i++) {
+        _ideal[i] = _audiencePreferences.at(genes[i].name).current;
+    }
+    rescore();
+}
+
+void SteadyState::rescore() {
+    for (Individual& individual : _individuals) {
+        score(&individual);
+    }
+    reheap();
+}
+
+void SteadyState::reheap() {
+    std::make_heap(_heap.begin(), _heap.end(), [this] (const size_t lhs, const size_t rhs) {
+        return lessFit(lhs, rhs);
+    });
+    _fittest = 0;
+    for (size_t i = 1; i < _individuals.size(); i++) {
+        if (_individuals[i].fitness() > _individuals[_fittest].fitness()) {
+            _fittest = i;
+        }
+    }
+    publish();
+}
+
+void SteadyState::publish() {
+    std::lock_guard<std::mutex> l(_conductorMutex);
+    _conductor = _individuals[_fittest];
+    _bestFitness.set(_conductor.fitness());
+}
+
+void SteadyState::setPreferences(const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>>& preferencesQueue) {
+    std::thread t([preferencesQueue, this] () {
+        TRACE_THREAD_NAME("preferences");
+        Preferences preferences;
+        while (true) {
+            TRACE_SCOPE("wait for audience");
+            preferencesQueue->wait_dequeue(preferences);
+            _preferencesReceived.increment();
+            setPreferences(preferences);
+        }
+    });
+    t.detach();
+}
+
+void SteadyState::setPreferences(const Preferences& preferences) {
+    {
+        std::lock_guard<std::mutex> l(_incomingMutex);
+        _incoming = preferences;
+    }
+    {
+        // Under the wake lock so a breeder about to wait can't miss it
+        std::lock_guard<std::mutex> l(_wakeMutex);
+        _haveIncoming = true;
+    }
+    _wakeCV.notify_all();
+}
+
+void SteadyState::nextGeneration() {
+    std::lock_guard<std::mutex> l(_populationMutex);
+    _generation++;
+    _generationGauge.set(_generation);
+    _worstFitness.set(_individuals[_heap.front()].fitness());
+}
+
+auto SteadyState::fittest() -> Individual {
+    std::lock_guard<std::mutex> l(_conductorMutex);
+    return _conductor;
+}
+
+auto SteadyState::generation() const -> uint32_t {
+    std::lock_guard<std::mutex> l(_populationMutex);
+    return _generation;
+}
+
+auto SteadyState::diversity() const -> double {
+    std::lock_guard<std::mutex> l(_populationMutex);
+    return audiogene::diversity(_individuals);
+}
+
+auto SteadyState::steps() const -> uint64_t {
+    return _bred;
+}
+
+auto SteadyState::checkpoint() const -> Checkpoint {
+    TRACE_SCOPE("checkpoint");
+    std::lock_guard<std::mutex> l(_populationMutex);
+    Checkpoint checkpoint;
+    checkpoint.generation = _generation;
+    for (const Gene& gene : _child.genes()) {
+        checkpoint.genes.push_back(gene.name);
+    }
+    // Fittest first, as a generational population would save them
+    std::vector<size_t> order(_individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this] (const size_t lhs, const size_t rhs) {
+        return _individuals[lhs].fitness() > _individuals[rhs].fitness();
+    });
+    checkpoint.genomes.reserve(_individuals.size() * checkpoint.genes.size());
+    for (const size_t i : order) {
+        const Individual& individual = _individuals[i];
+        checkpoint.genomes.insert(checkpoint.genomes.end(), individual.genome().begin(), individual.genome().end());
+        checkpoint.fitness.push_back(individual.fitness());
+    }
+    checkpoint.preferences = _audiencePreferences;
+    checkpoint.populationRng = _math.state();
+    checkpoint.geneticsRng = _genetics.rngState();
+    return checkpoint;
+}
+
+void SteadyState::restore(const Checkpoint& checkpoint) {
+    {
+        std::lock_guard<std::mutex> l(_populationMutex);
+        const Genes& genes = _child.genes();
+        if (checkpoint.genes.size() != genes.size()) {
+            throw std::runtime_error("Checkpoint genes don't match configured genes");
+        }
+        std::vector<size_t> order;
+        for (const Gene& gene : genes) {
+            const auto it = std::find(checkpoint.genes.begin(), checkpoint.genes.end(), gene.name);
+            if (it == checkpoint.genes.end() || checkpoint.preferences.count(gene.name) == 0) {
+                throw std::runtime_error("Gene " + gene.name + " isn't in the checkpoint");
+            }
+            order.push_back(std::distance(checkpoint.genes.begin(), it));
+        }
+        const size_t restored = std::min(checkpoint.fitness.size(), _individuals.size());
+        if (restored == 0) {
+            throw std::runtime_error("Checkpoint has no individuals");
+        }
+
+        const size_t geneCount = genes.size();
+        for (size_t i = 0; i < _individuals.size(); i++) {
+            const size_t from = i % restored;
+            Individual& individual = _individuals[i];
+            for (size_t g = 0; g < geneCount; g++) {
+                (*individual.mutableGenome())[g] = checkpoint.genomes[from * geneCount + order[g]];
+            }
+            std::fill(individual.mutableSteps()->begin(), individual.mutableSteps()->end(), INITIAL_STEP);
+            individual.setFitness(checkpoint.fitness[from]);
+            individual.renew();
+        }
+        _generation = checkpoint.generation;
+        _math.restore(checkpoint.populationRng);
+        _genetics.restoreRng(checkpoint.geneticsRng);
+        reheap();
+        _logger->info("Restored {} individuals at generation {}", restored, _generation);
+    }
+    // The breeder scores everyone against the saved preferences before breeding again
+    setPreferences(checkpoint.preferences);
+}
+
+void SteadyState::warmStart(const Individuals& seeds, const Preferences& preferences) {
+    size_t seeded;
+    {
+        std::lock_guard<std::mutex> l(_populationMutex);
+        seeded = std::min(seeds.size(), _individuals.size());
+        for (size_t i = 0; i < seeded; i++) {
+            Individual& individual = _individuals[i];
+            *individual.mutableGenome() = seeds[i].genome();
+            Genetics::create(individual.genes(), individual.mutableGenome());
+            std::fill(individual.mutableSteps()->begin(), individual.mutableSteps()->end(), INITIAL_STEP);
+            individual.setFitness(0);
+            individual.renew();
+        }
+        reheap();
+    }
+    _logger->info("Warm started {} of {} individuals", seeded, _individuals.size());
+    // The breeder scores everyone against these before breeding from them
+    setPreferences(preferences);
+}
+
+void SteadyState::setReactions(const std::shared_ptr<const Reactions>& reactions) {
+    std::lock_guard<std::mutex> l(_populationMutex);
+    _reactions = reactions;
+}
+
+void SteadyState::print(std::ostream& os) const {
+    std::lock_guard<std::mutex> l(_populationMutex);
+    os << "Steady state of " << _individuals.size() << " after " << _bred << " children\n";
+    os << "\tFittest " << _individuals[_fittest] << std::endl;
+}
+
+}  // namespace audiogene
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "surrogate.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace audiogene {
+
+Surrogate::Surrogate(const SurrogateConfig& config, const Individual& seed):
+        _logger(spdlog::get("log")),
+        _genes(seed.genes()),
+        _forgetting(config.forgetting),
+        _weight(config.weight),
+        _candidates(config.candidates),
+        _features(1 + 2 * seed.genes().size()),
+        _weights(_features, 0.0),
+        _P(_features * _features, 0.0),
+        _observations(0),
+        _error(0),
+        _x(_features),
+        _Px(_features),
+        _updateDuration(Metrics::instance().histogram("audiogene_surrogate_update_us",
+                "Time to teach the surrogate the audience's response to a conductor")),
+        _screenDuration(Metrics::instance().histogram("audiogene_surrogate_screen_us",
+                "Time for the surrogate to screen the candidates for a conductor")),
+        _errorGauge(Metrics::instance().gauge("audiogene_surrogate_error",
+                "Recent mean absolute error of the surrogate's predicted audience response")),
+        _observed(Metrics::instance().counter("audiogene_surrogate_observations_total",
+                "Audience responses the surrogate has learned from")),
+        _picked(Metrics::instance().counter("audiogene_surrogate_conductors_total",
+                "Conductors the surrogate picked over the optimizer's fittest")) {
+    if (_forgetting <= 0 || _forgetting > 1) {
+        throw std::runtime_error("Surrogate forgetting must be over 0 and at most 1");
+    }
+    for (size_t i = 0; i < _features; i++) {
+        _P[i * _features + i] = SURROGATE_PRIOR;
+    }
+    _logger->info("Screening {} candidates with a surrogate of {} weights", _candidates, _features);
+}
+
+void Surrogate::featuresOf(const Genome& genome, double* x) const noexcept {
+    x[0] = 1;
+    for (size_t i = 0; i < _genes.size(); i++) {
+        const double u = (genome[i] - _genes[i].min) / (_genes[i].max - _genes[i].min);
+        x[1 + 2 * i] = u;
+        x[2 + 2 * i] = u * u;
+    }
+}
+
+void Surrogate::observe(const Individual& conductor, const Preferences& before, const Preferences& after) {
+    ScopedTimer updateTimer(_updateDuration);
+    double response = 0;
+    for (const Gene& gene : _genes) {
+        response -= std::abs(after.at(gene.name).current - before.at(gene.name).current) / (gene.max - gene.min);
+    }
+    response /= _genes.size();
+
+    featuresOf(conductor.genome(), _x.data());
+    double predicted = 0;
+    for (size_t i = 0; i < _features; i++) {
+        predicted += _weights[i] * _x[i];
+    }
+    const double residual = response - predicted;
+    _error = _observations == 0 ? std::abs(residual)
+                                : _forgetting * _error + (1 - _forgetting) * std::abs(residual);
+
+    // Px, and the gain's denominator; P is symmetric, so x'P is Px too
+    double denominator = _forgetting;
+    for (size_t i = 0; i < _features; i++) {
+        double sum = 0;
+        const double* row = &_P[i * _features];
+        for (size_t j = 0; j < _features; j++) {
+            sum += row[j] * _x[j];
+        }
+        _Px[i] = sum;
+        denominator += _x[i] * sum;
+    }
+    for (size_t i = 0; i < _features; i++) {
+        _weights[i] += _Px[i] * residual / denominator;
+    }
+    for (size_t i = 0; i < _features; i++) {
+        double* row = &_P[i * _features];
+        for (size_t j = 0; j < _features; j++) {
+            row[j] = (row[j] - _Px[i] * _Px[j] / denominator) / _forgetting;
+        }
+    }
+
+    _observations++;
+    _observed.increment();
+    _errorGauge.set(_error);
+}
+
+auto Surrogate::predict(const Genome& genome) const noexcept -> double {
+    double predicted = _weights[0];
+    for (size_t i = 0; i < _genes.size(); i++) {
+        const double u = (genome[i] - _genes[i].min) / (_genes[i].max - _genes[i].min);
+        predicted += (_weights[1 + 2 * i] + _weights[2 + 2 * i] * u) * u;
+    }
+    return predicted;
+}
+
+auto Surrogate::screen(const Individuals& candidates, Individual* conductor) -> bool {
+    // Too few observations to fit every weight, so it would only be guessing
+    if (_observations < _features) {
+        return false;
+    }
+    ScopedTimer screenTimer(_screenDuration);
+    double best = conductor->fitness() + _weight * predict(conductor->genome());
+    const Individual* pick = nullptr;
+    for (const Individual& candidate : candidates) {
+        const double score = candidate.fitness() + _weight * predict(candidate.genome());
+        if (score > best) {
+            best = score;
+            pick = &candidate;
+        }
+    }
+    if (pick == nullptr) {
+        return false;
+    }
+    *conductor = *pick;
+    _picked.increment();
+    return true;
+}
+
+auto Surrogate::candidates() const noexcept -> size_t {
+    return _candidates;
+}
+
+auto Surrogate::error() const noexcept -> double {
+    return _error;
+}
+
+}  // namespace audiogene
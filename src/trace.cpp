@@ -0,0 +1,178 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "trace.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace audiogene {
+namespace trace {
+
+namespace {
+
+std::mutex s_registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> s_buffers;  // NOLINT
+
+auto registerThread() -> std::shared_ptr<ThreadBuffer> {
+    std::lock_guard<std::mutex> l(s_registryMutex);
+    s_buffers.push_back(std::make_shared<ThreadBuffer>(s_buffers.size() + 1));
+    return s_buffers.back();
+}
+
+void writeMicroseconds(std::ostream& out, const uint64_t ns) {
+    out << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000;
+}
+
+}  // namespace
+
+ThreadBuffer::ThreadBuffer(const uint32_t tid):
+        _slots(TRACE_BUFFER_EVENTS),
+        _claimed(0),
+        _published(0),
+        _tid(tid),
+        _name(nullptr) {
+    // empty constructor
+}
+
+auto ThreadBuffer::events() const -> std::vector<Event> {
+    const uint64_t published = _published.load(std::memory_order_acquire);
+    const uint64_t first = published > _slots.size() ? published - _slots.size() : 0;
+    std::vector<Event> events;
+    events.reserve(published - first);
+    for (uint64_t i = first; i < published; i++) {
+        const Slot& slot = _slots[i % _slots.size()];
+        events.push_back(Event{
+                slot.name.load(std::memory_order_relaxed),
+                slot.startNs.load(std::memory_order_relaxed),
+                slot.durationNs.load(std::memory_order_relaxed)});
+    }
+    // Any slot the owner claimed again while we copied may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = _claimed.load(std::memory_order_relaxed);
+    const uint64_t torn = claimed > first + _slots.size() ? claimed - first - _slots.size() : 0;
+    events.erase(events.begin(), events.begin() + std::min<uint64_t>(torn, events.size()));
+    return events;
+}
+
+auto now() noexcept -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+auto threadBuffer() -> ThreadBuffer& {
+    // Buffers are shared with the registry so they outlive their thread
+    static thread_local std::shared_ptr<ThreadBuffer> buffer = registerThread();
+    return *buffer;
+}
+
+void setThreadName(const char* name) {
+    threadBuffer().name(name);
+}
+
+auto write(const std::string& path) -> bool {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> l(s_registryMutex);
+        buffers = s_buffers;
+    }
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const std::shared_ptr<ThreadBuffer>& buffer : buffers) {
+            if (buffer->name() != nullptr) {
+                out << (first ? "" : ",\n");
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid()
+                    << ",\"args\":{\"name\":\"" << buffer->name() << "\"}}";
+                first = false;
+            }
+            for (const Event& event : buffer->events()) {
+                out << (first ? "" : ",\n");
+                out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid() << ",\"ts\":";
+                writeMicroseconds(out, event.startNs);
+                out << ",\"dur\":";
+                writeMicroseconds(out, event.durationNs);
+                out << "}";
+                first = false;
+            }
+            if (buffer->overwritten() > 0) {
+                out << (first ? "" : ",\n");
+                out << "{\"name\":\"overwritten events\",\"ph\":\"C\",\"pid\":1,\"tid\":" << buffer->tid() << ",\"ts\":";
+                writeMicroseconds(out, now());
+                out << ",\"args\":{\"overwritten\":" << buffer->overwritten() << "}}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+Exporter::Exporter(std::string path, const std::chrono::seconds interval):
+        _logger(spdlog::get("log")),
+        _path(std::move(path)),
+        _interval(interval),
+        _stop(false) {
+#ifndef AUDIOGENE_TRACING
+    _logger->warn("Tracing was not compiled in; {} will be empty", _path);
+#endif
+    _logger->info("Writing trace to {} every {}s", _path, _interval.count());
+    _thread = std::thread([this] () {
+        std::unique_lock<std::mutex> l(_stopMutex);
+        while (!_stopCV.wait_for(l, _interval, [this] () { return _stop; })) {
+            if (!write(_path)) {
+                _logger->warn("Failed to write trace to {}", _path);
+            }
+        }
+    });
+}
+
+Exporter::~Exporter() {
+    {
+        std::lock_guard<std::mutex> l(_stopMutex);
+        _stop = true;
+    }
+    _stopCV.notify_all();
+    _thread.join();
+    write(_path);
+}
+
+}  // namespace trace
+}  // namespace audiogene
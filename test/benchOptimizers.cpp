@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "cmaes.hpp"
+#include "genetics.hpp"
+#include "genome.hpp"
+#include "individual.hpp"
+#include "optimizer.hpp"
+#include "population.hpp"
+#include "preference.hpp"
+
+// Count the conductors each optimizer has to score before its fittest is
+// within reach of fixed audience preferences.
+// Usage: runOptimizerBenchmarks
+
+namespace audiogene {
+
+constexpr size_t RUNS = 10;
+constexpr double TARGET_FITNESS = 0.999;
+constexpr uint64_t MAX_EVALUATIONS = 200000;
+constexpr size_t GA_POPULATION = 96;
+constexpr size_t GA_TOP_N = 24;
+constexpr double MUTATION_PROBABILITY = 0.05;
+
+auto makeSeed(const size_t genes, Preferences* preferences) -> Individual {
+    auto g = std::make_shared<Genes>();
+    Genome genome;
+    for (size_t i = 0; i < genes; i++) {
+        const std::string name = "gene" + std::to_string(i);
+        g->emplace_back(name, Expression(0, 100, 50, false, ExpressionActivates::OnBar));
+        genome.push_back(50);
+        preferences->emplace(name, Preference(0, 100, 5 + 90.0 * i / genes));
+    }
+    return Individual(g, genome);
+}
+
+/*! Evaluations until the target, averaged over RUNS */
+auto evaluationsToTarget(const std::function<std::unique_ptr<Optimizer>()>& make, const uint64_t perGeneration,
+                         const Preferences& preferences) -> double {
+    uint64_t total = 0;
+    for (size_t run = 0; run < RUNS; run++) {
+        std::unique_ptr<Optimizer> optimizer = make();
+        optimizer->setPreferences(preferences);
+        uint64_t evaluations = 0;
+        do {
+            optimizer->nextGeneration();
+            evaluations += perGeneration;
+        } while (optimizer->fittest().fitness() < TARGET_FITNESS && evaluations < MAX_EVALUATIONS);
+        total += evaluations;
+    }
+    return static_cast<double>(total) / RUNS;
+}
+
+void benchmark(const size_t genes) {
+    Preferences preferences;
+    const Individual seed = makeSeed(genes, &preferences);
+
+    const PopulationConfig fixed(GA_POPULATION, GA_TOP_N, MUTATION_PROBABILITY);
+    PopulationConfig adaptive(fixed);
+    adaptive.mutation.selfAdaptive = true;
+    const uint64_t offspring = GA_POPULATION - GA_TOP_N;
+    const double gaFixed = evaluationsToTarget([&seed, &fixed] () {
+        return std::make_unique<Population>(fixed, seed);
+    }, offspring, preferences);
+    const double gaAdaptive = evaluationsToTarget([&seed, &adaptive] () {
+        return std::make_unique<Population>(adaptive, seed);
+    }, offspring, preferences);
+
+    const CMAES probe(seed, 0, CMAES_SIGMA);
+    const uint64_t lambda = probe.lambda();
+    const double cmaes = evaluationsToTarget([&seed] () {
+        return std::make_unique<CMAES>(seed, 0, CMAES_SIGMA);
+    }, lambda, preferences);
+
+    std::cout << genes << "\t" << gaFixed << "\t" << gaAdaptive << "\t" << cmaes << std::endl;
+}
+
+}  // namespace audiogene
+
+int main() {
+    spdlog::create<spdlog::sinks::null_sink_mt>("log");
+    std::cout << "genes\tGA\tGA self-adaptive\tCMA-ES" << std::endl;
+    for (const size_t genes : {3, 8, 16}) {
+        audiogene::benchmark(genes);
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "niching.hpp"
+#include "population.hpp"
+#include "preference.hpp"
+
+// Time a generation as the population grows, to check it stays linear, then
+// count the generations each mutation scheme needs to catch up with the audience
+// after its preferences jump, and how spread out each niching method keeps the
+// population.
+// Usage: runBenchmarks [largest population, default 1000000]
+
+namespace audiogene {
+
+constexpr size_t GENE_COUNT = 8;
+constexpr size_t GENERATIONS = 5;
+constexpr double MUTATION_PROBABILITY = 0.05;
+constexpr size_t RECOVERY_POPULATION = 96;
+constexpr size_t RECOVERY_TOP_N = 24;
+constexpr size_t RECOVERY_RUNS = 10;
+constexpr size_t SETTLE_GENERATIONS = 30;
+constexpr size_t MAX_RECOVERY_GENERATIONS = 300;
+constexpr double RECOVERED_FITNESS = 0.99;
+
+auto makeSeed(Preferences* preferences) -> Individual {
+    auto genes = std::make_shared<Genes>();
+    Genome genome;
+    for (size_t i = 0; i < GENE_COUNT; i++) {
+        const std::string name = "gene" + std::to_string(i);
+        genes->emplace_back(name, Expression(0, 100, 50, false, ExpressionActivates::OnBar));
+        genome.push_back(50);
+        preferences->emplace(name, Preference(0, 100, 10 * i));
+    }
+    return Individual(genes, genome);
+}
+
+void benchmark(const size_t n, const Individual& seed, const Preferences& preferences) {
+    Population population(PopulationConfig(n, std::max<size_t>(2, n / 3), MUTATION_PROBABILITY), seed);
+    population.setPreferences(preferences);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < GENERATIONS; i++) {
+        population.nextGeneration();
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    // The audience moves one gene; only that gene is scored again
+    Preferences moved(preferences);
+    moved.begin()->second.current += 1;
+    const auto changeStart = std::chrono::steady_clock::now();
+    population.setPreferences(moved);
+    const auto change = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - changeStart).count();
+
+    // Two generations are kept, each individual owning its genome, step sizes and scores
+    const size_t bytes = 2 * (sizeof(Individual) + 3 * GENE_COUNT * sizeof(double));
+    std::cout << n << "\t" << elapsed / GENERATIONS << "\t"
+              << static_cast<double>(elapsed) / GENERATIONS / n * 1000 << "\t"
+              << change << "\t" << bytes << std::endl;
+}
+
+void nearest(const size_t n, const Individual& seed, const Preferences& preferences) {
+    PopulationConfig config(n, std::max<size_t>(2, n / 3), MUTATION_PROBABILITY);
+    config.spatialIndex = true;
+    Population population(config, seed);
+    population.setPreferences(preferences);
+
+    const auto start = std::chrono::steady_clock::now();
+    population.nextGeneration();
+    const auto generation = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    Preferences moved(preferences);
+    moved.begin()->second.current += 1;
+    const auto changeStart = std::chrono::steady_clock::now();
+    population.setPreferences(moved);
+    const auto change = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - changeStart).count();
+    std::cout << n << "\t" << generation << "\t" << change / 1000.0 << std::endl;
+}
+
+void recovery(const std::string& name, const MutationConfig& mutation, const Individual& seed,
+              const Preferences& before) {
+    Preferences after(before);
+    for (auto& kv : after) {
+        kv.second.current = 100 - kv.second.current;
+    }
+
+    size_t total = 0;
+    for (size_t run = 0; run < RECOVERY_RUNS; run++) {
+        PopulationConfig config(RECOVERY_POPULATION, RECOVERY_TOP_N, MUTATION_PROBABILITY);
+        config.mutation = mutation;
+        Population population(config, seed);
+        population.setPreferences(before);
+        for (size_t i = 0; i < SETTLE_GENERATIONS; i++) {
+            population.nextGeneration();
+        }
+        population.setPreferences(after);
+        size_t generations = 0;
+        do {
+            population.nextGeneration();
+            generations++;
+        } while (population.fitness() < RECOVERED_FITNESS && generations < MAX_RECOVERY_GENERATIONS);
+        total += generations;
+    }
+    std::cout << name << "\t" << static_cast<double>(total) / RECOVERY_RUNS << std::endl;
+}
+
+void niching(const std::string& name, const NichingMethod method, const Individual& seed,
+             const Preferences& preferences) {
+    PopulationConfig config(RECOVERY_POPULATION, RECOVERY_TOP_N, MUTATION_PROBABILITY);
+    config.niching.method = method;
+    Population population(config, seed);
+    population.setPreferences(preferences);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SETTLE_GENERATIONS; i++) {
+        population.nextGeneration();
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    std::cout << name << "\t" << elapsed / SETTLE_GENERATIONS << "\t" << population.fitness() << "\t"
+              << population.diversity() << std::endl;
+}
+
+}  // namespace audiogene
+
+int main(int argc, char* argv[]) {
+    spdlog::create<spdlog::sinks::null_sink_mt>("log");
+    const size_t largest = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    audiogene::Preferences preferences;
+    const audiogene::Individual seed = audiogene::makeSeed(&preferences);
+
+    std::cout << "individuals\tus/generation\tns/individual\tus/preference change\tbytes/individual" << std::endl;
+    for (size_t n = 100; n <= largest; n *= 10) {
+        audiogene::benchmark(n, seed, preferences);
+    }
+
+    std::cout << std::endl << "indexed individuals\tus/generation\tus/preference change" << std::endl;
+    for (size_t n = 100; n <= largest; n *= 10) {
+        audiogene::nearest(n, seed, preferences);
+    }
+
+    audiogene::MutationConfig fixed(audiogene::MUTATION_PROBABILITY);
+    audiogene::MutationConfig selfAdaptive(fixed);
+    selfAdaptive.selfAdaptive = true;
+    audiogene::MutationConfig oneFifth(fixed);
+    oneFifth.oneFifthRule = true;
+    audiogene::MutationConfig both(selfAdaptive);
+    both.oneFifthRule = true;
+
+    std::cout << std::endl << "mutation\tgenerations to recover" << std::endl;
+    audiogene::recovery("fixed", fixed, seed, preferences);
+    audiogene::recovery("self-adaptive", selfAdaptive, seed, preferences);
+    audiogene::recovery("1/5th rule", oneFifth, seed, preferences);
+    audiogene::recovery("both", both, seed, preferences);
+
+    std::cout << std::endl << "niching\tus/generation\tbest fitness\tdiversity" << std::endl;
+    audiogene::niching("none", audiogene::NichingMethod::None, seed, preferences);
+    audiogene::niching("crowding", audiogene::NichingMethod::Crowding, seed, preferences);
+    audiogene::niching("sharing", audiogene::NichingMethod::Sharing, seed, preferences);
+    audiogene::niching("clearing", audiogene::NichingMethod::Clearing, seed, preferences);
+    return 0;
+}
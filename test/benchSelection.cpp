@@ -0,0 +1,126 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "selection.hpp"
+
+// Compare the cost of each selection strategy with the pressure it applies.
+// Intensity is how many standard deviations fitter than average the chosen
+// parents are; diversity is the fraction of the population chosen at least once.
+// Usage: runSelectionBenchmarks [population size, default 10000]
+
+namespace audiogene {
+
+constexpr size_t TOP_FRACTION = 3;
+
+void benchmark(const std::string& name, const SelectionConfig& config, Individuals* individuals, const Math& math) {
+    const size_t n = individuals->size();
+    const size_t topN = n / TOP_FRACTION;
+    const size_t draws = 2 * (n - topN);
+
+    // Truncation relies on the fittest being at the front
+    std::sort(individuals->begin(), individuals->end(), [] (const Individual& lhs, const Individual& rhs) {
+        return lhs.fitness() > rhs.fitness();
+    });
+    std::vector<double> fitness;
+    double mean = 0;
+    for (const Individual& individual : *individuals) {
+        fitness.push_back(individual.fitness());
+        mean += individual.fitness();
+    }
+    mean /= n;
+    double variance = 0;
+    for (const Individual& individual : *individuals) {
+        variance += (individual.fitness() - mean) * (individual.fitness() - mean);
+    }
+    const double stddev = std::sqrt(variance / n);
+
+    std::unique_ptr<Selection> selection = Selection::create(config, topN);
+    std::vector<bool> chosen(n, false);
+    double chosenFitness = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    selection->prepare(fitness, draws, math);
+    const auto prepared = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < draws / 2; i++) {
+        const std::pair<size_t, size_t> parents = selection->parents(math);
+        chosenFitness += (*individuals)[parents.first].fitness() + (*individuals)[parents.second].fitness();
+        chosen[parents.first] = true;
+        chosen[parents.second] = true;
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const auto prepareUs = std::chrono::duration_cast<std::chrono::microseconds>(prepared - start).count();
+    const auto drawNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - prepared).count();
+    size_t distinct = 0;
+    for (const bool c : chosen) {
+        distinct += c;
+    }
+    std::cout << name << "\t" << prepareUs << "\t"
+              << static_cast<double>(drawNs) / draws << "\t"
+              << (chosenFitness / draws - mean) / stddev << "\t"
+              << static_cast<double>(distinct) / n << std::endl;
+}
+
+}  // namespace audiogene
+
+int main(int argc, char* argv[]) {
+    using audiogene::SelectionConfig;
+    using audiogene::SelectionStrategy;
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+
+    const audiogene::Math math;
+    auto genes = std::make_shared<const audiogene::Genes>();
+    audiogene::Individuals individuals;
+    individuals.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        individuals.emplace_back(genes, audiogene::Genome());
+        individuals.back().setFitness(math.uniformReal(0.0, 1.0));
+    }
+
+    std::cout << "strategy\tprepare us\tns/draw\tintensity\tdiversity" << std::endl;
+    const std::vector<std::pair<std::string, SelectionStrategy>> strategies = {
+        {"truncation", SelectionStrategy::Truncation},
+        {"tournament", SelectionStrategy::Tournament},
+        {"roulette", SelectionStrategy::Roulette},
+        {"sus", SelectionStrategy::StochasticUniversal},
+        {"rank", SelectionStrategy::Rank},
+    };
+    for (const auto& strategy : strategies) {
+        SelectionConfig config;
+        config.strategy = strategy.second;
+        audiogene::benchmark(strategy.first, config, &individuals, math);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "archipelago.hpp"
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+
+namespace audiogene {
+
+TEST(ArchipelagoTest, RestoredIslandsDrawIndependently) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}}});
+    const PopulationConfig island(16, 4, 0.5);
+    Archipelago archipelago(2, island, seed, 0, 1, MigrationTopology::Ring);
+
+    // Both islands start from the same single individual and the same saved random state
+    Math math;
+    Checkpoint checkpoint;
+    checkpoint.generation = 7;
+    checkpoint.genes = {"energy"};
+    checkpoint.genomes = {100};
+    checkpoint.fitness = {0.5};
+    checkpoint.preferences.emplace("energy", Preference(0, 255, 200));
+    checkpoint.populationRng = math.state();
+    checkpoint.geneticsRng = math.state();
+    archipelago.restore(checkpoint);
+    archipelago.nextGeneration();
+
+    const Individuals sample = archipelago.sample(2 * island.size);
+    ASSERT_EQ(sample.size(), 2 * island.size);
+    size_t same = 0;
+    for (size_t i = 0; i < island.size; i++) {
+        same += sample[i].genome() == sample[island.size + i].genome() ? 1 : 0;
+    }
+    // The kept fittest are copies of the restored individual on both islands; the children aren't
+    ASSERT_LT(same, island.size);
+    ASSERT_EQ(archipelago.generation(), 8u);
+}
+
+TEST(ArchipelagoTest, RestoredIslandsKeepTheirOwnIndividuals) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}}});
+    const PopulationConfig island(16, 4, 0.5);
+    Archipelago archipelago(2, island, seed, 0, 1, MigrationTopology::Ring);
+
+    // Each island settled somewhere different before the checkpoint
+    Math math;
+    Checkpoint checkpoint;
+    checkpoint.generation = 7;
+    checkpoint.genes = {"energy"};
+    checkpoint.genomes = {10, 10, 10, 200, 200};
+    checkpoint.fitness = {0.5, 0.5, 0.5, 0.5, 0.5};
+    checkpoint.islands = {3, 2};
+    checkpoint.preferences.emplace("energy", Preference(0, 255, 200));
+    checkpoint.populationRng = math.state();
+    checkpoint.geneticsRng = math.state();
+    archipelago.restore(checkpoint);
+
+    const Checkpoint restored = archipelago.checkpoint();
+    ASSERT_EQ(restored.islands, std::vector<uint64_t>({island.size, island.size}));
+    for (size_t i = 0; i < island.size; i++) {
+        ASSERT_EQ(restored.genomes[i], 10);
+        ASSERT_EQ(restored.genomes[island.size + i], 200);
+    }
+}
+
+TEST(ArchipelagoTest, IslandsHearEveryPreferenceFromALiveQueue) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}}});
+    const PopulationConfig island(16, 4, 0.5);
+    Archipelago archipelago(2, island, seed, 0, 1, MigrationTopology::Ring);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    archipelago.setPreferences(queue);
+
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, 200));
+    queue->enqueue(preferences);
+    const auto start = std::chrono::steady_clock::now();
+    for (int generation = 0; generation < 3; generation++) {
+        archipelago.nextGeneration();
+    }
+    // Nobody waits for preferences once they've heard some
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(PREFERENCES_WAIT_FOR_S));
+    ASSERT_EQ(archipelago.generation(), 3u);
+    for (const Individual& individual : archipelago.sample(2 * island.size)) {
+        ASSERT_GT(individual.fitness(), 0);
+    }
+}
+
+TEST(ArchipelagoTest, DeadlinesAreNotSpentWaitingForPreferences) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}}});
+    const PopulationConfig island(16, 4, 0.5);
+    Archipelago archipelago(2, island, seed, 0, 1, MigrationTopology::Ring);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    archipelago.setPreferences(queue);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    ASSERT_FALSE(archipelago.advance(deadline));
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline - std::chrono::seconds(1));
+    ASSERT_EQ(archipelago.generation(), 0u);
+}
+
+}  // namespace audiogene
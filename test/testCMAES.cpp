@@ -0,0 +1,200 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockingqueue.hpp"
+#include "checkpoint.hpp"
+#include "cmaes.hpp"
+#include "genome.hpp"
+#include "individual.hpp"
+#include "preference.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t GENES = 4;
+constexpr double TARGET_FITNESS = 0.99;
+constexpr uint32_t MAX_GENERATIONS = 500;
+
+auto makeSeed() -> Individual {
+    auto genes = std::make_shared<Genes>();
+    Genome genome;
+    for (size_t i = 0; i < GENES; i++) {
+        genes->emplace_back("gene" + std::to_string(i), Expression(0, 100, 50, false, ExpressionActivates::OnBar));
+        genome.push_back(50);
+    }
+    return Individual(genes, genome);
+}
+
+auto preferences(const double offset) -> Preferences {
+    Preferences preferences;
+    for (size_t i = 0; i < GENES; i++) {
+        preferences.emplace("gene" + std::to_string(i), Preference(0, 100, offset + 10.0 * i));
+    }
+    return preferences;
+}
+
+/*! Generations until the fittest reaches the target, or MAX_GENERATIONS */
+auto evolve(CMAES* cmaes) -> uint32_t {
+    uint32_t generations = 0;
+    while (cmaes->fittest().fitness() < TARGET_FITNESS && generations < MAX_GENERATIONS) {
+        cmaes->nextGeneration();
+        generations++;
+    }
+    return generations;
+}
+
+}  // namespace
+
+TEST(CMAESTest, JacobiDiagonalizesASymmetricMatrix) {
+    // Eigenvalues 2 - sqrt(2), 2 and 2 + sqrt(2)
+    const size_t n = 3;
+    const std::vector<double> original = {2, -1, 0, -1, 2, -1, 0, -1, 2};
+    std::vector<double> a(original);
+    std::vector<double> v(n * n);
+    jacobi(n, &a, &v);
+
+    std::vector<double> eigenvalues = {a[0], a[4], a[8]};
+    std::sort(eigenvalues.begin(), eigenvalues.end());
+    ASSERT_NEAR(eigenvalues[0], 2 - std::sqrt(2.0), 1e-9);
+    ASSERT_NEAR(eigenvalues[1], 2, 1e-9);
+    ASSERT_NEAR(eigenvalues[2], 2 + std::sqrt(2.0), 1e-9);
+
+    // Each column of v is a unit eigenvector of the original matrix
+    for (size_t k = 0; k < n; k++) {
+        double norm = 0;
+        for (size_t i = 0; i < n; i++) {
+            double av = 0;
+            for (size_t j = 0; j < n; j++) {
+                av += original[i * n + j] * v[j * n + k];
+            }
+            ASSERT_NEAR(av, a[k * n + k] * v[i * n + k], 1e-9);
+            norm += v[i * n + k] * v[i * n + k];
+        }
+        ASSERT_NEAR(norm, 1, 1e-9);
+    }
+}
+
+TEST(CMAESTest, ReachesFixedPreferences) {
+    CMAES cmaes(makeSeed(), 0, CMAES_SIGMA);
+    cmaes.setPreferences(preferences(20));
+    ASSERT_LT(evolve(&cmaes), MAX_GENERATIONS);
+    ASSERT_GE(cmaes.fittest().fitness(), TARGET_FITNESS);
+    // Converging narrows the search
+    ASSERT_LT(cmaes.sigma(), CMAES_SIGMA);
+}
+
+TEST(CMAESTest, SearchesWidelyAgainWhenPreferencesShift) {
+    CMAES cmaes(makeSeed(), 0, CMAES_SIGMA);
+    cmaes.setPreferences(preferences(20));
+    evolve(&cmaes);
+    for (int i = 0; i < 40; i++) {
+        cmaes.nextGeneration();
+    }
+    const double converged = cmaes.sigma();
+    ASSERT_LT(converged, CMAES_SIGMA / 10);
+
+    // A move within CMAES_RESTART_SHIFT keeps the learned distribution
+    cmaes.setPreferences(preferences(20 + 100 * CMAES_RESTART_SHIFT / 2));
+    cmaes.nextGeneration();
+    ASSERT_LT(cmaes.sigma(), CMAES_SIGMA / 10);
+
+    // One beyond it starts wide again
+    cmaes.setPreferences(preferences(20 + 100 * CMAES_RESTART_SHIFT * 3));
+    cmaes.nextGeneration();
+    ASSERT_GT(cmaes.sigma(), CMAES_SIGMA / 2);
+    ASSERT_LT(evolve(&cmaes), MAX_GENERATIONS);
+}
+
+TEST(CMAESTest, GenerationsTakePreferencesFromALiveQueue) {
+    CMAES cmaes(makeSeed(), 0, CMAES_SIGMA);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    cmaes.setPreferences(queue);
+
+    // The first generation waits for the audience; the ones after keep their preferences
+    std::thread audience([queue] () {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        queue->enqueue(preferences(20));
+    });
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_LT(evolve(&cmaes), MAX_GENERATIONS);
+    audience.join();
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+    // Only the newest of several waiting are played to
+    queue->enqueue(preferences(25));
+    queue->enqueue(preferences(20 + 100 * CMAES_RESTART_SHIFT * 3));
+    cmaes.nextGeneration();
+    ASSERT_GT(cmaes.sigma(), CMAES_SIGMA / 2);
+    ASSERT_EQ(queue->size_approx(), 0u);
+}
+
+TEST(CMAESTest, DeadlinesAreNotSpentWaitingForPreferences) {
+    CMAES cmaes(makeSeed(), 0, CMAES_SIGMA);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    cmaes.setPreferences(queue);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    ASSERT_FALSE(cmaes.advance(deadline));
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline - std::chrono::seconds(1));
+    ASSERT_EQ(cmaes.generation(), 0u);
+
+    // Every generation of a request after the first plays to the same preferences
+    queue->enqueue(preferences(20));
+    for (uint32_t generation = 1; generation <= 3; generation++) {
+        ASSERT_TRUE(cmaes.advance(deadline));
+        ASSERT_EQ(cmaes.generation(), generation);
+    }
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline - std::chrono::seconds(1));
+}
+
+TEST(CMAESTest, RestoresTheFittestFromACheckpoint) {
+    CMAES original(makeSeed(), 0, CMAES_SIGMA);
+    original.setPreferences(preferences(20));
+    for (int i = 0; i < 30; i++) {
+        original.nextGeneration();
+    }
+    const Checkpoint checkpoint = original.checkpoint();
+    ASSERT_EQ(checkpoint.generation, 30u);
+    ASSERT_EQ(checkpoint.fitness.front(), original.fittest().fitness());
+
+    CMAES restored(makeSeed(), 0, CMAES_SIGMA);
+    restored.restore(checkpoint);
+    ASSERT_EQ(restored.generation(), 30u);
+    ASSERT_EQ(restored.fittest().genome(), original.fittest().genome());
+    ASSERT_EQ(restored.fittest().fitness(), original.fittest().fitness());
+    // It picks up with the saved preferences and narrows in from the fittest
+    ASSERT_EQ(restored.sigma(), CMAES_SIGMA);
+    ASSERT_LT(evolve(&restored), MAX_GENERATIONS);
+}
+
+}  // namespace audiogene
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "math.hpp"
+#include "population.hpp"
+
+namespace audiogene {
+
+namespace {
+
+const std::map<std::string, std::map<std::string, std::string>> ATTRIBUTES = {
+    {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+    {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}};
+
+auto preferences(const double energy, const double vibe) -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, energy));
+    preferences.emplace("vibe", Preference(1, 12, vibe));
+    return preferences;
+}
+
+auto sample() -> Checkpoint {
+    Math math;
+    Checkpoint checkpoint;
+    checkpoint.generation = 42;
+    checkpoint.genes = {"energy", "vibe"};
+    checkpoint.genomes = {10.5, 3, 200, 12, 0, 1};
+    checkpoint.fitness = {0.9, 0.5, 0.1};
+    checkpoint.islands = {1, 2};
+    checkpoint.preferences = preferences(100, 4);
+    checkpoint.populationRng = math.state();
+    math.uniformReal(0.0, 1.0);
+    checkpoint.geneticsRng = math.state();
+    return checkpoint;
+}
+
+auto path(const std::string& name) -> std::string {
+    return ::testing::TempDir() + "audiogene_" + name + ".ckpt";
+}
+
+}  // namespace
+
+TEST(CheckpointTest, ReadsBackWhatWasWritten) {
+    const Checkpoint written = sample();
+    ASSERT_TRUE(writeCheckpoint(path("roundtrip"), written));
+    const Checkpoint read = readCheckpoint(path("roundtrip"));
+
+    ASSERT_EQ(read.generation, written.generation);
+    ASSERT_EQ(read.genes, written.genes);
+    ASSERT_EQ(read.genomes, written.genomes);
+    ASSERT_EQ(read.fitness, written.fitness);
+    ASSERT_EQ(read.islands, written.islands);
+    ASSERT_EQ(read.populationRng, written.populationRng);
+    ASSERT_EQ(read.geneticsRng, written.geneticsRng);
+    ASSERT_EQ(read.preferences.at("energy").current, 100);
+    ASSERT_EQ(read.preferences.at("vibe").max, 12);
+
+    // The random state resumes the same sequence
+    Math original;
+    Math resumed;
+    original.restore(written.populationRng);
+    resumed.restore(read.populationRng);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(original.uniformInt(0, 1 << 30), resumed.uniformInt(0, 1 << 30));
+    }
+    std::remove(path("roundtrip").c_str());
+}
+
+TEST(CheckpointTest, WontWriteWithoutEveryPreference) {
+    Checkpoint checkpoint = sample();
+    checkpoint.preferences.erase("vibe");
+    ASSERT_FALSE(writeCheckpoint(path("unpreferred"), checkpoint));
+}
+
+TEST(CheckpointTest, WontWriteIslandsThatMissIndividuals) {
+    Checkpoint checkpoint = sample();
+    checkpoint.islands = {1, 1};
+    ASSERT_FALSE(writeCheckpoint(path("islands"), checkpoint));
+}
+
+TEST(CheckpointTest, RejectsACorruptHeader) {
+    ASSERT_TRUE(writeCheckpoint(path("corrupt"), sample()));
+    std::vector<char> data;
+    {
+        std::ifstream in(path("corrupt"), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<char> badMagic(data);
+    badMagic[0] ^= 0x7f;
+    std::ofstream(path("corrupt"), std::ios::binary | std::ios::trunc).write(badMagic.data(), badMagic.size());
+    ASSERT_THROW(readCheckpoint(path("corrupt")), std::runtime_error);
+
+    // Past the end of the file
+    std::vector<char> badOffset(data);
+    CheckpointHeader header{};
+    std::memcpy(&header, data.data(), sizeof(header));
+    header.rngOffset = data.size();
+    std::memcpy(badOffset.data(), &header, sizeof(header));
+    std::ofstream(path("corrupt"), std::ios::binary | std::ios::trunc).write(badOffset.data(), badOffset.size());
+    ASSERT_THROW(readCheckpoint(path("corrupt")), std::runtime_error);
+
+    std::ofstream(path("corrupt"), std::ios::binary | std::ios::trunc).write(data.data(), sizeof(header) / 2);
+    ASSERT_THROW(readCheckpoint(path("corrupt")), std::runtime_error);
+    std::remove(path("corrupt").c_str());
+}
+
+TEST(CheckpointTest, RejectsHeaderFieldsThatWrapAround) {
+    ASSERT_TRUE(writeCheckpoint(path("wrapping"), sample()));
+    std::vector<char> data;
+    {
+        std::ifstream in(path("wrapping"), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    CheckpointHeader original{};
+    std::memcpy(&original, data.data(), sizeof(original));
+    const auto rejects = [&data] (const CheckpointHeader& header) {
+        std::vector<char> corrupt(data);
+        std::memcpy(corrupt.data(), &header, sizeof(header));
+        std::ofstream(path("wrapping"), std::ios::binary | std::ios::trunc).write(corrupt.data(), corrupt.size());
+        ASSERT_THROW(readCheckpoint(path("wrapping")), std::runtime_error);
+    };
+
+    // rngOffset + rngSize wraps back inside the file
+    CheckpointHeader header = original;
+    header.rngSize = UINT64_MAX - header.rngOffset + 2;
+    rejects(header);
+
+    // namesOffset + namesSize wraps below preferencesOffset
+    header = original;
+    header.namesSize = UINT64_MAX - header.namesOffset + 1;
+    rejects(header);
+
+    // individualCount * geneCount * sizeof(double) wraps to nothing
+    header = original;
+    header.individualCount = uint64_t(1) << 61;
+    header.geneCount = 8;
+    rejects(header);
+
+    // individualCount * sizeof(double) wraps to nothing
+    header = original;
+    header.individualCount = uint64_t(1) << 61;
+    rejects(header);
+
+    // islandCount * sizeof(uint64_t) wraps to nothing
+    header = original;
+    header.islandCount = uint64_t(1) << 61;
+    rejects(header);
+    std::remove(path("wrapping").c_str());
+}
+
+TEST(CheckpointTest, PopulationResumesWhereItLeftOff) {
+    const Individual seed(ATTRIBUTES);
+    PopulationConfig config(32, 4, 0.2);
+    Population original(config, seed);
+    original.setPreferences(preferences(200, 3));
+    for (int i = 0; i < 3; i++) {
+        original.nextGeneration();
+    }
+    ASSERT_TRUE(writeCheckpoint(path("population"), original.checkpoint()));
+
+    Population resumed(config, seed);
+    resumed.restore(readCheckpoint(path("population")));
+    ASSERT_EQ(resumed.generation(), original.generation());
+    const Checkpoint before = original.checkpoint();
+    const Checkpoint after = resumed.checkpoint();
+    ASSERT_EQ(after.genomes, before.genomes);
+    ASSERT_EQ(after.fitness, before.fitness);
+    ASSERT_EQ(after.populationRng, before.populationRng);
+    ASSERT_EQ(after.geneticsRng, before.geneticsRng);
+    ASSERT_EQ(after.preferences.at("energy").current, 200);
+    std::remove(path("population").c_str());
+}
+
+}  // namespace audiogene
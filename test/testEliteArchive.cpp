@@ -0,0 +1,137 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "elitearchive.hpp"
+#include "individual.hpp"
+
+namespace audiogene {
+
+namespace {
+
+auto genes() -> std::shared_ptr<const Genes> {
+    auto genes = std::make_shared<Genes>();
+    genes->emplace_back("energy", Expression(0, 255, 128, false, ExpressionActivates::OnBar));
+    genes->emplace_back("vibe", Expression(1, 12, 6, false, ExpressionActivates::OnBar));
+    return genes;
+}
+
+auto conductor(const double energy, const double vibe) -> Individual {
+    return Individual(genes(), Genome{energy, vibe});
+}
+
+auto preferences(const double energy, const double vibe) -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, energy));
+    preferences.emplace("vibe", Preference(1, 12, vibe));
+    return preferences;
+}
+
+auto config(const std::vector<std::string>& descriptors) -> ArchiveConfig {
+    ArchiveConfig config;
+    config.enabled = true;
+    config.descriptors = descriptors;
+    config.bins = 4;
+    return config;
+}
+
+/*! The genome of whoever conducts at these preferences, starting from a conductor no elite loses to */
+auto challenger(const EliteArchive& archive, const Preferences& preferences) -> Genome {
+    Individual challenged = conductor(255, 12);
+    archive.challenge(preferences, &challenged);
+    return challenged.genome();
+}
+
+}  // namespace
+
+TEST(EliteArchiveTest, BinsTheEdgesOfEachRange) {
+    const EliteArchive archive(config({"energy", "vibe"}), conductor(0, 1));
+    ASSERT_EQ(archive.cellOf({0, 1}), 0u);
+    ASSERT_EQ(archive.cellOf({0, 12}), 3u);
+    ASSERT_EQ(archive.cellOf({255, 1}), 12u);
+    // The top of a range is in the last bin, not one past it
+    ASSERT_EQ(archive.cellOf({255, 12}), 15u);
+    // A bin starts at its lower edge
+    ASSERT_EQ(archive.cellOf({63.7, 1}), 0u);
+    ASSERT_EQ(archive.cellOf({63.75, 1}), 4u);
+    ASSERT_EQ(archive.cellOf({0, 3.75}), 1u);
+    // Anything outside a range is kept in its nearest bin
+    ASSERT_EQ(archive.cellOf({-10, 20}), 3u);
+}
+
+TEST(EliteArchiveTest, OnlyAFitterOfferTakesACell) {
+    EliteArchive archive(config({"energy"}), conductor(0, 1));
+    const Preferences preferred = preferences(20, 6);
+
+    archive.offer({conductor(30, 6)}, preferred);
+    archive.drain();
+    ASSERT_EQ(archive.filled(), 1u);
+    ASSERT_EQ(challenger(archive, preferred), Genome({30, 6}));
+
+    // Further from the preferences, in the same cell
+    archive.offer({conductor(50, 6)}, preferred);
+    archive.drain();
+    ASSERT_EQ(archive.filled(), 1u);
+    ASSERT_EQ(challenger(archive, preferred), Genome({30, 6}));
+
+    archive.offer({conductor(22, 6)}, preferred);
+    archive.drain();
+    ASSERT_EQ(archive.filled(), 1u);
+    ASSERT_EQ(challenger(archive, preferred), Genome({22, 6}));
+}
+
+TEST(EliteArchiveTest, RescoresElitesWhenPreferencesChange) {
+    EliteArchive archive(config({"energy"}), conductor(0, 1));
+    archive.offer({conductor(10, 6)}, preferences(10, 6));
+    archive.drain();
+
+    // Against the old preferences the elite is perfect; against the new ones this is fitter
+    const Preferences moved = preferences(0, 6);
+    archive.offer({conductor(2, 6)}, moved);
+    archive.drain();
+    ASSERT_EQ(challenger(archive, moved), Genome({2, 6}));
+}
+
+TEST(EliteArchiveTest, ChallengeKeepsTheConductorsOwnFitness) {
+    EliteArchive archive(config({"energy"}), conductor(0, 1));
+    const Preferences preferred = preferences(20, 6);
+    archive.offer({conductor(30, 6)}, preferred);
+    archive.drain();
+
+    // A closer conductor whose fitness blends in the audience's reactions
+    Individual closer = conductor(20, 6);
+    closer.setFitness(0.25);
+    ASSERT_FALSE(archive.challenge(preferred, &closer));
+    ASSERT_EQ(closer.fitness(), 0.25);
+
+    Individual further = conductor(60, 6);
+    further.setFitness(0.25);
+    ASSERT_TRUE(archive.challenge(preferred, &further));
+    ASSERT_EQ(further.genome(), Genome({30, 6}));
+}
+
+}  // namespace audiogene
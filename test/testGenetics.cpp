@@ -22,10 +22,53 @@
 
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <memory>
+#include <string>
+
 #include "genetics.hpp"
 
 namespace audiogene {
 
+namespace {
+
+auto makeGenes() -> Genes {
+    Genes genes;
+    genes.emplace_back("energy", Expression(0, 255, 128, false, ExpressionActivates::OnBar));
+    genes.emplace_back("vibe", Expression(1, 12, 6, true, ExpressionActivates::OnBar));
+    return genes;
+}
+
+/*! The fraction of genes of a long genome that change per mutation */
+auto mutatedFraction(const double probability, const bool selfAdaptive = false) -> double {
+    MutationConfig config(probability);
+    config.selfAdaptive = selfAdaptive;
+    Genetics genetics(config);
+    Genes genes;
+    for (int i = 0; i < 1000; i++) {
+        genes.emplace_back("gene" + std::to_string(i), Expression(0, 1000, 500, false, ExpressionActivates::OnBar));
+    }
+    const Genome original(genes.size(), 500);
+    StepSizes steps(genes.size(), INITIAL_STEP);
+    size_t changed = 0;
+    const int rounds = 200;
+    for (int round = 0; round < rounds; round++) {
+        Genome genome(original);
+        const StepSizes before(steps);
+        genetics.mutate(genes, &genome, &steps);
+        for (size_t g = 0; g < genes.size(); g++) {
+            changed += genome[g] != original[g] ? 1 : 0;
+            // Only a gene that mutated has tested a new step
+            if (genome[g] == original[g]) {
+                EXPECT_EQ(steps[g], before[g]) << g;
+            }
+        }
+    }
+    return static_cast<double>(changed) / (rounds * genes.size());
+}
+
+}  // namespace
+
 TEST(GeneticsText, TestPass) {
     int r = 0;
     ASSERT_EQ(r, 0);
@@ -36,4 +79,86 @@ TEST(GeneticsTest, TestFail) {
     ASSERT_EQ(r, 1);
 }
 
+TEST(GeneticsTest, AdaptLeavesStepsAloneWithoutTheRule) {
+    Genetics genetics{MutationConfig(0.1)};
+    ASSERT_EQ(genetics.adapt(1), 1);
+    ASSERT_EQ(genetics.adapt(0), 1);
+}
+
+TEST(GeneticsTest, AdaptFollowsTheSuccessRate) {
+    MutationConfig config(0.1);
+    config.oneFifthRule = true;
+    Genetics genetics(config);
+    ASSERT_DOUBLE_EQ(genetics.adapt(TARGET_SUCCESS_RATE + 0.01), 1 / STEP_SCALE_FACTOR);
+    ASSERT_DOUBLE_EQ(genetics.adapt(TARGET_SUCCESS_RATE), 1 / STEP_SCALE_FACTOR);
+    ASSERT_DOUBLE_EQ(genetics.adapt(TARGET_SUCCESS_RATE - 0.01), 1);
+    ASSERT_DOUBLE_EQ(genetics.adapt(0), STEP_SCALE_FACTOR);
+}
+
+TEST(GeneticsTest, AdaptStaysWithinItsBounds) {
+    MutationConfig config(0.1);
+    config.oneFifthRule = true;
+    Genetics genetics(config);
+    for (int i = 0; i < 100; i++) {
+        genetics.adapt(1);
+    }
+    ASSERT_DOUBLE_EQ(genetics.adapt(1), MAX_STEP_SCALE);
+    for (int i = 0; i < 100; i++) {
+        genetics.adapt(0);
+    }
+    ASSERT_DOUBLE_EQ(genetics.adapt(0), MIN_STEP_SCALE);
+}
+
+TEST(GeneticsTest, SelfAdaptiveStepsStayWithinTheirBounds) {
+    MutationConfig config(0.1);
+    config.selfAdaptive = true;
+    config.oneFifthRule = true;
+    Genetics genetics(config);
+    const Genes genes = makeGenes();
+    Genome genome = {128, 6};
+    StepSizes steps = {MIN_STEP, MAX_STEP};
+    for (int i = 0; i < 2000; i++) {
+        // Push the step scale to each end in turn
+        genetics.adapt(i / 500 % 2 == 0 ? 1 : 0);
+        genetics.mutate(genes, &genome, &steps);
+        for (size_t g = 0; g < genes.size(); g++) {
+            ASSERT_GE(steps[g], MIN_STEP);
+            ASSERT_LE(steps[g], MAX_STEP);
+            ASSERT_GE(genome[g], genes[g].min);
+            ASSERT_LE(genome[g], genes[g].max);
+        }
+        ASSERT_EQ(genome[1], std::round(genome[1]));
+    }
+}
+
+TEST(GeneticsTest, FixedStepsKeepGenesInRange) {
+    MutationConfig config(1);
+    config.oneFifthRule = true;
+    Genetics genetics(config);
+    for (int i = 0; i < 100; i++) {
+        genetics.adapt(1);
+    }
+    const Genes genes = makeGenes();
+    Genome genome = {255, 1};
+    StepSizes steps(genes.size(), INITIAL_STEP);
+    for (int i = 0; i < 1000; i++) {
+        genetics.mutate(genes, &genome, &steps);
+        ASSERT_GE(genome[0], genes[0].min);
+        ASSERT_LE(genome[0], genes[0].max);
+        ASSERT_GE(genome[1], genes[1].min);
+        ASSERT_LE(genome[1], genes[1].max);
+    }
+    ASSERT_EQ(steps[0], INITIAL_STEP);
+}
+
+TEST(GeneticsTest, MutatesTheConfiguredFractionOfGenes) {
+    // 200,000 genes each; the standard error at 0.05 is 0.0005
+    ASSERT_NEAR(mutatedFraction(0.05), 0.05, 0.003);
+    ASSERT_EQ(mutatedFraction(1), 1);
+    ASSERT_EQ(mutatedFraction(0), 0);
+    // Self-adaptive steps change how far genes move, not how many
+    ASSERT_NEAR(mutatedFraction(0.05, true), 0.05, 0.003);
+    ASSERT_EQ(mutatedFraction(1, true), 1);
+}
+
 }  // namespace audiogene
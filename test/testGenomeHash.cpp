@@ -0,0 +1,74 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include "genomehash.hpp"
+
+namespace audiogene {
+
+TEST(GenomeHashTest, EqualGenomesHashEqually) {
+    ASSERT_EQ(hashGenome({1, 2.5, 3}), hashGenome({1, 2.5, 3}));
+    ASSERT_EQ(hashGenome({0.0, 1}), hashGenome({-0.0, 1}));
+}
+
+TEST(GenomeHashTest, DifferentGenomesHashDifferently) {
+    ASSERT_NE(hashGenome({1, 2}), hashGenome({2, 1}));
+    ASSERT_NE(hashGenome({1}), hashGenome({1, 0}));
+    std::set<uint64_t> hashes;
+    for (int a = 0; a < 64; a++) {
+        for (int b = 0; b < 64; b++) {
+            hashes.insert(hashGenome({static_cast<double>(a), static_cast<double>(b)}));
+        }
+    }
+    ASSERT_EQ(hashes.size(), 64u * 64u);
+}
+
+TEST(GenomeHashTest, TableFindsWhatWasInserted) {
+    GenomeTable table(100);
+    ASSERT_GE(table.capacity(), 100u);
+    for (uint32_t i = 0; i < 100; i++) {
+        ASSERT_TRUE(table.insert(hashGenome({static_cast<double>(i)}), i));
+    }
+    ASSERT_EQ(table.size(), 100u);
+    ASSERT_FALSE(table.insert(hashGenome({7}), 0));
+    for (uint32_t i = 0; i < 100; i++) {
+        const uint32_t* value = table.find(hashGenome({static_cast<double>(i)}));
+        ASSERT_NE(value, nullptr);
+        ASSERT_EQ(*value, i);
+    }
+    ASSERT_EQ(table.find(hashGenome({100})), nullptr);
+}
+
+TEST(GenomeHashTest, ClearForgetsEverything) {
+    GenomeTable table(10);
+    table.insert(hashGenome({1}), 1);
+    table.clear();
+    ASSERT_EQ(table.size(), 0u);
+    ASSERT_EQ(table.find(hashGenome({1})), nullptr);
+    ASSERT_TRUE(table.insert(hashGenome({1}), 2));
+    ASSERT_EQ(*table.find(hashGenome({1})), 2u);
+}
+
+}  // namespace audiogene
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "genomeindex.hpp"
+#include "individual.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t GENES = 4;
+constexpr size_t INDIVIDUALS = 3000;
+
+auto distance(const Genome& a, const Genome& b, const std::vector<double>& weights) -> double {
+    double total = 0;
+    for (size_t g = 0; g < a.size(); g++) {
+        total += std::abs(a[g] - b[g]) * weights[g];
+    }
+    return total;
+}
+
+}  // namespace
+
+TEST(GenomeIndexTest, NearestMatchesBruteForce) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> uniform(0, 100);
+    auto genes = std::make_shared<Genes>();
+    for (size_t g = 0; g < GENES; g++) {
+        genes->emplace_back("gene" + std::to_string(g), Expression(0, 100, 50, false, ExpressionActivates::OnBar));
+    }
+    Individuals individuals;
+    for (size_t i = 0; i < INDIVIDUALS; i++) {
+        Genome genome(GENES);
+        for (double& value : genome) {
+            // Rounding some genes makes ties
+            value = i % 3 == 0 ? std::round(uniform(rng) / 10) : uniform(rng);
+        }
+        individuals.emplace_back(genes, genome);
+    }
+    const std::vector<double> weights = {1, 0.5, 2, 0.01};
+
+    GenomeIndex index;
+    index.build(individuals, weights);
+    ASSERT_EQ(index.size(), INDIVIDUALS);
+    std::vector<size_t> result;
+    std::vector<double> expected(INDIVIDUALS);
+    for (size_t query = 0; query < 50; query++) {
+        Genome ideal(GENES);
+        for (double& value : ideal) {
+            value = uniform(rng);
+        }
+        for (size_t i = 0; i < INDIVIDUALS; i++) {
+            expected[i] = distance(individuals[i].genome(), ideal, weights);
+        }
+        std::sort(expected.begin(), expected.end());
+        for (const size_t k : {size_t(1), size_t(7), size_t(40)}) {
+            index.nearest(ideal, weights, k, &result);
+            ASSERT_EQ(result.size(), k);
+            for (size_t j = 0; j < k; j++) {
+                // Ties may come back in either order, but never further than the brute force's jth
+                ASSERT_NEAR(distance(individuals[result[j]].genome(), ideal, weights), expected[j], 1e-9);
+            }
+        }
+    }
+}
+
+}  // namespace audiogene
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "metrics.hpp"
+
+namespace audiogene {
+
+TEST(MetricsTest, CounterIncrements) {
+    Counter c;
+    c.increment();
+    c.increment(4);
+    ASSERT_EQ(c.value(), 5u);
+}
+
+TEST(MetricsTest, HistogramSmallValuesAreExact) {
+    for (uint64_t v = 0; v < HISTOGRAM_SUB_BUCKETS; v++) {
+        ASSERT_EQ(Histogram::upperBound(Histogram::bucketOf(v)), v);
+    }
+}
+
+TEST(MetricsTest, HistogramBucketContainsValue) {
+    for (uint64_t v = 1; v < (uint64_t(1) << 40); v = v * 3 + 1) {
+        const size_t bucket = Histogram::bucketOf(v);
+        ASSERT_LT(bucket, HISTOGRAM_BUCKETS);
+        ASSERT_GE(Histogram::upperBound(bucket), v);
+        if (bucket > 0) {
+            ASSERT_LT(Histogram::upperBound(bucket - 1), v);
+        }
+    }
+}
+
+TEST(MetricsTest, HistogramQuantile) {
+    Histogram h;
+    for (uint64_t v = 1; v <= 1000; v++) {
+        h.record(v);
+    }
+    ASSERT_EQ(h.count(), 1000u);
+    ASSERT_EQ(h.sum(), 500500u);
+    const uint64_t median = h.quantile(0.5);
+    ASSERT_GE(median, 470u);
+    ASSERT_LE(median, 530u);
+}
+
+TEST(MetricsTest, LabelledInstancesShareTheirDescription) {
+    Metrics::instance().gauge(labelled("test_island_gauge", "island", "0"), "A gauge per island").set(1);
+    Metrics::instance().gauge(labelled("test_island_gauge", "island", "1"), "A gauge per island").set(2);
+    Metrics::instance().histogram(labelled("test_island_us", "island", "0"), "A histogram per island").record(3);
+    const std::string text = Metrics::instance().prometheus();
+
+    const std::string help = "# HELP test_island_gauge A gauge per island\n";
+    ASSERT_NE(text.find(help), std::string::npos);
+    ASSERT_EQ(text.find(help, text.find(help) + 1), std::string::npos);
+    ASSERT_NE(text.find("test_island_gauge{island=\"0\"} 1\n"), std::string::npos);
+    ASSERT_NE(text.find("test_island_gauge{island=\"1\"} 2\n"), std::string::npos);
+    ASSERT_NE(text.find("test_island_us_bucket{island=\"0\",le=\"3\"} 1\n"), std::string::npos);
+    ASSERT_NE(text.find("test_island_us_count{island=\"0\"} 1\n"), std::string::npos);
+}
+
+}  // namespace audiogene
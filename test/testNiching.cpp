@@ -0,0 +1,187 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "individual.hpp"
+#include "niching.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t GENES = 3;
+constexpr size_t CLUSTERS = 8;
+constexpr size_t INDIVIDUALS = 400;
+
+// A few tight clusters, so niches hold many individuals, and fitness that goes below zero
+auto clustered() -> Individuals {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, 0.04);
+    auto genes = std::make_shared<Genes>();
+    for (size_t g = 0; g < GENES; g++) {
+        genes->emplace_back("gene" + std::to_string(g), Expression(0, 10 * (g + 1), 0, false,
+                ExpressionActivates::OnBar));
+    }
+    std::vector<Genome> centres(CLUSTERS, Genome(GENES));
+    for (Genome& centre : centres) {
+        std::generate(centre.begin(), centre.end(), [&] () { return uniform(rng); });
+    }
+    Individuals individuals;
+    for (size_t i = 0; i < INDIVIDUALS; i++) {
+        Genome genome(GENES);
+        for (size_t g = 0; g < GENES; g++) {
+            const double range = (*genes)[g].max;
+            genome[g] = std::min(range, std::max(0.0, (centres[i % CLUSTERS][g] + noise(rng)) * range));
+        }
+        individuals.emplace_back(genes, genome);
+        individuals.back().setFitness(2 * uniform(rng) - 0.5);
+    }
+    return individuals;
+}
+
+auto distance(const Individual& a, const Individual& b) -> double {
+    double furthest = 0;
+    for (size_t g = 0; g < GENES; g++) {
+        const Gene& gene = a.genes()[g];
+        furthest = std::max(furthest, std::abs(a.genome()[g] - b.genome()[g]) / (gene.max - gene.min));
+    }
+    return furthest;
+}
+
+auto least(const Individuals& individuals) -> double {
+    return std::min_element(individuals.begin(), individuals.end(), [] (const Individual& lhs, const Individual& rhs) {
+        return lhs.fitness() < rhs.fitness();
+    })->fitness();
+}
+
+// Goldberg and Richardson's sharing, comparing every pair; returns the sum of everyone's share
+auto shared(const Individuals& individuals, const NichingConfig& config, std::vector<double>* fitness) -> double {
+    const double floor = least(individuals);
+    double niches = 0;
+    for (const Individual& i : individuals) {
+        double count = 0;
+        for (const Individual& j : individuals) {
+            const double d = distance(i, j);
+            if (d < config.radius) {
+                count += 1 - std::pow(d / config.radius, config.alpha);
+            }
+        }
+        fitness->push_back(floor + (i.fitness() - floor) / count);
+        niches += 1 / count;
+    }
+    return niches;
+}
+
+// Pétrowski's clearing, comparing every pair; returns how many niches it found
+auto cleared(const Individuals& individuals, const NichingConfig& config, std::vector<double>* fitness) -> size_t {
+    const size_t n = individuals.size();
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&individuals] (const size_t lhs, const size_t rhs) {
+        return individuals[lhs].fitness() > individuals[rhs].fitness();
+    });
+    const double floor = least(individuals);
+    std::vector<bool> clear(n, false);
+    std::vector<bool> kept(n, false);
+    size_t niches = 0;
+    for (size_t k = 0; k < n; k++) {
+        const size_t winner = order[k];
+        if (clear[winner]) {
+            continue;
+        }
+        niches += kept[winner] ? 0 : 1;
+        size_t winners = 1;
+        for (size_t m = k + 1; m < n; m++) {
+            const size_t j = order[m];
+            if (clear[j] || distance(individuals[winner], individuals[j]) >= config.radius) {
+                continue;
+            }
+            if (winners < config.capacity) {
+                winners++;
+                kept[j] = true;
+            } else {
+                clear[j] = true;
+            }
+        }
+    }
+    fitness->resize(n);
+    for (size_t i = 0; i < n; i++) {
+        (*fitness)[i] = clear[i] ? floor : individuals[i].fitness();
+    }
+    return niches;
+}
+
+}  // namespace
+
+TEST(NichingTest, SharingMatchesEveryPair) {
+    const Individuals individuals = clustered();
+    for (const double alpha : {1.0, 2.0, 0.5}) {
+        NichingConfig config;
+        config.method = NichingMethod::Sharing;
+        config.radius = 0.15;
+        config.alpha = alpha;
+        Niching niching(config);
+        std::vector<double> fitness;
+        niching.derate(individuals, &fitness);
+
+        std::vector<double> expected;
+        const double niches = shared(individuals, config, &expected);
+        ASSERT_EQ(fitness.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            // The grid measures distances in single precision
+            ASSERT_NEAR(fitness[i], expected[i], 1e-5) << "individual " << i << ", alpha " << alpha;
+        }
+        ASSERT_NEAR(niching.niches(), niches, 1e-4);
+    }
+}
+
+TEST(NichingTest, ClearingMatchesEveryPair) {
+    const Individuals individuals = clustered();
+    for (const size_t capacity : {1, 3, 20}) {
+        NichingConfig config;
+        config.method = NichingMethod::Clearing;
+        config.radius = 0.15;
+        config.capacity = capacity;
+        Niching niching(config);
+        std::vector<double> fitness;
+        niching.derate(individuals, &fitness);
+
+        std::vector<double> expected;
+        const size_t niches = cleared(individuals, config, &expected);
+        ASSERT_EQ(fitness, expected) << "capacity " << capacity;
+        ASSERT_EQ(niching.niches(), niches);
+        ASSERT_GE(niches, CLUSTERS);
+        ASSERT_LT(niches, INDIVIDUALS / 2);
+    }
+}
+
+}  // namespace audiogene
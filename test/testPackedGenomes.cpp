@@ -0,0 +1,170 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "genome.hpp"
+#include "individual.hpp"
+#include "niching.hpp"
+#include "packedgenomes.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t INDIVIDUALS = 500;
+
+auto gene(const std::string& name, const double min, const double max, const bool round,
+          const ExpressionEncoding encoding) -> Gene {
+    Expression expression(min, max, min, round, ExpressionActivates::OnBar);
+    expression.encoding = encoding;
+    return Gene(name, expression);
+}
+
+// Every encoding, with ends that none of them can hold exactly
+auto genes() -> std::shared_ptr<const Genes> {
+    auto genes = std::make_shared<Genes>();
+    genes->push_back(gene("autoWhole", -5, 300, true, ExpressionEncoding::Auto));
+    genes->push_back(gene("autoReal", 0, 255, false, ExpressionEncoding::Auto));
+    genes->push_back(gene("double", -1.5, 2.25, false, ExpressionEncoding::Double));
+    genes->push_back(gene("float32", -0.1, 0.1, false, ExpressionEncoding::Float32));
+    genes->push_back(gene("int16", -40.5, 99.5, true, ExpressionEncoding::Int16));
+    genes->push_back(gene("fixed16", -3.3, 7.9, false, ExpressionEncoding::Fixed16));
+    return genes;
+}
+
+// Quantized values from across each range, its ends, and past them
+auto population() -> Individuals {
+    const std::shared_ptr<const Genes> shared = genes();
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> uniform(-0.1, 1.1);
+    Individuals individuals;
+    for (size_t i = 0; i < INDIVIDUALS; i++) {
+        Genome genome;
+        for (const Gene& g : *shared) {
+            const double value = i == 0 ? g.min : i == 1 ? g.max : g.min + uniform(rng) * (g.max - g.min);
+            genome.push_back(quantize(g, g.round ? std::round(value) : value));
+        }
+        individuals.emplace_back(shared, genome);
+    }
+    return individuals;
+}
+
+}  // namespace
+
+TEST(PackedGenomesTest, AutoResolvesByRange) {
+    const std::shared_ptr<const Genes> shared = genes();
+    ASSERT_EQ((*shared)[0].encoding, ExpressionEncoding::Int16);
+    ASSERT_EQ((*shared)[1].encoding, ExpressionEncoding::Double);
+}
+
+TEST(PackedGenomesTest, QuantizingStaysInRange) {
+    for (const Gene& g : *genes()) {
+        for (const double value : {g.min, g.max, g.min - 1, g.max + 1, (g.min + g.max) / 3}) {
+            const double quantized = quantize(g, value);
+            ASSERT_GE(quantized, g.min) << g.name << " " << value;
+            ASSERT_LE(quantized, g.max) << g.name << " " << value;
+            // Already on the encoding's grid
+            ASSERT_EQ(quantize(g, quantized), quantized) << g.name << " " << value;
+        }
+    }
+}
+
+TEST(PackedGenomesTest, EveryEncodingRoundTrips) {
+    const Individuals individuals = population();
+    std::vector<size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(2));
+
+    PackedGenomes packed;
+    packed.pack(individuals, order);
+    ASSERT_EQ(packed.size(), individuals.size());
+    const Genes& g = individuals.front().genes();
+    for (size_t p = 0; p < order.size(); p++) {
+        for (size_t i = 0; i < g.size(); i++) {
+            ASSERT_EQ(packed.value(p, i), individuals[order[p]].genome()[i]) << g[i].name << " at " << p;
+        }
+    }
+}
+
+TEST(PackedGenomesTest, PacksFullPrecisionGenesAsTheirNearestEncodedValue) {
+    const std::shared_ptr<const Genes> shared = genes();
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    Individuals individuals;
+    for (size_t i = 0; i < INDIVIDUALS; i++) {
+        Genome genome;
+        for (const Gene& g : *shared) {
+            genome.push_back(g.min + uniform(rng) * (g.max - g.min));
+        }
+        individuals.emplace_back(shared, genome);
+    }
+    std::vector<size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    PackedGenomes packed;
+    packed.pack(individuals, order);
+    const Genes& g = individuals.front().genes();
+    for (size_t p = 0; p < order.size(); p++) {
+        for (size_t i = 0; i < g.size(); i++) {
+            ASSERT_EQ(packed.value(p, i), quantize(g[i], individuals[p].genome()[i])) << g[i].name << " at " << p;
+        }
+    }
+}
+
+TEST(PackedGenomesTest, DistancesMatchTheUnpackedGenomes) {
+    const Individuals individuals = population();
+    std::vector<size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::reverse(order.begin(), order.end());
+    PackedGenomes packed;
+    packed.pack(individuals, order);
+
+    const Genes& g = individuals.front().genes();
+    std::vector<float> out(individuals.size());
+    for (const size_t from : {0, 1, 250, 499}) {
+        packed.distances(from, 0, out.size(), out.data());
+        for (size_t p = 0; p < out.size(); p++) {
+            const double expected = NeighbourGrid::distance(g, individuals[order[from]].genome(),
+                    individuals[order[p]].genome());
+            // Compared in single precision
+            ASSERT_NEAR(out[p], expected, 1e-6 + 1e-6 * expected) << from << " to " << p;
+        }
+        ASSERT_EQ(out[from], 0);
+    }
+
+    // Only the asked for positions are written
+    std::fill(out.begin(), out.end(), -1.0F);
+    packed.distances(3, 10, 20, out.data());
+    for (size_t p = 0; p < out.size(); p++) {
+        ASSERT_EQ(out[p] < 0, p < 10 || p >= 20) << p;
+    }
+}
+
+}  // namespace audiogene
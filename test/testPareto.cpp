@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "pareto.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr size_t POINTS = 200;
+constexpr size_t OBJECTIVES = 3;
+
+auto dominates(const std::vector<double>& objectives, const size_t a, const size_t b) -> bool {
+    bool better = false;
+    for (size_t k = 0; k < OBJECTIVES; k++) {
+        if (objectives[a * OBJECTIVES + k] < objectives[b * OBJECTIVES + k]) {
+            return false;
+        }
+        better = better || objectives[a * OBJECTIVES + k] > objectives[b * OBJECTIVES + k];
+    }
+    return better;
+}
+
+/*! Each point's front by peeling off the non-dominated points one front at a time */
+auto referenceFronts(const std::vector<double>& objectives) -> std::vector<size_t> {
+    std::vector<size_t> fronts(POINTS, 0);
+    std::vector<bool> ranked(POINTS, false);
+    size_t done = 0;
+    for (size_t front = 1; done < POINTS; front++) {
+        std::vector<size_t> members;
+        for (size_t a = 0; a < POINTS; a++) {
+            bool dominated = false;
+            for (size_t b = 0; b < POINTS && !ranked[a] && !dominated; b++) {
+                dominated = !ranked[b] && dominates(objectives, b, a);
+            }
+            if (!ranked[a] && !dominated) {
+                members.push_back(a);
+            }
+        }
+        for (const size_t a : members) {
+            ranked[a] = true;
+            fronts[a] = front;
+        }
+        done += members.size();
+    }
+    return fronts;
+}
+
+auto randomObjectives(const bool ties) -> std::vector<double> {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<double> objectives(POINTS * OBJECTIVES);
+    for (double& objective : objectives) {
+        // A coarse grid makes plenty of equal and duplicate points
+        objective = ties ? std::floor(uniform(rng) * 6) : uniform(rng);
+    }
+    return objectives;
+}
+
+}  // namespace
+
+TEST(ParetoTest, FrontsMatchPeeling) {
+    for (const bool ties : {false, true}) {
+        const std::vector<double> objectives = randomObjectives(ties);
+        const std::vector<size_t> expected = referenceFronts(objectives);
+        ParetoRanking ranking;
+        ranking.rank(objectives, OBJECTIVES, POINTS);
+
+        std::vector<size_t> front(ranking.front());
+        std::sort(front.begin(), front.end());
+        std::vector<size_t> expectedFront;
+        for (size_t i = 0; i < POINTS; i++) {
+            if (expected[i] == 1) {
+                expectedFront.push_back(i);
+            }
+        }
+        ASSERT_EQ(front, expectedFront);
+
+        // Every point appears once, fronts in order
+        const std::vector<size_t>& order = ranking.order();
+        ASSERT_EQ(order.size(), POINTS);
+        std::vector<size_t> seen(order);
+        std::sort(seen.begin(), seen.end());
+        ASSERT_EQ(std::unique(seen.begin(), seen.end()), seen.end());
+        for (size_t i = 1; i < POINTS; i++) {
+            ASSERT_LE(expected[order[i - 1]], expected[order[i]]);
+        }
+    }
+}
+
+TEST(ParetoTest, OnlyTheNeededFrontsAreExact) {
+    const std::vector<double> objectives = randomObjectives(false);
+    const std::vector<size_t> expected = referenceFronts(objectives);
+    ParetoRanking ranking;
+    const size_t needed = POINTS / 4;
+    ranking.rank(objectives, OBJECTIVES, needed);
+    const std::vector<size_t>& order = ranking.order();
+    ASSERT_EQ(order.size(), POINTS);
+    for (size_t i = 1; i < needed; i++) {
+        ASSERT_LE(expected[order[i - 1]], expected[order[i]]);
+    }
+}
+
+TEST(ParetoTest, CrowdingIsInfiniteAtTheBoundaries) {
+    const std::vector<double> objectives = randomObjectives(false);
+    ParetoRanking ranking;
+    ranking.rank(objectives, OBJECTIVES, POINTS);
+    const std::vector<size_t>& front = ranking.front();
+    ASSERT_GT(front.size(), 2u);
+
+    std::vector<double> expected(POINTS, 0);
+    std::vector<size_t> sorted(front);
+    for (size_t k = 0; k < OBJECTIVES; k++) {
+        std::sort(sorted.begin(), sorted.end(), [&objectives, k] (const size_t a, const size_t b) {
+            return objectives[a * OBJECTIVES + k] < objectives[b * OBJECTIVES + k];
+        });
+        const double range = objectives[sorted.back() * OBJECTIVES + k] - objectives[sorted.front() * OBJECTIVES + k];
+        expected[sorted.front()] = std::numeric_limits<double>::infinity();
+        expected[sorted.back()] = std::numeric_limits<double>::infinity();
+        for (size_t i = 1; i + 1 < sorted.size(); i++) {
+            expected[sorted[i]] += (objectives[sorted[i + 1] * OBJECTIVES + k] -
+                                    objectives[sorted[i - 1] * OBJECTIVES + k]) / range;
+        }
+    }
+    for (const size_t point : front) {
+        if (std::isinf(expected[point])) {
+            ASSERT_TRUE(std::isinf(ranking.crowding(point)));
+        } else {
+            ASSERT_NEAR(ranking.crowding(point), expected[point], 1e-12);
+        }
+    }
+    // The most isolated of the front come first
+    for (size_t i = 1; i < front.size(); i++) {
+        ASSERT_GE(ranking.crowding(ranking.order()[i - 1]), ranking.crowding(ranking.order()[i]));
+    }
+}
+
+}  // namespace audiogene
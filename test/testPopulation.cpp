@@ -22,10 +22,44 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockingqueue.hpp"
+#include "individual.hpp"
+#include "math.hpp"
 #include "population.hpp"
 
 namespace audiogene {
 
+namespace {
+
+auto preferences(const double energy, const double vibe) -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, energy));
+    preferences.emplace("vibe", Preference(1, 12, vibe));
+    return preferences;
+}
+
+auto score(const Individual& individual, const Preferences& preferences) -> double {
+    const Math math;
+    const Genes& genes = individual.genes();
+    double total = 0;
+    for (size_t i = 0; i < genes.size(); i++) {
+        total += math.similarity(preferences.at(genes[i].name).current, individual.genome()[i], genes[i].min,
+                genes[i].max);
+    }
+    return total / genes.size();
+}
+
+}  // namespace
+
 TEST(PopulationText, TestPass) {
     int r = 0;
     ASSERT_EQ(r, 0);
@@ -36,4 +70,133 @@ TEST(PopulationTest, TestFail) {
     ASSERT_EQ(r, 1);
 }
 
+TEST(PopulationTest, UnfinishedGenerationsConductWithTheirFittestSoFar) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+        {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    const PopulationConfig config(4 * GENERATION_CHUNK, 4, 0.2);
+    Population population(config, seed);
+    population.setPreferences(preferences(20, 11));
+    population.nextGeneration();
+    const Preferences moved = preferences(230, 2);
+    population.setPreferences(moved);
+
+    bool childConducted = false;
+    for (int generation = 0; generation < 10; generation++) {
+        const Individual finished = population.fittest();
+        std::set<uint32_t> finishedIds;
+        for (const Individual& individual : population.sample(config.size)) {
+            finishedIds.insert(individual.id());
+        }
+        // A deadline that's already gone still breeds a chunk each time
+        double fitness = finished.fitness();
+        while (!population.advance(std::chrono::steady_clock::time_point::min())) {
+            const Individual partial = population.fittest();
+            ASSERT_DOUBLE_EQ(partial.fitness(), score(partial, moved));
+            // The elites carried over, so nobody less fit than them conducts
+            ASSERT_GE(partial.fitness(), fitness);
+            fitness = partial.fitness();
+            childConducted = childConducted || finishedIds.count(partial.id()) == 0;
+        }
+        ASSERT_GE(population.fittest().fitness(), fitness);
+    }
+    ASSERT_TRUE(childConducted);
+}
+
+TEST(PopulationTest, GenerationsTakePreferencesFromALiveQueue) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+        {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    const PopulationConfig config(32, 4, 0.2);
+    Population population(config, seed);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    population.setPreferences(queue);
+
+    // The first generation waits for the audience, then is scored against what they sent
+    std::thread audience([queue] () {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        queue->enqueue(preferences(20, 11));
+    });
+    population.nextGeneration();
+    audience.join();
+    ASSERT_EQ(population.generation(), 1u);
+    ASSERT_DOUBLE_EQ(population.fittest().fitness(), score(population.fittest(), preferences(20, 11)));
+
+    // Later generations keep those preferences until new ones arrive, and don't wait for them
+    const auto start = std::chrono::steady_clock::now();
+    for (int generation = 0; generation < 3; generation++) {
+        population.nextGeneration();
+    }
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(PREFERENCES_WAIT_FOR_S));
+    ASSERT_EQ(population.generation(), 4u);
+
+    // Only the newest of several waiting are played to
+    queue->enqueue(preferences(100, 3));
+    queue->enqueue(preferences(230, 2));
+    population.nextGeneration();
+    ASSERT_EQ(population.generation(), 5u);
+    ASSERT_DOUBLE_EQ(population.fittest().fitness(), score(population.fittest(), preferences(230, 2)));
+}
+
+TEST(PopulationTest, DeadlinesAreNotSpentWaitingForPreferences) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+        {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    const PopulationConfig config(32, 4, 0.2);
+    Population population(config, seed);
+    auto queue = std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+    population.setPreferences(queue);
+
+    // Nothing to score against yet, so give the time back rather than waiting it out
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    ASSERT_FALSE(population.advance(deadline));
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline - std::chrono::seconds(1));
+    ASSERT_EQ(population.generation(), 0u);
+
+    queue->enqueue(preferences(20, 11));
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(population.advance(start + std::chrono::seconds(2)));
+    ASSERT_EQ(population.generation(), 1u);
+    ASSERT_TRUE(population.advance(std::chrono::steady_clock::now() + std::chrono::seconds(2)));
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    ASSERT_EQ(population.generation(), 2u);
+}
+
+TEST(PopulationTest, ImmigrantsReplaceTheLeastFit) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+        {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    const PopulationConfig config(32, 4, 0.2);
+    Population population(config, seed);
+    Population island(config, seed);
+    population.setPreferences(preferences(20, 11));
+    island.setPreferences(preferences(20, 11));
+    population.nextGeneration();
+    island.nextGeneration();
+
+    const Individuals before = population.sample(config.size);
+    std::vector<double> fitness;
+    for (const Individual& individual : before) {
+        fitness.push_back(individual.fitness());
+    }
+    const size_t n = 3;
+    std::sort(fitness.begin(), fitness.end());
+    const Individuals immigrants = island.emigrants(n);
+    std::set<uint32_t> immigrantIds;
+    for (const Individual& immigrant : immigrants) {
+        immigrantIds.insert(immigrant.id());
+    }
+    population.immigrate(immigrants);
+
+    size_t stayed = 0;
+    for (const Individual& individual : population.sample(config.size)) {
+        if (immigrantIds.count(individual.id()) == 0) {
+            // Nobody fitter than those replaced was
+            ASSERT_GE(individual.fitness(), fitness[n - 1]);
+            stayed++;
+        }
+    }
+    ASSERT_EQ(stayed, config.size - n);
+}
+
 }  // namespace audiogene
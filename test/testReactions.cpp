@@ -0,0 +1,151 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+
+#include "audience.hpp"
+#include "reactions.hpp"
+
+namespace audiogene {
+
+namespace {
+
+constexpr double WEIGHT = 0.2;
+
+// Takes input only through preferenceUpdated, as the MIDI callback does
+class TestAudience final : public Audience {
+ public:
+    TestAudience() {
+        writeToPreferences(queue);
+        initializePreferences({
+            {"energy", {{"min", "0"}, {"max", "255"}, {"current", "128"}, {"round", "false"}, {"activates", "OnBar"}}},
+            {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "6"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    }
+
+    auto prepare() -> bool final {
+        return true;
+    }
+
+    const std::shared_ptr<moodycamel::BlockingConcurrentQueue<Preferences>> queue =
+            std::make_shared<moodycamel::BlockingConcurrentQueue<Preferences>>();
+};
+
+auto config(const size_t slots) -> ReactionConfig {
+    ReactionConfig config;
+    config.enabled = true;
+    config.slots = slots;
+    config.weight = WEIGHT;
+    return config;
+}
+
+auto blended(const double fitness, const double bars, const double inputs, const double reversals) -> double {
+    return (1 - WEIGHT) * fitness + WEIGHT / (1 + (inputs + reversals) / bars);
+}
+
+}  // namespace
+
+TEST(ReactionsTest, BlendsInputsPerBar) {
+    Reactions reactions(config(16));
+    ASSERT_EQ(reactions.blend(3, 0.7), 0.7);
+
+    reactions.play(3);
+    ASSERT_DOUBLE_EQ(reactions.blend(3, 0.7), blended(0.7, 1, 0, 0));
+    reactions.play(3);
+    reactions.react(false);
+    reactions.react(false);
+    reactions.react(true);
+    ASSERT_DOUBLE_EQ(reactions.blend(3, 0.7), blended(0.7, 2, 3, 1));
+    // Nobody else has played
+    ASSERT_EQ(reactions.blend(4, 0.7), 0.7);
+}
+
+TEST(ReactionsTest, ANewConductorTakesOverItsSlot) {
+    Reactions reactions(config(4));
+    reactions.play(1);
+    reactions.react(true);
+    reactions.react(true);
+    ASSERT_DOUBLE_EQ(reactions.blend(1, 0.5), blended(0.5, 1, 2, 2));
+
+    // 5 lands on the same slot, and starts with none of 1's reactions
+    reactions.play(5);
+    ASSERT_EQ(reactions.blend(1, 0.5), 0.5);
+    ASSERT_DOUBLE_EQ(reactions.blend(5, 0.5), blended(0.5, 1, 0, 0));
+    reactions.react(false);
+    ASSERT_DOUBLE_EQ(reactions.blend(5, 0.5), blended(0.5, 1, 1, 0));
+
+    // And 1 starts over when it plays again
+    reactions.play(1);
+    ASSERT_DOUBLE_EQ(reactions.blend(1, 0.5), blended(0.5, 1, 0, 0));
+    ASSERT_EQ(reactions.blend(5, 0.5), 0.5);
+}
+
+TEST(ReactionsTest, OnlyReversalsUnderTheSameConductorCount) {
+    auto reactions = std::make_shared<Reactions>(config(16));
+    TestAudience audience;
+    audience.attributeReactions(reactions);
+
+    reactions->play(1);
+    audience.preferenceUpdated("energy", 1);
+    audience.preferenceUpdated("energy", -1);
+    ASSERT_DOUBLE_EQ(reactions->blend(1, 0.5), blended(0.5, 1, 2, 1));
+
+    // Turning energy back up is the first thing the audience did to this conductor
+    reactions->play(2);
+    audience.preferenceUpdated("energy", 1);
+    ASSERT_DOUBLE_EQ(reactions->blend(2, 0.5), blended(0.5, 1, 1, 0));
+
+    // Nor does playing another bar of it forget what they did
+    reactions->play(2);
+    audience.preferenceUpdated("energy", -1);
+    audience.preferenceUpdated("vibe", -1);
+    ASSERT_DOUBLE_EQ(reactions->blend(2, 0.5), blended(0.5, 2, 3, 1));
+}
+
+TEST(AudienceTest, SnapshotsAreWholeWhileInputArrives) {
+    TestAudience audience;
+    Preferences sent;
+    ASSERT_TRUE(audience.queue->try_dequeue(sent));
+
+    // The MIDI callback keeps turning energy up while the generation thread reads
+    std::thread input([&audience] () {
+        for (int i = 0; i < 100; i++) {
+            audience.preferenceUpdated("energy", 1);
+        }
+    });
+    double energy = 128;
+    for (int i = 0; i < 100; i++) {
+        const Preferences gathered = audience.gatherPreferences();
+        ASSERT_TRUE(audience.queue->try_dequeue(sent));
+        // What was sent is what the caller gets back
+        ASSERT_EQ(sent.at("energy").current, gathered.at("energy").current);
+        ASSERT_GE(gathered.at("energy").current, energy);
+        energy = gathered.at("energy").current;
+    }
+    input.join();
+    ASSERT_EQ(audience.snapshot().at("energy").current, 228);
+    ASSERT_EQ(audience.snapshot().at("vibe").current, 6);
+}
+
+}  // namespace audiogene
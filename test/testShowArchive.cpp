@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "individual.hpp"
+#include "showarchive.hpp"
+
+namespace audiogene {
+
+namespace {
+
+auto genes() -> std::shared_ptr<const Genes> {
+    auto genes = std::make_shared<Genes>();
+    genes->emplace_back("energy", Expression(0, 255, 128, false, ExpressionActivates::OnBar));
+    genes->emplace_back("vibe", Expression(1, 12, 6, false, ExpressionActivates::OnBar));
+    return genes;
+}
+
+auto conductor(const double energy, const double vibe, const double fitness) -> Individual {
+    Individual individual(genes(), Genome{energy, vibe});
+    individual.setFitness(fitness);
+    return individual;
+}
+
+auto preferences(const double energy, const double vibe) -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, energy));
+    preferences.emplace("vibe", Preference(1, 12, vibe));
+    return preferences;
+}
+
+auto config(const std::string& name, const size_t capacity) -> ShowArchiveConfig {
+    ShowArchiveConfig config;
+    config.enabled = true;
+    config.file = ::testing::TempDir() + "audiogene_" + name + ".archive";
+    config.capacity = capacity;
+    std::remove(config.file.c_str());
+    return config;
+}
+
+}  // namespace
+
+TEST(ShowArchiveTest, ReopensWhatWasRecorded) {
+    const Individual seed = conductor(0, 1, 0);
+    const ShowArchiveConfig made = config("reopen", 4);
+    {
+        ShowArchive archive(made, seed);
+        ASSERT_EQ(archive.size(), 0u);
+        archive.record(conductor(10, 2, 0.8), preferences(20, 3));
+        archive.record(conductor(200, 11, 0.6), preferences(210, 10));
+        ASSERT_EQ(archive.size(), 2u);
+    }
+    // The file's capacity wins over the config's
+    ShowArchiveConfig reopened = made;
+    reopened.capacity = 1;
+    ShowArchive archive(reopened, seed);
+    ASSERT_EQ(archive.size(), 2u);
+    const Individuals elites = archive.nearest(preferences(205, 11), 2);
+    ASSERT_EQ(elites.size(), 2u);
+    ASSERT_EQ(elites[0].genome(), (Genome{200, 11}));
+    ASSERT_EQ(elites[0].fitness(), 0.6);
+    ASSERT_EQ(elites[1].genome(), (Genome{10, 2}));
+    ASSERT_EQ(elites[1].fitness(), 0.8);
+    std::remove(made.file.c_str());
+}
+
+TEST(ShowArchiveTest, OnlyAFitterEliteReplacesOneNearby) {
+    const ShowArchiveConfig made = config("replace", 4);
+    ShowArchive archive(made, conductor(0, 1, 0));
+    archive.record(conductor(10, 2, 0.5), preferences(100, 6));
+
+    // Within SHOW_ARCHIVE_RADIUS of the first preferences
+    archive.record(conductor(20, 3, 0.4), preferences(101, 6));
+    ASSERT_EQ(archive.size(), 1u);
+    ASSERT_EQ(archive.nearest(preferences(100, 6), 1).front().genome(), (Genome{10, 2}));
+
+    archive.record(conductor(30, 4, 0.9), preferences(101, 6));
+    ASSERT_EQ(archive.size(), 1u);
+    ASSERT_EQ(archive.nearest(preferences(100, 6), 1).front().genome(), (Genome{30, 4}));
+
+    // Further away gets its own record
+    archive.record(conductor(40, 5, 0.1), preferences(150, 6));
+    ASSERT_EQ(archive.size(), 2u);
+    std::remove(made.file.c_str());
+}
+
+TEST(ShowArchiveTest, OverwritesTheOldestOnceFull) {
+    const ShowArchiveConfig made = config("full", 3);
+    ShowArchive archive(made, conductor(0, 1, 0));
+    for (int i = 0; i < 5; i++) {
+        archive.record(conductor(i, 1, 0.5), preferences(50 * i, 6));
+    }
+    ASSERT_EQ(archive.size(), 3u);
+    // The first two were overwritten by the last two, in turn
+    const Individuals elites = archive.nearest(preferences(0, 6), 3);
+    ASSERT_EQ(elites.size(), 3u);
+    ASSERT_EQ(elites[0].genome(), (Genome{2, 1}));
+    ASSERT_EQ(elites[1].genome(), (Genome{3, 1}));
+    ASSERT_EQ(elites[2].genome(), (Genome{4, 1}));
+
+    // And the next one after them is the oldest left
+    archive.record(conductor(5, 1, 0.5), preferences(250, 6));
+    ASSERT_EQ(archive.nearest(preferences(0, 6), 1).front().genome(), (Genome{3, 1}));
+    std::remove(made.file.c_str());
+}
+
+TEST(ShowArchiveTest, RejectsAHeaderThatDoesntFit) {
+    const ShowArchiveConfig made = config("corrupt", 4);
+    const Individual seed = conductor(0, 1, 0);
+    ShowArchive(made, seed).record(conductor(10, 2, 0.8), preferences(20, 3));
+
+    ShowArchiveHeader header{};
+    {
+        std::ifstream in(made.file, std::ios::binary);
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    }
+    const auto corrupt = [&made] (const ShowArchiveHeader& corrupted) {
+        std::fstream out(made.file, std::ios::binary | std::ios::in | std::ios::out);
+        out.write(reinterpret_cast<const char*>(&corrupted), sizeof(corrupted));
+    };
+    std::vector<ShowArchiveHeader> corruptions(4, header);
+    // Names overlapping the header
+    corruptions[0].namesOffset = 0;
+    // Sizes that would wrap around if they were added or multiplied
+    corruptions[1].namesSize = std::numeric_limits<uint64_t>::max() - header.namesOffset + 1;
+    corruptions[2].capacity = std::numeric_limits<uint64_t>::max() / sizeof(double) + 2;
+    corruptions[2].count = 1;
+    corruptions[3].recordsOffset = std::numeric_limits<uint64_t>::max() - 7;
+    for (const ShowArchiveHeader& corrupted : corruptions) {
+        corrupt(corrupted);
+        ASSERT_THROW(ShowArchive(made, seed), std::runtime_error);
+    }
+
+    corrupt(header);
+    ASSERT_EQ(ShowArchive(made, seed).size(), 1u);
+    std::remove(made.file.c_str());
+}
+
+}  // namespace audiogene
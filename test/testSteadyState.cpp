@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "individual.hpp"
+#include "steadystate.hpp"
+
+namespace audiogene {
+
+namespace {
+
+// Long enough that the breeder only runs a batch when preferences arrive
+constexpr std::chrono::hours ONE_BATCH_AT_A_TIME(1);
+
+auto preferences() -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, 250));
+    preferences.emplace("vibe", Preference(1, 12, 2));
+    return preferences;
+}
+
+// Sends the same preferences again, which rescores everyone identically and breeds one more batch
+auto nextBatch(SteadyState* steadyState) -> std::vector<double> {
+    const uint64_t bred = steadyState->steps() + STEADY_STATE_BATCH;
+    steadyState->setPreferences(preferences());
+    while (steadyState->steps() < bred) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Waits for the batch to finish, and comes back fittest first
+    return steadyState->checkpoint().fitness;
+}
+
+}  // namespace
+
+TEST(SteadyStateTest, ChildrenOnlyReplaceTheLeastFit) {
+    const Individual seed({
+        {"energy", {{"min", "0"}, {"max", "255"}, {"current", "0"}, {"round", "false"}, {"activates", "OnBar"}}},
+        {"vibe", {{"min", "1"}, {"max", "12"}, {"current", "12"}, {"round", "true"}, {"activates", "OnBar"}}}});
+    SteadyState steadyState(PopulationConfig(16, 0, 0.5), seed, ONE_BATCH_AT_A_TIME);
+
+    std::vector<double> before = nextBatch(&steadyState);
+    bool improved = false;
+    for (int batch = 0; batch < 20; batch++) {
+        const std::vector<double> after = nextBatch(&steadyState);
+        ASSERT_EQ(after.size(), before.size());
+        ASSERT_EQ(steadyState.fittest().fitness(), after.front());
+
+        // Swapping the least fit for someone fitter can only raise each rank
+        for (size_t i = 0; i < after.size(); i++) {
+            ASSERT_GE(after[i], before[i]);
+        }
+        // Whoever left was no fitter than anyone who stayed
+        std::vector<double> left;
+        std::vector<double> stayed;
+        std::set_difference(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(left),
+                std::greater<double>());
+        std::set_intersection(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(stayed),
+                std::greater<double>());
+        if (!left.empty() && !stayed.empty()) {
+            ASSERT_LE(left.front(), stayed.back());
+        }
+        improved = improved || after.back() > before.back();
+        before = after;
+    }
+    ASSERT_TRUE(improved);
+}
+
+}  // namespace audiogene
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "individual.hpp"
+#include "surrogate.hpp"
+
+namespace audiogene {
+
+namespace {
+
+auto genes() -> std::shared_ptr<const Genes> {
+    auto genes = std::make_shared<Genes>();
+    genes->emplace_back("energy", Expression(0, 255, 128, false, ExpressionActivates::OnBar));
+    genes->emplace_back("vibe", Expression(1, 12, 6, false, ExpressionActivates::OnBar));
+    return genes;
+}
+
+// How far the audience moves, on average over the genes' ranges; least at energy 0.3 and vibe 0.7 of their ranges
+auto discontent(const Genome& genome) -> double {
+    const double energy = genome[0] / 255;
+    const double vibe = (genome[1] - 1) / 11;
+    return 0.05 + 0.4 * (energy - 0.3) * (energy - 0.3) + 0.2 * (vibe - 0.7) * (vibe - 0.7);
+}
+
+auto preferences(const double energy) -> Preferences {
+    Preferences preferences;
+    preferences.emplace("energy", Preference(0, 255, energy));
+    preferences.emplace("vibe", Preference(1, 12, 6));
+    return preferences;
+}
+
+auto random(std::mt19937* rng) -> Individual {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    return Individual(genes(), Genome{255 * uniform(*rng), 1 + 11 * uniform(*rng)});
+}
+
+}  // namespace
+
+TEST(SurrogateTest, LearnsAQuadraticResponse) {
+    std::mt19937 rng(3);
+    SurrogateConfig config;
+    config.weight = 1;
+    const Individual seed(genes(), Genome{0, 1});
+    Surrogate surrogate(config, seed);
+
+    // Only energy moves, by enough that the mean over both genes is the discontent
+    const Preferences before = preferences(0);
+    for (int i = 0; i < 400; i++) {
+        const Individual conductor = random(&rng);
+        surrogate.observe(conductor, before, preferences(2 * 255 * discontent(conductor.genome())));
+    }
+    for (int i = 0; i < 50; i++) {
+        const Genome genome = random(&rng).genome();
+        ASSERT_NEAR(surrogate.predict(genome), -discontent(genome), 1e-4);
+    }
+    // The error is a moving average, so the first guesses have long since been forgotten
+    ASSERT_LT(surrogate.error(), 1e-3);
+
+    // With fitness tied, whoever the audience is most content with conducts
+    Individuals candidates;
+    for (int i = 0; i < 100; i++) {
+        candidates.push_back(random(&rng));
+        candidates.back().setFitness(0.5);
+    }
+    Individual conductor(genes(), Genome{255, 12});
+    conductor.setFitness(0.5);
+    ASSERT_TRUE(surrogate.screen(candidates, &conductor));
+    for (const Individual& candidate : candidates) {
+        ASSERT_LE(discontent(conductor.genome()), discontent(candidate.genome()));
+    }
+}
+
+TEST(SurrogateTest, WontScreenBeforeItCanFitEveryWeight) {
+    std::mt19937 rng(4);
+    const Individual seed(genes(), Genome{0, 1});
+    Surrogate surrogate(SurrogateConfig(), seed);
+    Individuals candidates(1, random(&rng));
+    candidates.front().setFitness(1);
+    Individual conductor = random(&rng);
+    conductor.setFitness(0);
+
+    // A bias, then each gene and its square
+    for (int i = 0; i < 5; i++) {
+        ASSERT_FALSE(surrogate.screen(candidates, &conductor));
+        surrogate.observe(conductor, preferences(0), preferences(10));
+    }
+    ASSERT_TRUE(surrogate.screen(candidates, &conductor));
+}
+
+}  // namespace audiogene
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 Grant Elliott <grant@grantelliott.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "trace.hpp"
+
+namespace audiogene {
+namespace trace {
+
+TEST(TraceTest, KeepsEveryEventUntilTheRingFills) {
+    ThreadBuffer buffer(1);
+    for (uint64_t i = 0; i < 10; i++) {
+        buffer.push(Event{"event", i, 1});
+    }
+    const std::vector<Event> events = buffer.events();
+    ASSERT_EQ(events.size(), 10u);
+    ASSERT_EQ(events.front().startNs, 0u);
+    ASSERT_EQ(events.back().startNs, 9u);
+    ASSERT_EQ(buffer.overwritten(), 0u);
+}
+
+TEST(TraceTest, OverwritesTheOldestEventsOnceFull) {
+    ThreadBuffer buffer(1);
+    const uint64_t pushed = TRACE_BUFFER_EVENTS + 100;
+    for (uint64_t i = 0; i < pushed; i++) {
+        buffer.push(Event{"event", i, 1});
+    }
+    const std::vector<Event> events = buffer.events();
+    ASSERT_EQ(events.size(), TRACE_BUFFER_EVENTS);
+    ASSERT_EQ(events.front().startNs, 100u);
+    ASSERT_EQ(events.back().startNs, pushed - 1);
+    for (size_t i = 1; i < events.size(); i++) {
+        ASSERT_EQ(events[i].startNs, events[i - 1].startNs + 1);
+    }
+    ASSERT_EQ(buffer.overwritten(), 100u);
+}
+
+}  // namespace trace
+}  // namespace audiogene